@@ -32,6 +32,7 @@
 
 #include "nfp.h"
 #include "nfpioctl.h"
+#include "nfpdma.h"
 
 #include <linux/sched.h>
 #include <linux/kthread.h> // for kthread_create
@@ -63,6 +64,79 @@ static struct pci_device_id pci_id[] = {
 };  /**< The pci express device that this driver will manage.  */
 MODULE_DEVICE_TABLE (pci, pci_id);  /**< Exposes vendor/device in the  device table.  */
 
+static uint completion_mode = NFP_COMPLETION_POLL;
+module_param (completion_mode, uint, S_IRUGO);
+MODULE_PARM_DESC (completion_mode, "Completion mode at load time: 0 polling (default), 1 interrupt (MSI), 2 hybrid");
+
+static uint max_payload = 0;
+module_param (max_payload, uint, S_IRUGO);
+MODULE_PARM_DESC (max_payload, "Max Payload Size in bytes at load time. 0 keeps the value of the firmware (default)");
+
+static uint max_read_request = 4096;
+module_param (max_read_request, uint, S_IRUGO);
+MODULE_PARM_DESC (max_read_request, "Max Read Request Size in bytes at load time (default 4096)");
+
+static uint dma_engines = 1;
+module_param (dma_engines, uint, S_IRUGO);
+MODULE_PARM_DESC (dma_engines, "DMA engines decoded by the bitstream (default 1: dma_logic.v only instantiates the engine 0)");
+
+
+/**
+* @brief MSI handler. The DMA core raises it when a descriptor with generate_irq set has been
+* processed. The waiting process checks the state of the engine by itself.
+*
+* @param irq The interrupt line.
+* @param dev_id The struct nfp_card of the device.
+*
+* @return IRQ_HANDLED
+*/
+static irqreturn_t nfp_irq_handler (int irq, void *dev_id)
+{
+  struct nfp_card *card = (struct nfp_card *) dev_id;
+
+  card->irq_count++;
+  wake_up_interruptible (&card->dma_wait);
+  return IRQ_HANDLED;
+}
+
+/**
+* @brief Allocate the MSI of the device. If it is not possible the driver keeps working in
+* polling mode.
+*
+* @param pdev Pointer to a pci_dev device.
+* @param card Main structure of the driver.
+*/
+static void nfp_setup_irq (struct pci_dev *pdev, struct nfp_card *card)
+{
+  card->msi_enabled = 0;
+
+  if (pci_enable_msi (pdev)) {
+    printk (KERN_INFO "nfp: MSI not available, using polling completion\n");
+  } else if (request_irq (pdev->irq, nfp_irq_handler, 0, DEVICE_NAME, card)) {
+    printk (KERN_INFO "nfp: The MSI could not be requested, using polling completion\n");
+    pci_disable_msi (pdev);
+  } else {
+    card->msi_enabled = 1;
+  }
+
+  if (completion_mode != NFP_COMPLETION_POLL && dma_set_completion_mode (completion_mode, card)) {
+    printk (KERN_INFO "nfp: Completion mode %u not available, using polling completion\n", completion_mode);
+  }
+}
+
+/**
+* @brief Release the resources of nfp_setup_irq.
+*/
+static void nfp_free_irq (struct pci_dev *pdev, struct nfp_card *card)
+{
+  if (card->msi_enabled) {
+    dma_set_completion_mode (NFP_COMPLETION_POLL, card);
+    free_irq (pdev->irq, card);
+    pci_disable_msi (pdev);
+    card->msi_enabled = 0;
+  }
+}
+
 
 
 /*
@@ -94,54 +168,70 @@ Explanation: http://billauer.co.il/blog/2011/05/pcie-pci-express-linux-max-paylo
 
 */
 /**
-* @brief This function will set the pcie payload to the maximum possible.
+* @brief Largest payload that the device can use: its capability, limited by the payload
+* programmed in the bridge above it (the bridge would reject larger TLPs).
+*
+* @param dev Pointer to a pci_dev device.
+*
+* @return The payload encoded as in the Device Control Register (2^x * 128 bytes).
+*/
+static u16 pci_payload_limit (struct pci_dev *dev)
+{
+  int pos, ppos;
+  u16 dcap, pctl, dmax, pmax;
+  struct pci_dev *parent = dev->bus->self;
+
+  pos = pci_find_capability (dev, PCI_CAP_ID_EXP);
+  if (!pos)
+    return 0;
+  pci_read_config_word (dev, pos + PCI_EXP_DEVCAP, &dcap);
+  dmax = (dcap & PCI_EXP_DEVCAP_PAYLOAD);       /* Maximum payload */
+
+  ppos = parent ? pci_find_capability (parent, PCI_CAP_ID_EXP) : 0;
+  if (!ppos)
+    return dmax;
+  pci_read_config_word (parent, ppos + PCI_EXP_DEVCTL, &pctl);
+  pmax = (pctl & PCI_EXP_DEVCTL_PAYLOAD) >> 5;  /* Parent MaxPayload setting */
+
+  return min (dmax, pmax);
+}
+
+/**
+* @brief This function will set the pcie payload of the device.
 *
 * @param pdev Pointer to a pci_dev device.
-* @param payload The payload that will be set. 0 indicates maximum possible.
+* @param payload The payload that will be set in bytes: a power of 2 from 128 to 4096, not over
+* pci_payload_limit.
 *
-* @return The possible error code.
+* @return 0 if ok, a negative errno otherwise.
 */
 static int pci_set_payload (struct pci_dev *dev, uint16_t payload)
 {
-  int pos, ppos;
+  int pos;
   u16 psz;
-  u16 dctl, dsz, dcap, dmax;
-  struct pci_dev *parent;
+  u16 dctl, dsz;
 
-  if (! ( (payload >= 128 && payload <= 512) || payload == 0)) {
-    return -1;
+  if (payload < 128 || payload > 4096 || (payload & (payload - 1))) {
+    return -EINVAL;
   }
 
-  parent = dev->bus->self;
   pos = pci_find_capability (dev, PCI_CAP_ID_EXP);
 
   if (!pos)
-    return 0;
+    return -ENODEV;
 
-  /* Read Device MaxPayload capability and setting */
+  /* Read Device MaxPayload setting */
   pci_read_config_word (dev, pos + PCI_EXP_DEVCTL, &dctl);
-  pci_read_config_word (dev, pos + PCI_EXP_DEVCAP, &dcap);
   dsz = (dctl & PCI_EXP_DEVCTL_PAYLOAD) >> 5;   /* Actual configuration */
-  dmax = (dcap & PCI_EXP_DEVCAP_PAYLOAD);       /* Maximum payload */
-  /* Read Parent MaxPayload setting */
-  ppos = pci_find_capability (parent, PCI_CAP_ID_EXP);
+  psz = ffs (payload) - 8;
 
-  if (!ppos)
-    return 0;
-
-  psz = payload == 0 ? dmax : payload >> 8;
-
-  /* If parent payload > device max payload -> error
-  * If parent payload > device payload -> set speed
-  * If parent payload <= device payload -> do nothing
-  */
-  if (psz > dmax) {
-    return -1;
-  } else if (psz > dsz) {
+  if (psz > pci_payload_limit (dev)) {
+    return -EINVAL;
+  } else if (psz != dsz) {
     dev_info (&dev->dev, "Setting MaxPayload to %d\n", 128 << psz);
-    pci_write_config_word (dev, pos + PCI_EXP_DEVCTL,
-                           (dctl & ~PCI_EXP_DEVCTL_PAYLOAD) +
-                           (psz << 5));
+    return pcibios_err_to_errno (pci_write_config_word (dev, pos + PCI_EXP_DEVCTL,
+                                 (dctl & ~PCI_EXP_DEVCTL_PAYLOAD) +
+                                 (psz << 5)));
   }
 
   return 0;
@@ -161,36 +251,74 @@ static int pci_set_payload (struct pci_dev *dev, uint16_t payload)
  *
  * If possible sets maximum read byte count
  *
- * @return The possible error code.
+ * @return 0 if ok, -EINVAL if the count is not valid, -ENODEV if the device is not PCIe, or the
+ * negative errno of the failed access to the configuration space.
  */
 int pcie_set_readrq (struct pci_dev *dev, int count)
 {
-  int cap, err = -EINVAL;
+  int cap, err = 0;
   u16 ctl, v;
 
-  if (count < 128 || count > 4096) {
-    return -1;
+  if (count < 128 || count > 4096 || (count & (count - 1))) {
+    return -EINVAL;
   }
 
   v = (ffs (count) - 8) << 12;
   cap = pci_find_capability (dev, PCI_CAP_ID_EXP);
 
   if (!cap) {
-    return -1;
+    return -ENODEV;
   }
 
   err = pci_read_config_word (dev, cap + PCI_EXP_DEVCTL, &ctl);
 
   if (err) {
-    return -1;
+    return pcibios_err_to_errno (err);
   }
 
   if ( (ctl & PCI_EXP_DEVCTL_READRQ) != v) {
     ctl &= ~PCI_EXP_DEVCTL_READRQ;
     ctl |= v;
-    err = pci_write_config_dword (dev, cap + PCI_EXP_DEVCTL, ctl);
+    err = pci_write_config_word (dev, cap + PCI_EXP_DEVCTL, ctl);
+  }
+
+  return pcibios_err_to_errno (err);
+}
+
+int nfp_pcie_config (struct nfp_card *card, struct pcie_config *pc)
+{
+  struct pci_dev *dev = card->pdev;
+  struct dma_common_block cb;
+  int pos, i, ret;
+  u16 dctl;
+
+  if ((pos = pci_find_capability (dev, PCI_CAP_ID_EXP)) == 0) {
+    return -ENODEV;
+  }
+  if (pc->max_payload || pc->max_read_request) {
+    // The sizes of the TLPs of the core are fixed at synthesis: the link must accept them
+    memcpy_fromio (&cb, &(card->dma->dma_common_block), sizeof (struct dma_common_block));
+    if ((pc->max_payload && pc->max_payload < (128U << cb.max_payload)) ||
+        (pc->max_read_request && pc->max_read_request < (128U << cb.max_read_request))) {
+      return -EINVAL;
+    }
+    for (i = 0; i < card->num_engines; i++) {
+      if (!dma_engine_idle (i, card)) {
+        return -EBUSY;
+      }
+    }
+    if (pc->max_payload && (ret = pci_set_payload (dev, pc->max_payload)) < 0) {
+      return ret;
+    }
+    if (pc->max_read_request && (ret = pcie_set_readrq (dev, pc->max_read_request)) < 0) {
+      return ret;
+    }
   }
 
+  pci_read_config_word (dev, pos + PCI_EXP_DEVCTL, &dctl);
+  pc->max_payload       = 128U << ((dctl & PCI_EXP_DEVCTL_PAYLOAD) >> 5);
+  pc->max_read_request  = 128U << ((dctl & PCI_EXP_DEVCTL_READRQ) >> 12);
+  pc->max_payload_limit = 128U << pci_payload_limit (dev);
   return 0;
 }
 
@@ -218,6 +346,8 @@ static int __devinit nfp_probe (struct pci_dev *pdev, const struct pci_device_id
 
   card->pdev  =  pdev;
   sema_init (&card->sem_op, 1);   /* We accept one IOCTL operation per time. No op has yet started. */
+  dma_init_engines (card);        /* Each engine accepts one IOCTL operation per time */
+  init_waitqueue_head (&card->dma_wait);
 
   /* Enable device */
   if ( (ret = pci_enable_device (pdev))) {
@@ -226,12 +356,12 @@ static int __devinit nfp_probe (struct pci_dev *pdev, const struct pci_device_id
     return ret;
   }
 
-  if (pci_set_payload (pdev, 128)) {
+  if (max_payload && (ret = pci_set_payload (pdev, max_payload))) {
     printk (KERN_ERR "nfp: Unable to adjust the PCIe payload!\n");
     goto  err_out_disable_device;
   }
 
-  if (pcie_set_readrq (pdev, 4096)) {
+  if (max_read_request && (ret = pcie_set_readrq (pdev, max_read_request))) {
     printk (KERN_ERR "nfp: Unable to adjust the PCIe read request!\n");
     goto  err_out_disable_device;
   }
@@ -286,6 +416,11 @@ static int __devinit nfp_probe (struct pci_dev *pdev, const struct pci_device_id
 
 
   card->dma = card->bar0 + (DMA_OFFSET * 8); //Bar 0 uses a 0x200 offset of 64 bit words.
+  // The registers of an engine that is not instantiated alias the ones of the engine 0: it cannot
+  // be detected from BAR0, so the number of engines of the bitstream is a parameter
+  card->num_engines = clamp_t (uint, dma_engines, 1, MAX_NUM_DMA_ENGINES);
+  printk (KERN_INFO "nfp: %u DMA engines\n", card->num_engines);
+  nfp_setup_irq (pdev, card);
 
   card->mmap_info.page_list = pci_alloc_consistent(pdev, MAX_PAGES * PAGE_SIZE, &card->mmap_info.dma_handle);
   if (card->mmap_info.page_list == NULL) {
@@ -297,6 +432,7 @@ static int __devinit nfp_probe (struct pci_dev *pdev, const struct pci_device_id
   return ret;
 
 err_iface:
+  nfp_free_irq (pdev, card);
   pci_iounmap (pdev, card->bar0);
   if (card->bar1) pci_iounmap (pdev, card->bar1);
   if (card->bar2) pci_iounmap (pdev, card->bar2);
@@ -335,6 +471,7 @@ static void __devexit nfp_remove (struct pci_dev *pdev)
     //kfree(card->mmap_info.page_list);
     printk (KERN_INFO "nfp: disabling device\n");
     nfpioctl_remove (pdev, card);
+    nfp_free_irq (pdev, card);
 
     pci_iounmap (pdev, card->bar0);
     if (card->bar1) pci_iounmap (pdev, card->bar1);
@@ -32,4 +32,16 @@
 #define NFPDRIVERMAIN_H
 #include "nfp_types.h"
 
+/**
+* @brief Program the Max Payload Size and the Max Read Request Size of the device (the values
+* of pc that are not 0) and return the ones in effect. The link must accept the TLPs of the DMA
+* core and no engine may be running.
+*
+* @param card The pointer to the main structure that represents the device
+* @param pc The configuration (struct pcie_config in ioctl_commands.h)
+*
+* @return 0 if ok, -EINVAL if a value is out of range, -EBUSY if an engine is running.
+*/
+int nfp_pcie_config (struct nfp_card *card, struct pcie_config *pc);
+
 #endif
@@ -46,6 +46,7 @@
 #include <linux/interrupt.h>
 
 #include "../include/ioctl_commands.h"
+#include "../include/dma_core.h"
 
 #define PCI_VENDOR_ID_NFP 0x10EE /**< Vendor of the PCI device */
 #define PCI_DEVICE_ID_NFP 0x7038 /**< Device code */
@@ -54,112 +55,79 @@
 #define DEVICE_NAME        "nfp"     /**< Name of the device ( a char device will be create under /dev/DEVICE_NAME ) */
 #define CPU_AFFINITY_MASK  0x02      /**< Core that will run the module. it must be a mask. Example: Proccessors 3 and 4 1100b */
 
-#define MAX_NUM_DMA_ENGINES 2        /**< Maximum number of DMA engines in the device */
 
-#define ADDRES_OFFSET           0x199  /**< Initial offset in the BAR0 that indicates the address of the second bar (so a translation from PCIe addresses to FPGA ones can be made). */
-#define MAX_NUM_DMA_DESCRIPTORS 1024   /**< Maximum number of DMA engines in the device */
-#define OFFSET_BETWEEN_ENGINES  0x4000 /**< Offset in 64b words between engines in the HDL design */
-#define DMA_OFFSET              0x200  /**< Initial offset in the BAR0 to the DMA registers.
-At DMA_OFFSET                          dma_engine[0]
-At DMA_OFFSET+OFFSET_BETWEEN_ENGINES   dma_engine[1]
-
-.
-.
-.
-
-At DMA_OFFSET+i*OFFSET_BETWEEN_ENGINES dma_engine[i]
-
-
-
-At DMA_OFFSET+MAX_NUM_DMA_ENGINES*OFFSET_BETWEEN_ENGINES:  dma_common_block
 
+/**
+* @brief A physically contiguous region of the registered buffer.
 */
-
-
-#define MAX_TLP_SIZE   128     //In bytes. It must be a 32b multiple
-
-
-struct  __attribute__ ((__packed__)) dma_descriptor {
-  u64  address;
-  u64  size;
-  u64  generate_irq : 1;
-  u64  u0           : 63;
-  u64  latency;
-
-  u64  time_at_req;   // Divided by 4
-  u64  time_at_comp;  // Divided by 4
-  u64  bytes_at_req;  // Divided by 4
-  u64  bytes_at_comp; // Divided by 4
-
+struct mem_segment {
+  u64 offset;                /**<  Offset of the region in the buffer */
+  u64 length;                /**<  Length of the region */
+  u64 address;               /**<  Kernel address of the region */
 };
 
+struct mem {
+  void      *virtual;        /**<  Pointer to a region of memory */
 
-struct  __attribute__ ((__packed__)) dma_engine {
-  u64  enable         : 1;
-  u64  reset          : 1;
-  u64  is_c2s         : 1;
-  u64  is_s2c         : 1;
-  u64  address_mode   : 2;
-  u64  u0             : 58;
-  u16  complete_until_descriptor;
-  u16  u1;
-  u32  u2;
-  u64  total_time;             //Read: Time that consumed the previous operation. Write: Maximum timeout for a C2S operation
-  u64  total_bytes;            //Only read
-
-  u64  host_buffer_size;
-  u64  address_offset;
-  u64  address_inc;
-  u64  number_of_tlps;
-  struct dma_descriptor  dma_descriptor[MAX_NUM_DMA_DESCRIPTORS];
-
-  u64 u4[OFFSET_BETWEEN_ENGINES - 4 - MAX_NUM_DMA_DESCRIPTORS * sizeof(struct dma_descriptor) / 8];    // Unused
+  u64       length;          /**<  Length of the allocated memory */
+  u64       page_size;       /**<  Size of the pages declared by the user (informative) */
+  u64       nsegments;       /**<  Number of elements in segment */
+  struct mem_segment *segment; /**<  Scatter-gather table of the buffer sorted by offset (vmalloc). The pins of the pages are released region by region */
 };
 
-struct __attribute__ ((__packed__)) dma_common_block {
-  uint64_t max_payload : 3; // The maximum payload size being used by the DMA core.
-  // this size may be different than the system-programmed Max Payload
-  // The size is expressed as: 2^{max_payload} * 128 bytes. Common examples:
-  //    · 000 = 128  Bytes
-  //    · 001 = 256  Bytes
-  //    · 010 = 512  Bytes
-  //    · 011 = 1024 Bytes
-  //    · 100 = 2048 Bytes
-  //    · 101 = 4096 Bytes
-  uint64_t max_read_request : 3; // The read request size being used by the DMA core.
-  // this size may be different than the system-programmed Max Read Request
-  // The size is expressed as: 2^{max_payload} * 128 bytes. Common examples:
-  //    · 000 = 128  Bytes
-  //    · 001 = 256  Bytes
-  //    · 010 = 512  Bytes
-  //    · 011 = 1024 Bytes
-  //    · 100 = 2048 Bytes
-  //    · 101 = 4096 Bytes
-  uint64_t irq_enable  : 1; // Global DMA Interrupt Enable; this bit globally enables/disables interrupts.
-  uint64_t user_reset  : 1;
-
-  uint64_t engine_finished : 16;  // Bitmask of engines that have completed the operation. It is useful if
-  // a polling strategy is applied.
-  uint64_t u0 : 32;
+#define DMA_MAP_CACHE_ENTRIES 32 /**< Streaming DMA mappings kept alive between descriptors */
 
+/**
+* @brief A streaming DMA mapping of [address, address+size) that is reused by every descriptor
+* whose memory is inside it.
+*/
+struct dma_map_entry {
+  u64        address;       /**< Kernel address of the region (key) */
+  u64        size;          /**< Size of the region (key) */
+  dma_addr_t dma_handle;    /**< Bus address returned by pci_map_single */
 };
 
-
-
-struct  __attribute__ ((__packed__)) dma_core {
-  struct dma_engine       dma_engine[MAX_NUM_DMA_ENGINES];
-  struct dma_common_block dma_common_block;
+/**
+* @brief Mappings created on first use and released when their buffer is unregistered (or the
+* file closed), so the IOMMU work is out of the per-descriptor path.
+*/
+struct dma_map_cache {
+  struct dma_map_entry entry[DMA_MAP_CACHE_ENTRIES];
+  u32                  used;          /**< Valid entries, packed at the beginning of entry */
 };
 
+struct nfp_card;
 
+/**
+* @brief State of an open file of the char device. Each one registers its own buffer and leases
+* the engines that it drives, so independent processes (or threads with their own file) can use
+* different engines of the device at the same time.
+*/
+struct nfp_context {
+  struct nfp_card     *card;
+  struct mem           buffer[NFP_MAX_BUFFERS]; /**< The buffers registered through this file, indexed by their handle */
+  struct semaphore     sem_map;     /**< Mutex Semaphore of map_cache, which is shared by the engines of the context */
+  struct dma_map_cache map_cache;   /**< Mappings of buffer */
+};
 
-struct mem {
-  void      *virtual;        /**<  Pointer to a region of memory */
-
-  u64       length;          /**<  Length of the allocated memory */
-  u64       page_size;          /**<  Length of the allocated memory */
-  u64       npages;          /**<  Number of pages pointed by virtual */
-  u64       page_address[16];   /**<  Direction of such pages */
+/**
+* @brief State of a DMA engine. The descriptor operations over an engine are serialised by its
+* own semaphore, so different engines can be driven at the same time.
+*/
+struct nfp_engine {
+  struct semaphore sem_op;         /**< Mutex Semaphore for the IOCTL operations over this engine */
+  struct nfp_context *owner;       /**< Context that leases the engine. NULL if it is free. Changed with sem_op held */
+
+  u64 s, e;                        /**< Start time, end time of the last DMA operation */
+  u32 ldescriptor;                 /**< Next position of the descriptor ring */
+  u32 async_head;                  /**< Oldest submitted descriptor that has not been reaped */
+  u32 async_control;               /**< Control word (without enable) of the descriptors in flight */
+  struct dma_descriptor_sw async_config; /**< Configuration of the descriptors in flight */
+
+  u64 phy_addr[MAX_NUM_DMA_DESCRIPTORS];       /**< Bus address of each position of the ring */
+  u64 phy_size[MAX_NUM_DMA_DESCRIPTORS];
+  u8  phy_addr_valid[MAX_NUM_DMA_DESCRIPTORS]; /**< The mapping is not cached and must be released */
+  u32 phy_addr_count;                          /**< Mappings in phy_addr that must be released after the operation */
 };
 
 struct mmap_info {
@@ -173,8 +141,8 @@ struct mmap_info {
 
 
 /**
-* @brief Main structure of the driver. All information about the device and the DMA transactions
-* (descriptors, user memory,...) are registered here.
+* @brief Main structure of the driver. All information about the device and the DMA engines is
+* registered here. The user memory belongs to the context of each open file (struct nfp_context).
 */
 struct nfp_card {
   struct pci_dev *pdev;        /**< Pointer to the physical dev */
@@ -190,11 +158,17 @@ struct nfp_card {
 
 
 
-  struct semaphore sem_op;     /**< Mutex Semaphore for IOCTL operations. */
+  struct semaphore sem_op;     /**< Mutex Semaphore for the IOCTL operations over the whole device. */
 
   struct dma_core *dma;
-  struct mem  buffer;
-  struct mmap_info mmap_info;
+  struct mmap_info mmap_info;  /**< Kernel pages of the device, shared by every context */
+  struct nfp_engine engine[MAX_NUM_DMA_ENGINES];
+  u32               num_engines;      /**< Engines decoded by the bitstream (module parameter dma_engines). The IOCTLs over the rest fail */
+
+  u8                msi_enabled;      /**< The MSI of the device has been allocated and requested */
+  u32               completion_mode;  /**< enum nfp_completion_mode */
+  wait_queue_head_t dma_wait;         /**< Processes waiting for the end of a DMA operation (IRQ and poll()) */
+  u64               irq_count;        /**< Number of interrupts received */
 };
 
 
@@ -30,12 +30,13 @@
 #include "nfpdma.h"
 #include <linux/io.h>
 #include <linux/time.h>
+#include <linux/wait.h>
+#include <linux/jiffies.h>
 
 
 
-u64 s = 0, e = 0; /* Start time, end time of the last DMA operation */
-u64 llength = 0;
-u32 ldescriptor = 0;
+#define DMA_TIMEOUT_US 10000000 /* If the OP lasts more than 10s... has the core failed? */
+#define DMA_IRQ_RECHECK_US 1000 /* Maximum sleep between two checks of the engine in interrupt mode */
 
 
 static inline u64 getToD(void)
@@ -46,94 +47,461 @@ static inline u64 getToD(void)
 }
 
 
-u64 phy_addr[MAX_NUM_DMA_DESCRIPTORS];
-u64 phy_size[MAX_NUM_DMA_DESCRIPTORS];
+/**
+ * @brief Obtain the bus address of [address, address+size). The mapping is looked up in the
+ * DMA map cache of the context and created (and cached) on first use. A mapping of a larger
+ * region (NFPIOC_MAP_BUFFER over a huge page) serves every descriptor inside it, so the small
+ * buffers of a scatter-gather list do not need an entry each.
+ *
+ * @param cached Set to 1 if the mapping belongs to the cache, 0 if it must be released by the caller
+ * (or if it failed)
+ *
+ * @return The bus address. It must be checked with pci_dma_mapping_error.
+ */
+static u64 dma_map_cached(struct nfp_context *ctx, u64 address, u64 size, u8 *cached)
+{
+  struct dma_map_cache *mc = &ctx->map_cache;
+  struct pci_dev *pdev = ctx->card->pdev;
+  struct dma_map_entry *me;
+  dma_addr_t dma_handle;
+  u32 i;
 
-u8  phy_addr_valid[MAX_NUM_DMA_DESCRIPTORS] = {0};
+  down(&ctx->sem_map); // The cache is shared by the engines of the context
+  for (i = 0; i < mc->used; i++) {
+    me = &mc->entry[i];
+    if (me->address <= address && address + size <= me->address + me->size) {
+      *cached = 1;
+      up(&ctx->sem_map);
+      return (u64) me->dma_handle + (address - me->address);
+    }
+  }
 
+  *cached = mc->used < DMA_MAP_CACHE_ENTRIES;
+  if (!*cached) { // The cache is full. Pending descriptors may use any entry, so nothing is evicted
+    up(&ctx->sem_map);
+    return (u64) pci_map_single (pdev, (u8 *) address, size,  PCI_DMA_BIDIRECTIONAL);
+  }
+  me = &mc->entry[mc->used];
+  me->dma_handle = pci_map_single (pdev, (u8 *) address, size,  PCI_DMA_BIDIRECTIONAL);
+  if (pci_dma_mapping_error (pdev, me->dma_handle)) {
+    printk(KERN_ERR "nfp: The region could not be mapped\n");
+    *cached = 0; // Not in the cache, and there is nothing to release
+  } else {
+    me->address = address;
+    me->size    = size;
+    mc->used++;
+  }
+  dma_handle = me->dma_handle;
+  up(&ctx->sem_map);
+  return (u64) dma_handle;
+}
 
-void dma_set_window_size(u64 ws, struct nfp_card *card)
+/* The mapping points to memory of the buffer m */
+static int dma_map_in_buffer(struct dma_map_entry *me, struct mem *m)
 {
-  struct dma_core *dma = card->dma;
-  memcpy_toio(&(dma->dma_engine[0].total_bytes), &(ws), 8);
+  u64 i;
 
-  return;
+  for (i = 0; i < m->nsegments; i++) {
+    if (me->address >= m->segment[i].address && me->address < m->segment[i].address + m->segment[i].length) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void dma_map_cache_flush(struct nfp_context *ctx, struct mem *m)
+{
+  struct dma_map_cache *mc = &ctx->map_cache;
+  u32 i, kept = 0;
+
+  down(&ctx->sem_map);
+  for (i = 0; i < mc->used; i++) {
+    if (m == NULL || dma_map_in_buffer (&mc->entry[i], m)) {
+      pci_unmap_single (ctx->card->pdev, mc->entry[i].dma_handle, mc->entry[i].size, PCI_DMA_BIDIRECTIONAL);
+    } else {
+      mc->entry[kept++] = mc->entry[i]; // The entries stay packed
+    }
+  }
+  mc->used = kept;
+  up(&ctx->sem_map);
 }
 
 
-u64 writeDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card)
+int dma_map_region(struct nfp_context *ctx, u64 address, u64 size, u64 *bus_address)
+{
+  u8 cached;
+
+  *bus_address = dma_map_cached (ctx, address, size, &cached);
+  if (pci_dma_mapping_error (ctx->card->pdev, *bus_address)) {
+    return -EIO;
+  }
+  if (!cached) { // Nobody would release it
+    pci_unmap_single (ctx->card->pdev, *bus_address, size, PCI_DMA_BIDIRECTIONAL);
+    return -ENOSPC;
+  }
+  return 0;
+}
+
+void dma_init_engines(struct nfp_card *card)
 {
-  struct dma_core *dma = card->dma;
   int i;
+
+  for (i = 0; i < MAX_NUM_DMA_ENGINES; i++) {
+    sema_init (&card->engine[i].sem_op, 1);
+  }
+}
+
+int dma_engine_idle(u32 engine, struct nfp_card *card)
+{
+  return !(card->dma->dma_engine[engine].enable);
+}
+
+int dma_set_completion_mode(u32 mode, struct nfp_card *card)
+{
+  struct dma_common_block cb;
+
+  if (mode > NFP_COMPLETION_HYBRID) {
+    return -EINVAL;
+  }
+  if (mode != NFP_COMPLETION_POLL && !card->msi_enabled) {
+    return -ENODEV;
+  }
+
+  memcpy_fromio(&cb, &(card->dma->dma_common_block), sizeof(struct dma_common_block));
+  cb.irq_enable = mode != NFP_COMPLETION_POLL;
+  cb.user_reset = 0;
+  memcpy_toio(&(card->dma->dma_common_block), &cb, sizeof(struct dma_common_block));
+  card->completion_mode = mode;
+
+  return 0;
+}
+
+/**
+ * @brief Wait until the engine clears its enable bit, in the way selected by card->completion_mode.
+ * The fields s and e of the engine keep the start and end time of the operation.
+ *
+ * @param interruptible 0 to ignore the signals: the wait is only bounded by DMA_TIMEOUT_US.
+ *
+ * @return 0 if the operation finished, -ETIMEDOUT after DMA_TIMEOUT_US, -ERESTARTSYS if a signal
+ * was received first. The engine is still running in both cases.
+ */
+static int dma_wait_completion(u32 engine, struct nfp_card *card, int interruptible)
+{
+  struct nfp_engine *ne = &card->engine[engine];
   u8 exit_loop = 0;
-  u32 control;
+  u64 spin_us = DMA_TIMEOUT_US;
 
-  // Obtain the IO address
-  phy_addr[dd->index] = (u64) pci_map_single (card->pdev, (u8 *) dd->address, dd->buffer_size,  PCI_DMA_BIDIRECTIONAL);
+  if (card->completion_mode == NFP_COMPLETION_IRQ) {
+    spin_us = 0;
+  } else if (card->completion_mode == NFP_COMPLETION_HYBRID) {
+    spin_us = NFP_HYBRID_SPIN_US;
+  }
 
-  // Copy address and size to the FPGA
-  memcpy_toio(&(dma->dma_engine[0].host_buffer_size), &(dd->buffer_size), 8);
-  memcpy_toio(&(dma->dma_engine[0].number_of_tlps), &(dd->number_of_tlps), 8);
-  memcpy_toio(&(dma->dma_engine[0].address_offset), &(dd->address_offset), 8);
-  memcpy_toio(&(dma->dma_engine[0].address_inc), &(dd->address_inc), 8);
+  do { //Dont stub the cpu. If the OP lasts more than Xs... has the core failed? The time is measured in the FPGA, so we do not
+    // loose accuracy.
+    ne->e = getToD();
+    exit_loop = dma_engine_idle(engine, card) || (ne->e - ne->s) > spin_us;
+  } while ( !exit_loop );
+
+  // The interrupt is just a hint: the condition is always checked against the engine, and it is
+  // rechecked periodically in case the MSI is lost (or the design does not raise it).
+  while (!dma_engine_idle(engine, card) && (ne->e - ne->s) <= DMA_TIMEOUT_US) {
+    if (!interruptible) {
+      wait_event_timeout(card->dma_wait, dma_engine_idle(engine, card), usecs_to_jiffies(DMA_IRQ_RECHECK_US));
+    } else if (wait_event_interruptible_timeout(card->dma_wait, dma_engine_idle(engine, card), usecs_to_jiffies(DMA_IRQ_RECHECK_US)) < 0) {
+      return dma_engine_idle(engine, card) ? 0 : -ERESTARTSYS;
+    }
+    ne->e = getToD();
+  }
+
+  return dma_engine_idle(engine, card) ? 0 : -ETIMEDOUT;
+}
+
+/* Release the mappings of the descriptors of the ring that are not in the map cache */
+static void dma_release_mappings(struct nfp_engine *ne, struct nfp_card *card)
+{
+  int i;
+
+  for (i = 0; i < MAX_NUM_DMA_DESCRIPTORS && ne->phy_addr_count; i++) {
+    if (ne->phy_addr_valid[i]) {
+      pci_unmap_single (card->pdev, ne->phy_addr[i], ne->phy_size[i], PCI_DMA_BIDIRECTIONAL);
+      ne->phy_addr_count--;
+    }
+    ne->phy_addr_valid[i] = 0;
+  }
+}
+
+int dma_lease_engine(u32 engine, struct nfp_context *ctx)
+{
+  struct nfp_engine *ne = &ctx->card->engine[engine];
+
+  if (ne->owner != NULL && ne->owner != ctx) {
+    return -EBUSY;
+  }
+  ne->owner = ctx;
+  return 0;
+}
+
+int dma_release_engine(u32 engine, struct nfp_context *ctx)
+{
+  struct nfp_card *card = ctx->card;
+  struct nfp_engine *ne = &card->engine[engine];
+
+  if (ne->owner != ctx) {
+    return -EPERM;
+  }
+  // The descriptors in flight use the memory of the context: a signal must not cut the wait short,
+  // and an engine that is still running keeps its owner and its mappings
+  if (!dma_engine_idle(engine, card)) {
+    ne->s = getToD();
+    if (dma_wait_completion(engine, card, 0) < 0) {
+      printk(KERN_ERR "nfp: The engine %u did not finish before being released\n", engine);
+      return -EBUSY;
+    }
+  }
+  dma_release_mappings(ne, card);
+  ne->async_head = ne->ldescriptor; // The submitted descriptors are not reaped by the next owner
+  ne->owner      = NULL;
+  return 0;
+}
+
+void dma_set_window_size(u64 ws, u32 engine, struct nfp_card *card)
+{
+  struct dma_core *dma = card->dma;
+  memcpy_toio(&(dma->dma_engine[engine].total_bytes), &(ws), 8);
+
+  return;
+}
+
+/* Map the memory of a descriptor and copy its address, size and generate_irq flag to the position
+ * index of the ring. -EIO if the memory cannot be mapped: nothing is written to the device */
+static int dma_program_descriptor(struct dma_descriptor_sw *dd, u32 index, u64 generate_irq, struct nfp_card *card)
+{
+  struct dma_engine *de = &card->dma->dma_engine[dd->engine];
+  struct nfp_engine *ne = &card->engine[dd->engine];
+  u8 cached;
+
+  // Obtain the IO address. Reuse the mapping of a previous descriptor over the same region if possible
+  ne->phy_addr[index] = dma_map_cached (ne->owner, dd->address, dd->buffer_size, &cached);
+  if (pci_dma_mapping_error (card->pdev, ne->phy_addr[index])) {
+    return -EIO;
+  }
 
   // Copy address and size to the FPGA
-  memcpy_toio(&(dma->dma_engine[0].dma_descriptor[dd->index].address) , &(phy_addr[dd->index]), 8);
-  memcpy_toio(&(dma->dma_engine[0].dma_descriptor[dd->index].size) , &(dd->length), 8);
-  phy_addr_valid[dd->index] = 1;
-  phy_size[dd->index] = dd->buffer_size;
+  memcpy_toio(&(de->dma_descriptor[index].address) , &(ne->phy_addr[index]), 8);
+  memcpy_toio(&(de->dma_descriptor[index].size) , &(dd->length), 8);
+  memcpy_toio((u8 *) &(de->dma_descriptor[index].size) + 8, &generate_irq, 8); // bit 0 of the third word
+  if (!cached) {
+    ne->phy_addr_valid[index] = 1;
+    ne->phy_size[index] = dd->buffer_size;
+    ne->phy_addr_count++;
+  }
+  return 0;
+}
+
+/* Copy the configuration of the engine (common to every descriptor of a run) to the FPGA */
+static void dma_program_engine(struct dma_descriptor_sw *dd, u32 control, struct nfp_card *card)
+{
+  struct dma_engine *de = &card->dma->dma_engine[dd->engine];
+
+  memcpy_toio(&(de->host_buffer_size), &(dd->buffer_size), 8);
+  memcpy_toio(&(de->number_of_tlps), &(dd->number_of_tlps), 8);
+  memcpy_toio(&(de->address_offset), &(dd->address_offset), 8);
+  memcpy_toio(&(de->address_inc), &(dd->address_inc), 8);
+  memcpy_toio(de , &(control), 4);
+}
+
+/* Check dma_engine_manager.v to obtain the mapping scpecification of the control word */
+static u32 dma_control_word(struct dma_descriptor_sw *dd)
+{
+  u32 control;
 
-  // Copy the direction. Check dma_engine_manager.v to obtain the mapping scpecification
   control = dd->is_c2s_op << 2;
   control += dd->is_s2c_op ? (1 << 3) : 0;
   control += (dd->address_mode << 4);
-  memcpy_toio(&(dma->dma_engine[0]) , &(control), 4);
+  return control;
+}
+
+static u32 dma_active_index(u32 engine, struct nfp_card *card)
+{
+  u32 word;
+
+  memcpy_fromio(&word, &(card->dma->dma_engine[engine].complete_until_descriptor), 4);
+  return DMA_ACTIVE_INDEX(word);
+}
+
+/* Submitted descriptors that have not been reaped */
+static u32 dma_async_pending(struct nfp_engine *ne)
+{
+  return (ne->ldescriptor + MAX_NUM_DMA_DESCRIPTORS - ne->async_head) % MAX_NUM_DMA_DESCRIPTORS;
+}
+
+u32 dma_async_completed(u32 engine, struct nfp_card *card)
+{
+  struct nfp_engine *ne = &card->engine[engine];
+  u32 done = (dma_active_index(engine, card) + MAX_NUM_DMA_DESCRIPTORS - ne->async_head) % MAX_NUM_DMA_DESCRIPTORS;
+
+  return done <= dma_async_pending(ne) ? done : 0;
+}
+
+int dma_context_busy(struct nfp_context *ctx)
+{
+  struct nfp_card *card = ctx->card;
+  u32 i;
+
+  for (i = 0; i < MAX_NUM_DMA_ENGINES; i++) {
+    if (card->engine[i].owner == ctx && (!dma_engine_idle(i, card) || dma_async_pending(&card->engine[i]))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int submitDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card)
+{
+  struct nfp_engine *ne = &card->engine[dd->engine];
+  u32 control = dma_control_word(dd);
+  int ret;
+
+  if (dma_async_pending(ne) == MAX_NUM_DMA_DESCRIPTORS - 1) {
+    return -ENOSPC;
+  }
+
+  // The engine is only reprogrammed when it is idle and every submitted descriptor has been
+  // processed: the ones of the batch in course are not started until startDMAEngine
+  if (dma_engine_idle(dd->engine, card) && dma_async_completed(dd->engine, card) == dma_async_pending(ne)) {
+    dma_program_engine(dd, control, card);
+    ne->async_config  = *dd;
+    ne->async_control = control;
+  } else if (control != ne->async_control || dd->buffer_size != ne->async_config.buffer_size ||
+             dd->number_of_tlps != ne->async_config.number_of_tlps || dd->address_offset != ne->async_config.address_offset ||
+             dd->address_inc != ne->async_config.address_inc) {
+    return -EBUSY; // Writing the control word would stop the engine or change the pending descriptors
+  }
+
+  ne->ldescriptor = (ne->ldescriptor) % MAX_NUM_DMA_DESCRIPTORS;
+  dd->index = ne->ldescriptor;
+  if ((ret = dma_program_descriptor(dd, dd->index, 0, card)) < 0) {
+    return ret;
+  }
+  ne->ldescriptor = (ne->ldescriptor + 1) % MAX_NUM_DMA_DESCRIPTORS;
+
+  return 0;
+}
+
+void startDMAEngine (u32 first, u32 engine, struct nfp_card *card)
+{
+  struct dma_engine *de = &card->dma->dma_engine[engine];
+  struct nfp_engine *ne = &card->engine[engine];
+  u32 last = (ne->ldescriptor + MAX_NUM_DMA_DESCRIPTORS - 1) % MAX_NUM_DMA_DESCRIPTORS;
+  u64 generate_irq = 1;
+  u32 control = ne->async_control | 1;
+
+  if (card->completion_mode != NFP_COMPLETION_POLL) {
+    memcpy_toio((u8 *) &(de->dma_descriptor[last].size) + 8, &generate_irq, 8);
+  }
+  de->complete_until_descriptor = last;
+
+  // If the engine is still running it will continue until the new last descriptor. Otherwise
+  // start it, unless it already processed the new descriptors before stopping.
+  if (dma_engine_idle(engine, card) && dma_active_index(engine, card) == first) {
+    ne->s = getToD();
+    memcpy_toio(de , &(control), 4);
+  }
+}
+
+int reapDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card)
+{
+  u32 engine = dd->engine;
+  struct nfp_engine *ne = &card->engine[engine];
+  u32 index = ne->async_head;
+
+  if (dma_async_completed(engine, card) == 0) {
+    return -EAGAIN;
+  }
+
+  // dma_engine_manager.v stores the status of a descriptor in the next position of the ring
+  memset(dd, 0, sizeof(struct dma_descriptor_sw));
+  dd->engine = engine;
+  dd->index = (index + 1) % MAX_NUM_DMA_DESCRIPTORS;
+  readDMADescriptor(dd, card);
+  dd->index = index;
+
+  if (ne->phy_addr_valid[index]) {
+    pci_unmap_single (card->pdev, ne->phy_addr[index], ne->phy_size[index], PCI_DMA_BIDIRECTIONAL);
+    ne->phy_addr_valid[index] = 0;
+    ne->phy_addr_count--;
+  }
+  ne->async_head = (ne->async_head + 1) % MAX_NUM_DMA_DESCRIPTORS;
+
+  return 0;
+}
+
+int writeDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card)
+{
+  struct dma_engine *de = &card->dma->dma_engine[dd->engine];
+  struct nfp_engine *ne = &card->engine[dd->engine];
+  u32 control;
+  int ret;
+
+  if (dd->index >= MAX_NUM_DMA_DESCRIPTORS) { // It indexes the ring of the device and the mappings of the engine
+    return -EINVAL;
+  }
+  // Writing the control word stops the engine: wait for the submitted descriptors in flight
+  if (!dma_engine_idle(dd->engine, card)) {
+    ne->s = getToD();
+    if ((ret = dma_wait_completion(dd->engine, card, 1)) < 0) {
+      return ret; // Nothing has been written
+    }
+  }
+
+  control = dma_control_word(dd);
+  dma_program_engine(dd, control, card);
+  if ((ret = dma_program_descriptor(dd, dd->index, card->completion_mode != NFP_COMPLETION_POLL && dd->enable, card)) < 0) {
+    return ret;
+  }
 
   // Update the last descriptor count
-  ldescriptor = (ldescriptor) % MAX_NUM_DMA_DESCRIPTORS;
-  dma->dma_engine[0].complete_until_descriptor = ldescriptor;
-  ldescriptor = (ldescriptor + 1) % MAX_NUM_DMA_DESCRIPTORS;
+  ne->ldescriptor = (ne->ldescriptor) % MAX_NUM_DMA_DESCRIPTORS;
+  de->complete_until_descriptor = ne->ldescriptor;
+  ne->ldescriptor = (ne->ldescriptor + 1) % MAX_NUM_DMA_DESCRIPTORS;
 
-  // If we have to process this descriptor immediately, poll the device.
+  // If we have to process this descriptor immediately, wait for the device.
   if (!dd->enable) {
     return 0;
   }
-  s = getToD();
+  ne->s = getToD();
   // dma->dma_engine[0].enable = 1;
   control |= 1;
-  memcpy_toio(&(dma->dma_engine[0]) , &(control), 4);
-
-  do { //Dont stub the cpu. If the OP lasts more than Xs... has the core failed? The time is measured in the FPGA, so we do not
-    // loose accuracy.
-    e = getToD();
-    exit_loop = !(dma->dma_engine[0].enable) || (e - s) > 10000000;
-  } while ( !exit_loop );
+  memcpy_toio(de , &(control), 4);
 
-  if (e - s > 10000000) {
-    printk(KERN_ERR "Exit by timeout\n");
-  } else {
-    //printk(KERN_ERR "Operation complete\n");
+  ret = dma_wait_completion(dd->engine, card, 1);
+  ne->async_head = ne->ldescriptor; // Synchronous operations are not reaped (and they discard the unreaped ones)
+  if (ret < 0) {
+    // The engine may still use the memory: its mappings are released by the next operation that
+    // finds it idle. The descriptor has been started, so the IOCTL must not be restarted
+    printk(KERN_ERR "nfp: The engine %u did not finish the descriptor\n", dd->engine);
+    return ret == -ERESTARTSYS ? -EINTR : ret;
   }
 
-  // Free the resources
-  for (i = 0; i < MAX_NUM_DMA_DESCRIPTORS; i++) {
-    if (phy_addr_valid[i]) {
-      pci_unmap_single (card->pdev, phy_addr[i], phy_size[i], PCI_DMA_BIDIRECTIONAL);
-    }
-    phy_addr_valid[i] = 0;
-  }
+  // Free the resources that are not in the cache
+  dma_release_mappings(ne, card);
   return 0;
 }
 
-u64 readDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card)
+int readDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card)
 {
-  struct dma_core *dma = card->dma;
+  struct dma_engine *de = &card->dma->dma_engine[dd->engine];
+
+  if (dd->index >= MAX_NUM_DMA_DESCRIPTORS) {
+    return -EINVAL;
+  }
 
   // Just access to the proper positions and copy the information from the descriptor with index dd->index
-  memcpy_fromio( &(dd->latency), &(dma->dma_engine[0].dma_descriptor[dd->index].latency), 8);
-  memcpy_fromio( &(dd->time_at_req), &(dma->dma_engine[0].dma_descriptor[dd->index].time_at_req), 8);
-  memcpy_fromio( &(dd->time_at_comp), &(dma->dma_engine[0].dma_descriptor[dd->index].time_at_comp), 8);
-  memcpy_fromio( &(dd->bytes_at_req), &(dma->dma_engine[0].dma_descriptor[dd->index].bytes_at_req), 8);
-  memcpy_fromio( &(dd->bytes_at_comp), &(dma->dma_engine[0].dma_descriptor[dd->index].bytes_at_comp), 8);
-  return dd->latency;
+  memcpy_fromio( &(dd->latency), &(de->dma_descriptor[dd->index].latency), 8);
+  memcpy_fromio( &(dd->time_at_req), &(de->dma_descriptor[dd->index].time_at_req), 8);
+  memcpy_fromio( &(dd->time_at_comp), &(de->dma_descriptor[dd->index].time_at_comp), 8);
+  memcpy_fromio( &(dd->bytes_at_req), &(de->dma_descriptor[dd->index].bytes_at_req), 8);
+  memcpy_fromio( &(dd->bytes_at_comp), &(de->dma_descriptor[dd->index].bytes_at_comp), 8);
+  return 0;
 }
@@ -61,15 +61,19 @@ u64 dma_write (struct dma_transfer *di,  struct nfp_card *card);
 u64 dma_read (struct dma_transfer *di,  struct nfp_card *card);
 
 /**
- * @brief Write the [CONTROL] fields of a struct dma_descriptor_sw to the FPGA
+ * @brief Write the [CONTROL] fields of a struct dma_descriptor_sw to the FPGA. The engine must be
+ * leased: the memory is mapped through the DMA map cache of its owner.
  *
  * @param dma_descriptor_sw A proper initialized structure with VALID data. *A missconfiguration
  * may lead to the freeze of the system*.
  * @param nfp_card The pointer to the main structure that represents the device
  *
- * @return 0 if the operation could be completed successfully
+ * @return 0 if the operation could be completed successfully, -EINVAL if its index is out of the
+ * ring, -EIO if its memory could not be mapped for the device (the descriptor is not written). If the engine was running, it is waited
+ * for first: -ERESTARTSYS or -ETIMEDOUT if it did not finish (nothing is written). A descriptor with
+ * enable set is waited for as well: -EINTR or -ETIMEDOUT if it is still running.
  */
-u64 writeDMADescriptor (struct dma_descriptor_sw *di,  struct nfp_card *card);
+int writeDMADescriptor (struct dma_descriptor_sw *di,  struct nfp_card *card);
 
 /**
  * @brief Retrieve the [STATUS] fields of a particular descriptor in the FPGA and copy them
@@ -79,9 +83,9 @@ u64 writeDMADescriptor (struct dma_descriptor_sw *di,  struct nfp_card *card);
  * may lead to the freeze of the system*.
  * @param nfp_card The pointer to the main structure that represents the device
  *
- * @return 0 if the operation could be completed successfully
+ * @return 0 if the operation could be completed successfully, -EINVAL if its index is out of the ring.
  */
-u64 readDMADescriptor (struct dma_descriptor_sw *di,  struct nfp_card *card);
+int readDMADescriptor (struct dma_descriptor_sw *di,  struct nfp_card *card);
 
 
 /**
@@ -89,7 +93,135 @@ u64 readDMADescriptor (struct dma_descriptor_sw *di,  struct nfp_card *card);
  * concurrent tags (in memory read request operations)
  *
  * @param ws The new value. As a general thumb rule, 32 offers the maximum performance
+ * @param engine The DMA engine
  * @param nfp_card The pointer to the main structure that represents the device
  */
-void dma_set_window_size(u64 ws, struct nfp_card *card);
+void dma_set_window_size(u64 ws, u32 engine, struct nfp_card *card);
+
+/**
+ * @brief Release the mappings of the DMA map cache of a context that point to a buffer. It must
+ * be invoked when the memory behind them is going to be released (buffer unregistered, file closed).
+ *
+ * @param ctx The context of the open file
+ * @param m One of the buffers of ctx, or NULL to release every mapping
+ */
+void dma_map_cache_flush(struct nfp_context *ctx, struct mem *m);
+
+/**
+ * @brief Map a region for the device through the DMA map cache of a context, so it is kept
+ * until dma_map_cache_flush.
+ *
+ * @param ctx The context of the open file
+ * @param address Kernel address of the region
+ * @param size Size of the region
+ * @param bus_address Where the address of the region for the device is stored
+ *
+ * @return 0 if ok, -ENOSPC if the cache is full, -EIO if the region could not be mapped.
+ */
+int dma_map_region(struct nfp_context *ctx, u64 address, u64 size, u64 *bus_address);
+
+/**
+ * @brief Lease an engine to a context. The semaphore of the engine must be held.
+ *
+ * @param engine The DMA engine
+ * @param ctx The context of the open file
+ *
+ * @return 0 if the engine is free or already leased to ctx, -EBUSY if another context holds it.
+ */
+int dma_lease_engine(u32 engine, struct nfp_context *ctx);
+
+/**
+ * @brief Return an engine leased by a context. The operation in flight is waited for without
+ * being interrupted by signals and the submitted descriptors that were not reaped are discarded.
+ * The semaphore of the engine must be held.
+ *
+ * @param engine The DMA engine
+ * @param ctx The context of the open file
+ *
+ * @return 0 if ok, -EPERM if the engine is not leased to ctx, -EBUSY if the engine did not finish
+ * in DMA_TIMEOUT_US: it is still leased to ctx and its mappings are kept, because the core may
+ * still access the memory of ctx.
+ */
+int dma_release_engine(u32 engine, struct nfp_context *ctx);
+
+/**
+ * @brief Select how the end of the DMA operations is detected. The interrupts of the core
+ * (irq_enable) are enabled for NFP_COMPLETION_IRQ and NFP_COMPLETION_HYBRID.
+ *
+ * @param mode A value of enum nfp_completion_mode
+ * @param nfp_card The pointer to the main structure that represents the device
+ *
+ * @return 0 if ok, -EINVAL for an unknown mode, -ENODEV if the mode requires MSI and the
+ * device has not got it.
+ */
+int dma_set_completion_mode(u32 mode, struct nfp_card *card);
+
+/**
+ * @brief Initialize the state of every DMA engine of the device.
+ *
+ * @param nfp_card The pointer to the main structure that represents the device
+ */
+void dma_init_engines(struct nfp_card *card);
+
+/**
+ * @brief Check if the engine has finished the last operation.
+ *
+ * @param engine The DMA engine
+ * @param nfp_card The pointer to the main structure that represents the device
+ *
+ * @return 1 if the engine is idle
+ */
+int dma_engine_idle(u32 engine, struct nfp_card *card);
+
+/**
+ * @brief Queue a descriptor without waiting for it. The position in the ring is chosen by the
+ * driver and returned in dd->index. The engine is not started until startDMAEngine is called.
+ * As in writeDMADescriptor, the engine must be leased.
+ *
+ * @param dd A proper initialized structure whose address has already been translated.
+ * @param nfp_card The pointer to the main structure that represents the device
+ *
+ * @return 0 if ok, -ENOSPC if the ring is full, -EBUSY if the configuration differs from the one of
+ * the descriptors in flight or not processed yet (the engine is running or the batch has not been started).
+ */
+int submitDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card);
+
+/**
+ * @brief Start the engine after a set of submitDMADescriptor calls, or let the running engine
+ * continue until the new descriptors.
+ *
+ * @param first Position of the first descriptor queued in the set.
+ * @param engine The DMA engine of the set
+ * @param nfp_card The pointer to the main structure that represents the device
+ */
+void startDMAEngine (u32 first, u32 engine, struct nfp_card *card);
+
+/**
+ * @brief Retrieve the [STATUS] fields of the oldest submitted descriptor if it has been completed.
+ *
+ * @param dd Where the status is stored. dd->engine selects the engine and dd->index is the position of the descriptor.
+ * @param nfp_card The pointer to the main structure that represents the device
+ *
+ * @return 0 if ok, -EAGAIN if the descriptor has not been completed (or nothing was submitted).
+ */
+int reapDMADescriptor (struct dma_descriptor_sw *dd,  struct nfp_card *card);
+
+/**
+ * @brief Number of submitted descriptors that have been completed and not reaped.
+ *
+ * @param engine The DMA engine
+ * @param nfp_card The pointer to the main structure that represents the device
+ */
+u32 dma_async_completed(u32 engine, struct nfp_card *card);
+
+/**
+ * @brief Check whether an engine leased by a context is running or has submitted descriptors
+ * that were not reaped: their mappings point to the buffers of the context, which cannot be
+ * released meanwhile. The semaphores of the engines must be held.
+ *
+ * @param ctx The context of the open file
+ *
+ * @return 1 if the buffers of ctx are in use by an engine, 0 otherwise.
+ */
+int dma_context_busy(struct nfp_context *ctx);
 #endif
@@ -29,6 +29,7 @@
 * @date 2013-07-05
 */
 #include "nfp_types.h"
+#include "nfp.h"
 #include "nfpioctl.h"
 #include "nfpdma.h"
 #include "nfpmem.h"
@@ -38,6 +39,8 @@
 #include <linux/sched.h>
 #include <linux/fs_struct.h>
 #include <linux/version.h>
+#include <linux/slab.h>
+#include <linux/poll.h>
 
 
 
@@ -45,31 +48,24 @@
 * @brief Invoked function when the user makes an open over the char device.
 *
 * @param inode A pointer to the inode struct.
-* @param filp  A pointer to the file struct. We will save the struct nfp_card in its
-* private pointer.
+* @param filp  A pointer to the file struct. A new struct nfp_context (the registered buffer and
+* the DMA mappings of this open file) is saved in its private pointer.
 *
 * @return The possible error code.
 */
 static int nfp_open (struct inode *inode, struct file *filp)
 {
   struct nfp_card *card = (struct nfp_card *) container_of (inode->i_cdev, struct nfp_card, cdev);
-  filp->private_data = card;
+  struct nfp_context *ctx;
 
-  return 0;
-}
+  ctx = kzalloc (sizeof (struct nfp_context), GFP_KERNEL);
+  if (ctx == NULL) {
+    return -ENOMEM;
+  }
+  ctx->card = card;
+  sema_init (&ctx->sem_map, 1);
+  filp->private_data = ctx;
 
-/**
-* @brief Invoked function on close.
-*
-* @param inode A pointer to the inode struct.
-* @param filp  A pointer to the file struct. We will erase the struct nfp_card in its
-* private pointer.
-*
-* @return The possible error code.
-*/
-static int nfp_release (struct inode *inode, struct file *filp)
-{
-  filp->private_data = NULL;
   return 0;
 }
 
@@ -88,6 +84,349 @@ static ssize_t nfp_write (struct file *filp, const char *buffer, size_t len, lof
   return len;
 }
 
+/**
+* @brief poll()/select() over the char device. The device is readable when the engine has
+* finished the last operation that was started or there are submitted descriptors to reap.
+*
+* @param filp  A pointer to the file struct.
+* @param wait  The poll table.
+*
+* @return POLLIN | POLLRDNORM if every engine is idle or NFPIOC_REAP_DMA_DESCRIPTORS would return
+* something for any of them. The engines leased by other open files are not considered.
+*/
+static unsigned int nfp_poll (struct file *filp, poll_table *wait)
+{
+  struct nfp_context *ctx = (struct nfp_context *) filp->private_data;
+  struct nfp_card *card = ctx->card;
+  struct nfp_context *owner;
+  u32 i, idle = 0;
+
+  poll_wait (filp, &card->dma_wait, wait);
+  for (i = 0; i < card->num_engines; i++) {
+    owner = READ_ONCE (card->engine[i].owner);
+    if (owner != NULL && owner != ctx) {
+      idle++;
+      continue;
+    }
+    if (dma_async_completed (i, card)) {
+      return POLLIN | POLLRDNORM;
+    }
+    idle += dma_engine_idle (i, card);
+  }
+  return idle == card->num_engines ? POLLIN | POLLRDNORM : 0;
+}
+
+/**
+* @brief Find the contiguous region of the registered buffer that contains an offset.
+*
+* @return The region, NULL if the offset is out of the buffer.
+*/
+static struct mem_segment *findSegment (struct mem *m, u64 offset)
+{
+  u64 low = 0, high = m->nsegments, mid;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if (offset < m->segment[mid].offset) {
+      high = mid;
+    } else if (offset >= m->segment[mid].offset + m->segment[mid].length) {
+      low = mid + 1;
+    } else {
+      return &m->segment[mid];
+    }
+  }
+  return NULL;
+}
+
+/**
+* @brief Bytes from dd->address that the engine may access. The random generator moves
+* through the whole buffer_size window.
+*/
+static u64 descriptorExtent (struct dma_descriptor_sw *dd)
+{
+  if (dd->address_mode >= 2 && dd->buffer_size > dd->length) {
+    return dd->buffer_size;
+  }
+  return dd->length;
+}
+
+/**
+* @brief Translate the offset in dd->address (relative to the registered buffer of dd->buffer)
+* to the kernel address of the memory.
+*
+* @param dd The descriptor sent by the user.
+* @param ctx Context of the open file.
+*
+* @return 0 if ok, a negative value if the handle is not registered or the memory of the
+* descriptor is not physically contiguous.
+*/
+static int translateDescriptorAddress (struct dma_descriptor_sw *dd, struct nfp_context *ctx)
+{
+  struct nfp_card *card = ctx->card;
+  struct mem_segment *seg;
+  struct mem *m;
+
+  if (dd->buffer >= NFP_MAX_BUFFERS) {
+    return -EINVAL;
+  }
+  m = &ctx->buffer[dd->buffer];
+  if (m->virtual == NULL) {
+    if (dd->buffer) { // Only the handle 0 falls back to the kernel pages
+      return -EINVAL;
+    }
+    // Mmap buffer
+    dd->address = (u64) ( (u8 *) card->mmap_info.page_list +  (card->mmap_info.first + (u64)dd->address)); // Use the page indicated by the user (and calculate the kernel direction from the internal buffer)
+    return 0;
+  }
+  seg = findSegment (m, dd->address);
+  if (seg == NULL || dd->address + descriptorExtent (dd) > seg->offset + seg->length) { // Take care of offsets
+    return -EINVAL;
+  }
+  dd->address = seg->address + (dd->address - seg->offset);
+  return 0;
+}
+
+/**
+* @brief Write a descriptor sent with NFPIOC_WRITE_DMA_DESCRIPTOR. If its memory is not
+* contiguous and it starts the engine, it is split at the end of each contiguous region: each
+* piece is processed on its own (the configuration of the engine is shared by the descriptors
+* in flight) in the next position of the ring, with the share of number_of_tlps of its length.
+*
+* @param dd The descriptor sent by the user. dd->slots is written.
+* @param ctx Context of the open file.
+*
+* @return 0 if ok, -EINVAL if the index is out of the ring or the descriptor cannot be translated
+* or split, -EIO if its memory cannot be mapped for the device.
+*/
+static int writeUserDescriptor (struct dma_descriptor_sw *dd, struct nfp_context *ctx)
+{
+  struct nfp_card *card = ctx->card;
+  struct dma_descriptor_sw piece = *dd;
+  struct mem_segment *seg;
+  struct mem *m;
+  u64 start, done, tlps = 0;
+  u32 pass, n = 0;
+  int ret;
+
+  if (dd->index >= MAX_NUM_DMA_DESCRIPTORS) { // The pieces take the next positions of the ring modulo its size
+    return -EINVAL;
+  }
+  if (translateDescriptorAddress (&piece, ctx) == 0) {
+    dd->slots = 1;
+    return writeDMADescriptor (&piece, card);
+  }
+  m = dd->buffer < NFP_MAX_BUFFERS ? &ctx->buffer[dd->buffer] : NULL;
+  if (!dd->enable || dd->address_mode >= 2 || m == NULL || m->virtual == NULL || dd->length == 0) {
+    printk (KERN_ERR "nfp: Error while computing the physical address of the memory");
+    return -EINVAL;
+  }
+
+  // The fixed address generator accesses address+address_offset: the offset is applied before splitting
+  start = dd->address + (dd->address_mode == 0 ? dd->address_offset : 0);
+
+  // The first pass checks that the descriptor can be split, the second one writes the pieces
+  for (pass = 0; pass < 2; pass++) {
+    for (done = 0, n = 0; done < dd->length; n++) {
+      seg = findSegment (m, start + done);
+      if (seg == NULL || n == NFP_MAX_DESCRIPTOR_SLOTS) {
+        printk (KERN_ERR "nfp: The descriptor cannot be split");
+        return -EINVAL;
+      }
+      piece = *dd;
+      piece.address        = start + done;
+      piece.address_offset = 0;
+      piece.length         = min_t (u64, dd->length - done, seg->offset + seg->length - (start + done));
+      piece.index          = (dd->index + n) % MAX_NUM_DMA_DESCRIPTORS;
+      piece.enable         = 1;
+      piece.number_of_tlps = max_t (u64, 1, dd->number_of_tlps * piece.length / dd->length);
+      done += piece.length;
+      if (done == dd->length && tlps + piece.number_of_tlps < dd->number_of_tlps) { // The last piece takes the rounding error
+        piece.number_of_tlps = dd->number_of_tlps - tlps;
+      }
+      tlps += piece.number_of_tlps;
+      if (pass == 1) {
+        translateDescriptorAddress (&piece, ctx);
+        if ((ret = writeDMADescriptor (&piece, card)) < 0) {
+          return ret;
+        }
+      }
+    }
+    tlps = 0;
+  }
+  dd->slots = n;
+  return 0;
+}
+
+#define DESCRIPTORS_PER_COPY 16 /**< Descriptors copied from/to userspace at once in a batch */
+
+/**
+* @brief Write, read, submit or reap the descriptors of a batch. The whole batch is processed
+* while the semaphore of db->engine is held, and the descriptors are copied from/to userspace in blocks.
+*
+* @param db The batch. db->processed is updated.
+* @param cmd NFPIOC_WRITE_DMA_DESCRIPTORS, NFPIOC_READ_DMA_DESCRIPTORS, NFPIOC_SUBMIT_DMA_DESCRIPTORS
+* or NFPIOC_REAP_DMA_DESCRIPTORS.
+* @param ctx Context of the open file.
+*
+* @return The possible error code. Submit and reap only fail if no descriptor could be processed.
+*/
+static long processDescriptorBatch (struct dma_descriptor_batch *db, unsigned int cmd, struct nfp_context *ctx)
+{
+  struct nfp_card *card = ctx->card;
+  struct dma_descriptor_sw *dd;
+  struct dma_descriptor_sw __user *udd = (struct dma_descriptor_sw __user *) db->descriptors;
+  u32 i, n, first = 0;
+  long ret = 0;
+
+  db->processed = 0;
+  if (db->count > MAX_DESCRIPTORS_PER_BATCH) {
+    return -EINVAL;
+  }
+
+  dd = kmalloc (DESCRIPTORS_PER_COPY * sizeof (struct dma_descriptor_sw), GFP_KERNEL);
+  if (dd == NULL) {
+    return -ENOMEM;
+  }
+
+  while (db->processed < db->count && ret == 0) {
+    n = min_t (u32, DESCRIPTORS_PER_COPY, db->count - db->processed);
+    if (cmd != NFPIOC_REAP_DMA_DESCRIPTORS && copy_from_user (dd, udd + db->processed, n * sizeof (struct dma_descriptor_sw))) {
+      ret = -EFAULT;
+      break;
+    }
+    for (i = 0; i < n; i++) {
+      dd[i].engine = db->engine;
+      if (cmd == NFPIOC_WRITE_DMA_DESCRIPTORS || cmd == NFPIOC_SUBMIT_DMA_DESCRIPTORS) {
+        if ((ret = translateDescriptorAddress (&dd[i], ctx)) < 0) {
+          break;
+        }
+      }
+      if (cmd == NFPIOC_WRITE_DMA_DESCRIPTORS) {
+        if ((ret = writeDMADescriptor (&dd[i], card)) < 0) {
+          break;
+        }
+      } else if (cmd == NFPIOC_READ_DMA_DESCRIPTORS) {
+        if ((ret = readDMADescriptor (&dd[i], card)) < 0) {
+          break;
+        }
+      } else if (cmd == NFPIOC_SUBMIT_DMA_DESCRIPTORS) {
+        if ((ret = submitDMADescriptor (&dd[i], card)) < 0) {
+          break;
+        }
+        if (db->processed + i == 0) {
+          first = dd[i].index;
+        }
+      } else if ((ret = reapDMADescriptor (&dd[i], card)) < 0) {
+        break;
+      }
+    }
+    if (cmd != NFPIOC_WRITE_DMA_DESCRIPTORS && copy_to_user (udd + db->processed, dd, i * sizeof (struct dma_descriptor_sw))) {
+      ret = -EFAULT;
+      break;
+    }
+    db->processed += i;
+  }
+
+  if (cmd == NFPIOC_SUBMIT_DMA_DESCRIPTORS && db->processed) {
+    startDMAEngine (first, db->engine, card);
+  }
+  if ((cmd == NFPIOC_SUBMIT_DMA_DESCRIPTORS || cmd == NFPIOC_REAP_DMA_DESCRIPTORS) && db->processed && ret != -EFAULT) {
+    ret = 0;
+  }
+
+  kfree (dd);
+  return ret;
+}
+
+/**
+* @brief Take the semaphores that an IOCTL operation requires. The operations over the descriptors
+* and the window size or the TLP log of an engine only block that engine, so the engines can be driven concurrently.
+* The rest of the operations change state shared by the engines and block the whole device.
+*
+* @param card Main structure of the driver.
+* @param engine The engine of the operation, or -1 to block the device.
+*
+* @return 0 if ok, -ERESTARTSYS if a signal was received while waiting.
+*/
+static int nfp_lock (struct nfp_card *card, int engine)
+{
+  int i;
+
+  if (engine >= 0) {
+    return down_interruptible (&card->engine[engine].sem_op) ? -ERESTARTSYS : 0;
+  }
+
+  if (down_interruptible (&card->sem_op)) {
+    return -ERESTARTSYS;
+  }
+  for (i = 0; i < MAX_NUM_DMA_ENGINES; i++) {
+    if (down_interruptible (&card->engine[i].sem_op)) {
+      while (i--) {
+        up (&card->engine[i].sem_op);
+      }
+      up (&card->sem_op);
+      return -ERESTARTSYS;
+    }
+  }
+  return 0;
+}
+
+/**
+* @brief Release the semaphores taken by nfp_lock.
+*/
+static void nfp_unlock (struct nfp_card *card, int engine)
+{
+  int i;
+
+  if (engine >= 0) {
+    up (&card->engine[engine].sem_op);
+    return;
+  }
+  for (i = MAX_NUM_DMA_ENGINES - 1; i >= 0; i--) {
+    up (&card->engine[i].sem_op);
+  }
+  up (&card->sem_op);
+}
+
+/**
+* @brief Invoked function on close. The engines leased by the file are returned (the operations
+* in flight are waited for) and its buffers are unregistered. If an engine is still running after
+* the wait, the context is leaked instead: its pages stay pinned and mapped and the engine stays
+* leased to it, so the core never writes in freed memory and no other file reprograms the engine.
+*
+* @param inode A pointer to the inode struct.
+* @param filp  A pointer to the file struct. We will free the struct nfp_context in its
+* private pointer.
+*
+* @return The possible error code.
+*/
+static int nfp_release (struct inode *inode, struct file *filp)
+{
+  struct nfp_context *ctx = (struct nfp_context *) filp->private_data;
+  struct nfp_card *card = ctx->card;
+  int i, busy = 0;
+
+  for (i = 0; i < MAX_NUM_DMA_ENGINES; i++) {
+    down (&card->engine[i].sem_op); // Not interruptible: the engine must be returned
+    if (card->engine[i].owner == ctx && dma_release_engine (i, ctx) < 0) {
+      busy = 1;
+    }
+    up (&card->engine[i].sem_op);
+  }
+  filp->private_data = NULL;
+  if (busy) {
+    printk (KERN_ERR "nfp: The memory of the file is leaked because an engine is still using it\n");
+    return 0;
+  }
+  for (i = 0; i < NFP_MAX_BUFFERS; i++) {
+    unreg_hugemem (ctx, i);
+  }
+  dma_map_cache_flush (ctx, NULL); // The kernel pages
+
+  kfree (ctx);
+  return 0;
+}
+
 /**
 * @brief When an IOCTL is received this function will process it.
 *
@@ -99,12 +438,19 @@ static ssize_t nfp_write (struct file *filp, const char *buffer, size_t len, lof
 */
 long nfp_ioctl (struct file *f, unsigned int cmd, unsigned long arg)
 {
-  struct nfp_card *card = (struct nfp_card *) f->private_data;
+  struct nfp_context *ctx = (struct nfp_context *) f->private_data;
+  struct nfp_card *card = ctx->card;
   struct reg32 r;
-  u64 timeout;
   void *pInArg = NULL;
   struct dma_descriptor_sw dd;
   struct dma_buffer   db;
+  struct dma_descriptor_batch batch;
+  struct dma_window window;
+  struct dma_buffer_map bm;
+  struct pcie_config pc;
+  u32 mode, leased, handle;
+  int engine = -1;
+  long ret = 0;
 
   /* Check if it is a correct IOCTL  */
   if (_IOC_TYPE (cmd) != IOCTL_MAGIC_NUMBER) return -ENOTTY;     /* Unexpected code */
@@ -112,45 +458,62 @@ long nfp_ioctl (struct file *f, unsigned int cmd, unsigned long arg)
 
   pInArg = (void __user *) arg;
 
-
-  if (down_interruptible (&card->sem_op)) {   /* Block other IOCTL operations. */
-    up (&card->sem_op);
-    return -ERESTARTSYS;
-  }
-
-  /* Copy the user struct into kernel space  */
+  /* Copy the user struct into kernel space. It also selects the engine of the operation */
 
   if (cmd == NFPIOC_READ_32 || cmd == NFPIOC_WRITE_32) {
-    if (copy_from_user (&r, pInArg, sizeof (struct reg32))) {
-      up (&card->sem_op);
-      printk (KERN_ERR "nfp: user variables cannot be accessed");
-      return -EFAULT;
-    }
+    ret = copy_from_user (&r, pInArg, sizeof (struct reg32));
   } else if (cmd == NFPIOC_WINDOW_SIZE) {
-    if (copy_from_user (&timeout, pInArg, sizeof (u64))) {
-      up (&card->sem_op);
-      printk (KERN_ERR "nfp: user variables cannot be accessed");
-      return -EFAULT;
-    }
+    window.engine = engine = 0;
+    ret = copy_from_user (&window.size, pInArg, sizeof (u64));
+  } else if (cmd == NFPIOC_ENGINE_WINDOW_SIZE) {
+    ret = copy_from_user (&window, pInArg, sizeof (struct dma_window));
+    engine = min_t (u32, window.engine, MAX_NUM_DMA_ENGINES); // Out of range values are rejected below
   } else if (cmd == NFPIOC_WRITE_DMA_DESCRIPTOR || cmd == NFPIOC_READ_DMA_DESCRIPTOR) {
-    if (copy_from_user (&dd, pInArg, sizeof (struct dma_descriptor_sw))) {
-      up (&card->sem_op);
-      printk (KERN_ERR "nfp: user variables cannot be accessed");
-      return -EFAULT;
-    }
-  } else if (cmd == NFPIOC_REGISTER_BUFFER) {
-    if (copy_from_user (&db, pInArg, sizeof (struct dma_buffer))) {
-      up (&card->sem_op);
-      printk (KERN_ERR "nfp: user variables cannot be accessed");
-      return -EFAULT;
-    }
+    ret = copy_from_user (&dd, pInArg, sizeof (struct dma_descriptor_sw));
+    engine = dd.engine;
+  } else if (cmd == NFPIOC_COMPLETION_MODE) {
+    ret = copy_from_user (&mode, pInArg, sizeof (u32));
+  } else if (cmd == NFPIOC_WRITE_DMA_DESCRIPTORS || cmd == NFPIOC_READ_DMA_DESCRIPTORS ||
+             cmd == NFPIOC_SUBMIT_DMA_DESCRIPTORS || cmd == NFPIOC_REAP_DMA_DESCRIPTORS) {
+    ret = copy_from_user (&batch, pInArg, sizeof (struct dma_descriptor_batch));
+    engine = min_t (u32, batch.engine, MAX_NUM_DMA_ENGINES);
+  } else if (cmd == NFPIOC_REGISTER_BUFFER || cmd == NFPIOC_REGISTER_BUFFER_HANDLE) {
+    ret = copy_from_user (&db, pInArg, sizeof (struct dma_buffer));
+  } else if (cmd == NFPIOC_UNREGISTER_BUFFER_HANDLE) {
+    ret = copy_from_user (&handle, pInArg, sizeof (u32));
+  } else if (cmd == NFPIOC_MAP_BUFFER) {
+    ret = copy_from_user (&bm, pInArg, sizeof (struct dma_buffer_map));
+  } else if (cmd == NFPIOC_LEASE_ENGINE || cmd == NFPIOC_RELEASE_ENGINE) {
+    ret = copy_from_user (&leased, pInArg, sizeof (u32));
+    engine = min_t (u32, leased, MAX_NUM_DMA_ENGINES);
+  } else if (cmd == NFPIOC_PCIE_CONFIG) {
+    ret = copy_from_user (&pc, pInArg, sizeof (struct pcie_config));
+  }
+  if (ret) {
+    printk (KERN_ERR "nfp: user variables cannot be accessed");
+    return -EFAULT;
+  }
+  if (engine >= MAX_NUM_DMA_ENGINES) {
+    return -EINVAL;
+  }
+  if (engine >= (int) card->num_engines) { // Its registers would alias the ones of the engine 0
+    return -ENODEV;
   }
 
+  if (nfp_lock (card, engine)) {   /* Block other IOCTL operations over the same engine (or the device). */
+    return -ERESTARTSYS;
+  }
+  /* The operations over an engine lease it to the file: the engines of other files are not touched */
+  if (engine >= 0 && cmd != NFPIOC_RELEASE_ENGINE && (ret = dma_lease_engine (engine, ctx)) < 0) {
+    nfp_unlock (card, engine);
+    return ret;
+  }
 
   /* Select the correct operation.  */
   switch (cmd) {
   case NFPIOC_WINDOW_SIZE:
-    dma_set_window_size(timeout,  card);
+  case NFPIOC_ENGINE_WINDOW_SIZE:
+    dma_set_window_size(window.size, window.engine, card);
     break;
 
   case NFPIOC_WRITE_32:
@@ -167,52 +530,134 @@ long nfp_ioctl (struct file *f, unsigned int cmd, unsigned long arg)
     break;
 
   case NFPIOC_WRITE_DMA_DESCRIPTOR:
-    if (card->buffer.virtual == NULL) { // Mmap buffer
-      dd.address = (u64) ( (u8 *) card->mmap_info.page_list +  (card->mmap_info.first + (u64)dd.address)); // Use the page indicated by the user (and calculate the kernel direction from the internal buffer)
-    } else if ((dd.address + dd.length) / card->buffer.page_size == dd.address / card->buffer.page_size) { //We do not exceed a huge page (take care of offsets)
-      dd.address = card->buffer.page_address[(u64)dd.address / card->buffer.page_size] + (u64)dd.address % card->buffer.page_size;
-    } else {
-      printk(KERN_ERR "nfp: Error while computing the physical address of the memory");
+    if ((ret = writeUserDescriptor(&dd, ctx)) < 0) {
       break;
     }
 
-    writeDMADescriptor(&dd, card);
+    if (copy_to_user (pInArg, &dd, sizeof (struct dma_descriptor_sw))) {
+      printk (KERN_ERR "nfp: It was impossible to access user variable");
+    }
     break;
 
   case NFPIOC_READ_DMA_DESCRIPTOR:
-    if (card->buffer.virtual == NULL) { // Mmap buffer
-      dd.address = (u64) ( (u8 *) card->mmap_info.page_list + (card->mmap_info.first + (u64)dd.address)); // Use the page indicated by the user (and calculate the kernel direction from the internal buffer)
-    } else if ((dd.address + dd.length) / card->buffer.page_size == dd.address / card->buffer.page_size) { //We do not exceed a huge page (take care of offsets)
-      dd.address = card->buffer.page_address[(u64)dd.address / card->buffer.page_size] + (u64)dd.address % card->buffer.page_size;
-    } else {
-      printk(KERN_ERR "nfp: Error while computing the physical address of the memory");
+    if ((ret = readDMADescriptor(&dd, card)) < 0) { // Only the index is used: the descriptor may have been split
       break;
     }
 
-    readDMADescriptor(&dd, card);
-
     if (copy_to_user (pInArg, &dd, sizeof (struct dma_descriptor_sw))) {
       printk (KERN_ERR "nfp: It was impossible to access user variable");
     }
 
     break;
 
-  case NFPIOC_REGISTER_BUFFER:
-    reg_hugemem(card, &db);
+  case NFPIOC_WRITE_DMA_DESCRIPTORS:
+  case NFPIOC_READ_DMA_DESCRIPTORS:
+  case NFPIOC_SUBMIT_DMA_DESCRIPTORS:
+  case NFPIOC_REAP_DMA_DESCRIPTORS:
+    ret = processDescriptorBatch(&batch, cmd, ctx);
+
+    if (copy_to_user (pInArg, &batch, sizeof (struct dma_descriptor_batch))) {
+      printk (KERN_ERR "nfp: It was impossible to access user variable");
+    }
+
+    break;
+
+  case NFPIOC_COMPLETION_MODE:
+    ret = dma_set_completion_mode(mode, card);
+    break;
+
+  case NFPIOC_MAP_BUFFER:
+    memset (&dd, 0, sizeof (struct dma_descriptor_sw));
+    dd.address = bm.offset;
+    dd.length  = bm.length;
+    dd.buffer  = min_t (u32, bm.buffer, NFP_MAX_BUFFERS); // Out of range values are rejected by the translation
+    if (bm.length == 0 || (ret = translateDescriptorAddress(&dd, ctx)) < 0) {
+      ret = -EINVAL;
+      break;
+    }
+    if ((ret = dma_map_region(ctx, dd.address, bm.length, &bm.bus_address)) < 0) {
+      break;
+    }
+
+    if (copy_to_user (pInArg, &bm, sizeof (struct dma_buffer_map))) {
+      printk (KERN_ERR "nfp: It was impossible to access user variable");
+    }
+
+    break;
+
+  case NFPIOC_TLP_LOG_CONTROL: // Only the emulator implements the log (see struct dma_tlp_log)
+  case NFPIOC_READ_TLP_LOG:
+    ret = -EOPNOTSUPP;
+    break;
+
+  case NFPIOC_REGISTER_BUFFER: // The whole device is locked: the engines of the context cannot start meanwhile
+    if (ctx->buffer[0].length && dma_context_busy(ctx)) {
+      ret = -EBUSY;
+      break;
+    }
+    ret = reg_hugemem(ctx, 0, &db);
     break;
 
   case NFPIOC_UNREGISTER_BUFFER:
-    unreg_hugemem(card);
+    if (ctx->buffer[0].length && dma_context_busy(ctx)) {
+      ret = -EBUSY;
+      break;
+    }
+    unreg_hugemem(ctx, 0);
     break;
 
+  case NFPIOC_REGISTER_BUFFER_HANDLE:
+    for (handle = 1; handle < NFP_MAX_BUFFERS && ctx->buffer[handle].length; handle++);
+    if (handle == NFP_MAX_BUFFERS) {
+      ret = -ENOSPC;
+      break;
+    }
+    if ((ret = reg_hugemem(ctx, handle, &db)) < 0) {
+      break;
+    }
+    db.handle = handle;
+
+    if (copy_to_user (pInArg, &db, sizeof (struct dma_buffer))) {
+      printk (KERN_ERR "nfp: It was impossible to access user variable");
+    }
+    break;
+
+  case NFPIOC_UNREGISTER_BUFFER_HANDLE:
+    if (handle >= NFP_MAX_BUFFERS) {
+      ret = -EINVAL;
+      break;
+    }
+    if (ctx->buffer[handle].length && dma_context_busy(ctx)) {
+      ret = -EBUSY;
+      break;
+    }
+    unreg_hugemem(ctx, handle);
+    break;
+
+  case NFPIOC_LEASE_ENGINE: // Leased above
+    break;
+
+  case NFPIOC_RELEASE_ENGINE:
+    ret = dma_release_engine(engine, ctx);
+    break;
+
+  case NFPIOC_PCIE_CONFIG: // The whole device is locked: no operation of another engine is in progress
+    if ((ret = nfp_pcie_config(card, &pc)) < 0) {
+      break;
+    }
+
+    if (copy_to_user (pInArg, &pc, sizeof (struct pcie_config))) {
+      printk (KERN_ERR "nfp: It was impossible to access user variable");
+    }
+
     break;
 
   default:
     printk (KERN_INFO "nfp: IOCTL command not recognized %d\n", cmd);
   }
 
-  up (&card->sem_op);
-  return 0;
+  nfp_unlock (card, engine);
+  return ret;
 }
 
 
@@ -245,10 +690,10 @@ int mmap_kmem(struct file *f, struct vm_area_struct *vma)
   int npages  = (vma->vm_end - vma->vm_start) / PAGE_SIZE;
   void *p;
   int ret, i;
-  struct nfp_card *card = (struct nfp_card *) f->private_data;
+  struct nfp_card *card = ((struct nfp_context *) f->private_data)->card;
 
   vma->vm_ops = &mmap_vm_ops;
-  vma->vm_private_data =  f->private_data;
+  vma->vm_private_data =  card; // The pages are shared by every open file of the device
 
   if ( npages * PAGE_SIZE != (vma->vm_end - vma->vm_start)  ) npages++;
 
@@ -273,10 +718,36 @@ int mmap_kmem(struct file *f, struct vm_area_struct *vma)
 }
 
 
+/**
+* @brief Map BAR0 in userspace, so the registers of the DMA core can be accessed without
+* IOCTL operations. The mapping is uncached: the core only accepts 32/64 bit writes.
+* BAR0 holds the registers of every engine, so only a file that leases at least one of
+* them can map it (-EACCES otherwise).
+*/
+static int mmap_bar0(struct file *f, struct vm_area_struct *vma)
+{
+  struct nfp_context *ctx = (struct nfp_context *) f->private_data;
+  struct nfp_card *card = ctx->card;
+  unsigned long size = vma->vm_end - vma->vm_start;
+  int i;
+
+  if (size > pci_resource_len (card->pdev, 0)) {
+    return -EINVAL;
+  }
+  for (i = 0; i < MAX_NUM_DMA_ENGINES && READ_ONCE (card->engine[i].owner) != ctx; i++);
+  if (i == MAX_NUM_DMA_ENGINES) {
+    return -EACCES;
+  }
+  vma->vm_page_prot = pgprot_noncached (vma->vm_page_prot);
+  return io_remap_pfn_range (vma, vma->vm_start, pci_resource_start (card->pdev, 0) >> PAGE_SHIFT, size, vma->vm_page_prot);
+}
+
 /* character device mmap method */
 static int nfp_mmap(struct file *filp, struct vm_area_struct *vma)
 {
-
+  if (vma->vm_pgoff == NFP_MMAP_BAR0_OFFSET >> PAGE_SHIFT) {
+    return mmap_bar0(filp, vma);
+  }
   return mmap_kmem(filp, vma); // Contiguous region of memory
 
 }
@@ -292,7 +763,8 @@ static struct file_operations nfp_ops = {
   .release    = nfp_release,
   .unlocked_ioctl = nfp_ioctl,
   .compat_ioctl   = nfp_ioctl,
-  .mmap       = nfp_mmap
+  .mmap       = nfp_mmap,
+  .poll       = nfp_poll
 };
 
 
@@ -29,154 +29,252 @@
 */
 
 #include "nfpmem.h"
+#include "nfpdma.h"
 #include <linux/pagemap.h>
 #include <linux/sched.h>
 #include <linux/fs_struct.h>
 #include <linux/hugetlb.h>
 #include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
 
 
-static int        num_pages = 0;    /**< Number of 4KB pages in the HP file system */
-static struct page **pages  = NULL; /**< Struct pages associated to the buffer in use */
 
+#define PIN_PAGES_PER_CALL 4096 /**< 4KB pages pinned by each call: the pointers of a 16MB slice of the buffer */
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+  /* Long-term pins: the pages are not migrated while the device may access them */
+  #define pinPages(start, n, pag) pin_user_pages_fast (start, n, FOLL_WRITE | FOLL_LONGTERM, pag)
+#else
+  #define pinPages(start, n, pag) get_user_pages_fast (start, n, FOLL_WRITE, pag)
+#endif
 
 /**
-* @brief This function maps the user memory pointed by di into kernel space.
-* A list of pointer to pages is returned by the ppag argument.
+* @brief 4KB pages held by the pin of a page: the rest of its huge page for a page of hugetlbfs,
+* which is always mapped by a single entry, so the next addresses are the next 4KB pages of the
+* same huge page. Any other page (transparent huge pages included, which may be mapped 4KB at a
+* time) holds just itself.
+*/
+static u64 pinnedPages (struct page *page)
+{
+  struct page *head = compound_head (page);
+
+  if (!PageHuge (page)) {
+    return 1;
+  }
+  return (1UL << compound_order (head)) - (page_to_pfn (page) - page_to_pfn (head));
+}
+
+/**
+* @brief Release the pins of a physically contiguous range of pages. It follows the same steps
+* than getUserHugePages: a single pin per huge page and one per any other page.
+*
+* @param first The first page of the range.
+* @param npages Number of 4KB pages in the range.
+*/
+static void unpinRange (struct page *first, u64 npages)
+{
+  struct page *p;
+  u64 i, step;
+
+  for (i = 0; i < npages; i += step) {
+    p    = pfn_to_page (page_to_pfn (first) + i);
+    step = pinnedPages (p);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+    unpin_user_pages_dirty_lock (&p, 1, true);
+#else
+    set_page_dirty_lock (p);
+    put_page (p);
+#endif
+  }
+}
+
+/**
+* @brief Release the pins of a list of pages that were not added to the table of the buffer.
+*/
+static void unpinPages (struct page **pag, u64 npages)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+  unpin_user_pages (pag, npages);
+#else
+  u64 i;
+
+  for (i = 0; i < npages; i++) {
+    put_page (pag[i]);
+  }
+#endif
+}
+
+/**
+* @brief Add a piece of the buffer to its list of physically contiguous regions. It is merged with
+* the last region if it follows it in memory, so each huge page produces (at least) one region and
+* 2MB, 1GB and transparent huge pages are handled the same way.
+*
+* @param m The buffer. The table grows when it is full.
+* @param capacity Elements allocated in m->segment.
+* @param offset Offset of the piece in the buffer.
+* @param address Kernel address of the piece.
+* @param length Length of the piece.
+*
+* @return 0 if ok, -ENOMEM if the table cannot grow.
+*/
+static int appendSegment (struct mem *m, u64 *capacity, u64 offset, u64 address, u64 length)
+{
+  struct mem_segment *seg;
+
+  if (m->nsegments && m->segment[m->nsegments - 1].address + m->segment[m->nsegments - 1].length == address) {
+    m->segment[m->nsegments - 1].length += length;
+    return 0;
+  }
+  if (m->nsegments == *capacity) {
+    seg = vmalloc (2 * *capacity * sizeof (struct mem_segment));
+    if (seg == NULL) {
+      return -ENOMEM;
+    }
+    memcpy (seg, m->segment, m->nsegments * sizeof (struct mem_segment));
+    vfree (m->segment);
+    m->segment = seg;
+    *capacity *= 2;
+  }
+  seg = &m->segment[m->nsegments++];
+  seg->offset  = offset;
+  seg->address = address;
+  seg->length  = length;
+  return 0;
+}
+
+static void forgetUserHugePages (struct mem *m);
+
+/**
+* @brief This function pins the user memory pointed by db and describes it as a list of
+* physically contiguous regions (m->segment). The 4KB pages are pinned in slices of
+* PIN_PAGES_PER_CALL without mmap_sem, and only the regions are kept: the pointers to the 4KB
+* pages of a slice are discarded once it has been merged in the table. A huge page of hugetlbfs
+* is pinned once (see pinnedPages): the pins of its next 4KB pages in the slice are dropped and
+* the following ones are pinned one huge page per call, until a 4KB page is found again.
 *
 * @param db User data that is necessary to map.
-* @param card Driver main structure.
-* @param ppag ppag will point to a list of pointer of pages it the invocation
-* was successful.
+* @param m The buffer of the context whose regions are filled.
 *
-* @return The number of pointer of pages in *ppag.
+* @return The number of 4KB pages held, a negative value if the memory cannot be pinned.
 */
-static int getUserHugePages (struct dma_buffer *db, struct nfp_card *card, struct page ***ppag)
+static s64 getUserHugePages (struct dma_buffer *db, struct mem *m)
 {
-  int ret;
-  /*Assuming the userspace pointer is passed as an unsigned long, */
-  /*calculate the first,last, and number of pages being transferred via*/
+  struct page **pag;
   u64 udata  = (u64) db->data;
   u64 nbytes = db->length;
-  u64 first_page = (udata & PAGE_MASK) >> PAGE_SHIFT;
-  u64 last_page = ( (udata + nbytes - 1) & PAGE_MASK) >> PAGE_SHIFT;
-  u64 npages = last_page - first_page + 1;
-  struct page **pag;
-  u64 num_huge_pages = 0;
-  u64 acum;
-  int i;
-  pag = vmalloc (npages * sizeof (struct page *));
-  if (pag == NULL) {
-    return -EFAULT;
-  }
+  u64 first_offset = udata & ~PAGE_MASK;
+  u64 first = udata & PAGE_MASK;
+  u64 npages = (PAGE_ALIGN (udata + nbytes) - first) >> PAGE_SHIFT;
+  u64 capacity = db->is_hp && db->n_hp ? db->n_hp + 1 : 16; // One region per huge page unless they are adjacent
+  u64 done = 0, batch = PIN_PAGES_PER_CALL, i, offset, step = 1;
+  long ret;
 
-  *ppag = pag;
-  /* Ensure that all userspace pages are locked in memory for the */
-  /* duration of the DMA transfer */
-  down_read (&current->mm->mmap_sem);
-  #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
-    /*
-    long get_user_pages(unsigned long start, unsigned long nr_pages,
-          unsigned int gup_flags, struct page **pages,
-          struct vm_area_struct **vmas); */
-    ret = get_user_pages(udata, npages, FOLL_WRITE, pag, NULL);
-  #else
-    /*
-    long get_user_pages(struct task_struct *tsk, struct mm_struct *mm,
-        unsigned long start, unsigned long nr_pages,
-        int write, int force, struct page **pages,
-        struct vm_area_struct **vmas); */
-    ret = get_user_pages (current,
-                        current->mm,
-                        udata,
-                        npages,
-                        1,         /* We can write in this region */
-                        0,         /* Force */
-                        pag,
-                        NULL);
-
-  #endif
-  up_read (&current->mm->mmap_sem);
-
-  num_huge_pages = db->length;
-  num_huge_pages /= db->hp_size;
-  acum = db->hp_size;
-  acum *= num_huge_pages;
-
-  if (acum != db->length) {
-    num_huge_pages++;
+  if (nbytes == 0) {
+    return -EINVAL;
+  }
+  pag = vmalloc (PIN_PAGES_PER_CALL * sizeof (struct page *));
+  m->segment   = vmalloc (capacity * sizeof (struct mem_segment));
+  m->nsegments = 0;
+  if (pag == NULL || m->segment == NULL) {
+    vfree (pag);
+    vfree (m->segment);
+    m->segment = NULL;
+    return -ENOMEM;
   }
 
-  for (i = 0; i < num_huge_pages; i++) {
-    card->buffer.page_address[i] = (u64) page_address (pag[db->hp_size / PAGE_SIZE * i]);
+  while (done < npages) {
+    ret = pinPages (first + done * PAGE_SIZE, min_t (u64, batch, npages - done), pag);
+    if (ret <= 0) {
+      break;
+    }
+    for (i = 0; i < ret; i++) {
+      step = min_t (u64, pinnedPages (pag[i]), npages - done);
+      if (step > 1) { // The pin holds the rest of the huge page
+        unpinPages (pag + i + 1, ret - i - 1);
+        ret = i + 1;
+      }
+      offset = done * PAGE_SIZE;
+      if (appendSegment (m, &capacity, offset ? offset - first_offset : 0,
+                         (u64) page_address (pag[i]) + (offset ? 0 : first_offset),
+                         step * PAGE_SIZE - (offset ? 0 : first_offset))) {
+        unpinPages (pag + i, ret - i);
+        break;
+      }
+      done += step;
+    }
+    if (i < ret) {
+      break;
+    }
+    batch = step > 1 ? 1 : PIN_PAGES_PER_CALL;
   }
+  vfree (pag);
 
-  card->buffer.npages = num_huge_pages;
-  card->buffer.virtual = (void *)db->data;
-  card->buffer.length =  db->length;
+  if (done < npages) {
+    forgetUserHugePages (m);
+    return -EFAULT;
+  }
+  m->segment[m->nsegments - 1].length = nbytes - m->segment[m->nsegments - 1].offset; // The buffer may end before its last page
 
-  return ret;
+  return done;
 }
 
 
 /**
-* @brief Release an user previously registered buffer.
+* @brief Release a buffer pinned by getUserHugePages, one physically contiguous region at a time.
 *
-* @param pages The content of the ppag argument returned by getUserPages function.
-* @param num_pages The number of total pages pointed by pages.
+* @param m The buffer. Its table of regions is freed.
 */
-static void forgetUserHugePages (struct page **pages, int num_pages)
+static void forgetUserHugePages (struct mem *m)
 {
-  int i;
-
-  for (i = 0; i < num_pages; i++) {
-    down_read (&current->mm->mmap_sem);
-
-    if (!PageReserved (pages[i])) {
-      SetPageDirty (pages[i]);
-      #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
-        put_page (pages[i]);
-      #else
-        page_cache_release (pages[i]);
-      #endif
-    } else {
-      #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
-        put_page (pages[i]);
-      #else
-        page_cache_release (pages[i]);
-      #endif
-    }
+  struct mem_segment *seg;
+  u64 i;
 
-    up_read (&current->mm->mmap_sem);
+  for (i = 0; i < m->nsegments; i++) {
+    seg = &m->segment[i];
+    unpinRange (virt_to_page (seg->address), DIV_ROUND_UP ((seg->address & ~PAGE_MASK) + seg->length, PAGE_SIZE));
   }
-
-  vfree (pages);
+  vfree (m->segment);
+  m->segment   = NULL;
+  m->nsegments = 0;
 }
 
 
-int reg_hugemem(struct nfp_card *card, struct dma_buffer *db)
+int reg_hugemem(struct nfp_context *ctx, u32 handle, struct dma_buffer *db)
 {
-  if ( (num_pages = getUserHugePages (db, card, &pages)) < 0) {        // Map user memory into kernel space
-    card->buffer.length  = 0;
-    up (&card->sem_op);
+  struct mem *m = &ctx->buffer[handle];
+  s64 num_pages;
+  u64 ns;
+
+  unreg_hugemem (ctx, handle); // Registering a buffer in a handle replaces the previous one
+  ns = ktime_get_ns ();
+  if ( (num_pages = getUserHugePages (db, m)) < 0) {        // Pin the user memory
+    m->length  = 0;
     printk (KERN_ERR "nfp: user memory cant be mapped\n");
     return -EFAULT;
   } else {
-    card->buffer.virtual = db->data;
-    card->buffer.length  = db->length;
-    card->buffer.page_size  = db->hp_size;
+    m->virtual = db->data;
+    m->length  = db->length;
+    m->page_size  = db->hp_size;
+    printk (KERN_INFO "nfp: buffer %u of %llu bytes (%lld pages of 4KB) registered in %llu contiguous regions in %llu us\n",
+            handle, m->length, num_pages, m->nsegments, (ktime_get_ns () - ns) / 1000);
   }
 
   return 0;
 }
 
-int unreg_hugemem (struct nfp_card *card)
+int unreg_hugemem (struct nfp_context *ctx, u32 handle)
 {
-  if (card->buffer.length) { /* Ensure the operation is executed just one time. */
-    card->buffer.length = 0;
-    forgetUserHugePages (pages, num_pages);
-    num_pages = 0;
+  struct mem *m = &ctx->buffer[handle];
+  u64 ns, nsegments = m->nsegments;
+
+  if (m->length) { /* Ensure the operation is executed just one time. */
+    ns = ktime_get_ns ();
+    m->length = 0;
+    dma_map_cache_flush (ctx, m); // The mappings point to the pages that are going to be released
+    forgetUserHugePages (m);
+    m->virtual   = NULL;
+    printk (KERN_INFO "nfp: buffer %u of %llu contiguous regions unregistered in %llu us\n", handle, nsegments, (ktime_get_ns () - ns) / 1000);
   }
 
   return 0;
@@ -36,22 +36,25 @@
 
 /**
  * @brief Initialize the internal buffers of the driver. In this case, a huge page (or several)
- * that has been  previously allocated in user space are set as the default location for
- * memory read and write requests
+ * that has been  previously allocated in user space are set as the location for the memory read
+ * and write requests of the descriptors of a context that refer to a handle. A buffer registered
+ * before in the same handle is released first.
  *
- * @param nfp_card Structure describing the device
+ * @param nfp_context Context of the open file
+ * @param handle Handle of the buffer (lower than NFP_MAX_BUFFERS)
  * @param dma_buffer The information provided by the user space
  *
  * @return 0 if everything was ok
  */
-int reg_hugemem(struct nfp_card *card, struct dma_buffer *db);
+int reg_hugemem(struct nfp_context *ctx, u32 handle, struct dma_buffer *db);
 
 /**
  * @brief Unmap a previous registered buffer
  *
- * @param nfp_card Structure describing the device
+ * @param nfp_context Context of the open file
+ * @param handle Handle of the buffer (lower than NFP_MAX_BUFFERS)
  * @return 0 if everything was ok
  */
-int unreg_hugemem(struct nfp_card *card);
+int unreg_hugemem(struct nfp_context *ctx, u32 handle);
 
 #endif
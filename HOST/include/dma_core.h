@@ -0,0 +1,167 @@
+/**
+* @file include/dma_core.h
+*
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief  Register map of the DMA core (BAR0). It is shared by the driver and by the
+* software model of the device in the middleware, so both always agree on the layout.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+
+#ifndef DMA_CORE_H
+#define DMA_CORE_H
+
+#ifndef __KERNEL__
+#include <stdint.h>
+#endif
+
+#define MAX_NUM_DMA_ENGINES 2        /**< Maximum number of DMA engines in the device */
+
+#define ADDRES_OFFSET           0x199  /**< Initial offset in the BAR0 that indicates the address of the second bar (so a translation from PCIe addresses to FPGA ones can be made). */
+#define MAX_NUM_DMA_DESCRIPTORS 1024   /**< Maximum number of DMA engines in the device */
+#define OFFSET_BETWEEN_ENGINES  0x4000 /**< Offset in 64b words between engines in the HDL design */
+#define DMA_OFFSET              0x200  /**< Initial offset in the BAR0 to the DMA registers.
+At DMA_OFFSET                          dma_engine[0]
+At DMA_OFFSET+OFFSET_BETWEEN_ENGINES   dma_engine[1]
+
+.
+.
+.
+
+At DMA_OFFSET+i*OFFSET_BETWEEN_ENGINES dma_engine[i]
+
+
+
+At DMA_OFFSET+MAX_NUM_DMA_ENGINES*OFFSET_BETWEEN_ENGINES:  dma_common_block
+
+*/
+
+#define DMA_ENGINE_CONFIG_WORDS 8      /**< 64b words of configuration that precede the descriptor table of an engine */
+
+#define DMA_DESCRIPTOR_INDEX_BITS 10   /**< log2(MAX_NUM_DMA_DESCRIPTORS) */
+/** A read of the complete_until_descriptor word returns {active descriptor, last descriptor}. The active
+ * descriptor is the one being processed, or the next one to process if the engine is stopped. */
+#define DMA_ACTIVE_INDEX(word) (((word) >> DMA_DESCRIPTOR_INDEX_BITS) & (MAX_NUM_DMA_DESCRIPTORS - 1))
+
+#define MAX_TLP_SIZE   128     //In bytes. It must be a 32b multiple
+
+#define DMA_TLP_LOG_ENTRIES 8192 /**< Entries of the per-TLP latency log of an engine. A power of 2 */
+
+
+struct  __attribute__ ((__packed__)) dma_descriptor {
+  uint64_t  address;
+  uint64_t  size;
+  uint64_t  generate_irq : 1;
+  uint64_t  u0           : 63;
+  uint64_t  latency;
+
+  uint64_t  time_at_req;   // Divided by 4
+  uint64_t  time_at_comp;  // Divided by 4
+  uint64_t  bytes_at_req;  // Divided by 4
+  uint64_t  bytes_at_comp; // Divided by 4
+
+};
+
+
+/**
+* @brief Per-TLP latency log of an engine: the time from each memory read request until its last
+* completion, in a ring that follows the descriptor table. It is only implemented by the software
+* model of the device (middleware/emulator.c). The FPGA design does not have it, and it does not
+* ignore these addresses either: dma_engine_manager.v accepts the first word after the descriptor
+* table (its range check uses <=) and truncates it to the descriptor 0, so a write of the control
+* word overwrites the address of that descriptor and the reads return its fields. The driver
+* never accesses it and fails the log IOCTLs with EOPNOTSUPP.
+*/
+struct  __attribute__ ((__packed__)) dma_tlp_log {
+  uint64_t  enable       : 1;  // Write 1 to record the memory read requests of the engine. Setting it clears head
+  uint64_t  sample_shift : 5;  // Record only one of every 2^sample_shift requests
+  uint64_t  u0           : 58;
+  uint64_t  head;              // Read: entries recorded since the log was enabled. Entry i is at latency[i % DMA_TLP_LOG_ENTRIES]
+  uint32_t  latency[DMA_TLP_LOG_ENTRIES]; // Cycles of 4 ns, saturated to 32 bits
+};
+
+struct  __attribute__ ((__packed__)) dma_engine {
+  uint64_t  enable         : 1;
+  uint64_t  reset          : 1;
+  uint64_t  is_c2s         : 1;
+  uint64_t  is_s2c         : 1;
+  uint64_t  address_mode   : 2;
+  uint64_t  u0             : 58;
+  uint16_t  complete_until_descriptor;
+  uint16_t  u1;
+  uint32_t  u2;
+  uint64_t  total_time;             //Read: Time that consumed the previous operation. Write: Maximum timeout for a C2S operation
+  uint64_t  total_bytes;            //Only read
+
+  uint64_t  host_buffer_size;
+  uint64_t  address_offset;
+  uint64_t  address_inc;
+  uint64_t  number_of_tlps;
+  struct dma_descriptor  dma_descriptor[MAX_NUM_DMA_DESCRIPTORS];
+  struct dma_tlp_log     tlp_log;
+
+  uint64_t u4[OFFSET_BETWEEN_ENGINES - DMA_ENGINE_CONFIG_WORDS - MAX_NUM_DMA_DESCRIPTORS * sizeof(struct dma_descriptor) / 8 -
+              sizeof(struct dma_tlp_log) / 8];    // Unused
+};
+
+struct __attribute__ ((__packed__)) dma_common_block {
+  uint64_t max_payload : 3; // The maximum payload size being used by the DMA core.
+  // this size may be different than the system-programmed Max Payload
+  // The size is expressed as: 2^{max_payload} * 128 bytes. Common examples:
+  //    · 000 = 128  Bytes
+  //    · 001 = 256  Bytes
+  //    · 010 = 512  Bytes
+  //    · 011 = 1024 Bytes
+  //    · 100 = 2048 Bytes
+  //    · 101 = 4096 Bytes
+  uint64_t max_read_request : 3; // The read request size being used by the DMA core.
+  // this size may be different than the system-programmed Max Read Request
+  // The size is expressed as: 2^{max_payload} * 128 bytes. Common examples:
+  //    · 000 = 128  Bytes
+  //    · 001 = 256  Bytes
+  //    · 010 = 512  Bytes
+  //    · 011 = 1024 Bytes
+  //    · 100 = 2048 Bytes
+  //    · 101 = 4096 Bytes
+  uint64_t irq_enable  : 1; // Global DMA Interrupt Enable; this bit globally enables/disables interrupts.
+  uint64_t user_reset  : 1;
+
+  uint64_t engine_finished : 16;  // Bitmask of engines that have completed the operation. It is useful if
+  // a polling strategy is applied.
+  uint64_t u0 : 32;
+
+};
+
+
+
+struct  __attribute__ ((__packed__)) dma_core {
+  struct dma_engine       dma_engine[MAX_NUM_DMA_ENGINES];
+  struct dma_common_block dma_common_block;
+};
+
+#define DMA_CORE_BAR0_SIZE (DMA_OFFSET * 8 + sizeof(struct dma_core)) /**< Bytes of BAR0 covered by the DMA core registers */
+
+#endif
@@ -42,6 +42,8 @@
 
 #define MAX_PAGES      1024  /**< Maximum number of 4KB pages to be allocated.   */
 #define LOG2_MAX_PAGES 10    /**< log2 of the maximum number of 4KB pages to be allocated. */
+#define NFP_MAX_BUFFERS 16   /**< Buffers registered at the same time by an open file of the device. Handle 0 is the
+                                  buffer of NFPIOC_REGISTER_BUFFER, the rest are given by NFPIOC_REGISTER_BUFFER_HANDLE */
 
 struct reg32 {
   uint32_t  data;      /**< The 4 byte data to write */
@@ -64,8 +66,10 @@ struct dma_buffer {
   void *data;         /**< Pointer to the region of memory where
                          the driver will write/read. Virtual direction */
   uint64_t length;    /**< Quantity of data to transfer/receive */
-  uint64_t hp_size;    /**< Size in bytes of each huge page (2MB/1GB typically) */
+  uint64_t hp_size;    /**< Size in bytes of each huge page (2MB/1GB typically). The driver does not rely on it: the
+                          buffer is described by the physically contiguous regions found when it is pinned */
   uint32_t n_hp;      /**< Number of Huge Pages in the virtual direction pointed by data */
+  uint32_t handle;    /**< [OUTPUT] Handle of the buffer (NFPIOC_REGISTER_BUFFER_HANDLE) */
 
 };
 
@@ -82,7 +86,12 @@ struct  dma_descriptor_sw {
   uint64_t is_c2s_op    : 1;     /**< [CONTROL] Is this is an operation from the NIC to the host ? */
   uint64_t is_s2c_op    : 1;     /**< [CONTROL] Is this is an operation from the host to the NIC ? */
   uint64_t address_mode : 2;     /**< [CONTROL] Is this is an operation from the host to the NIC ? */
-  uint64_t u0           : 58;
+  uint64_t engine       : 4;     /**< [CONTROL] DMA engine of the descriptor (lower than MAX_NUM_DMA_ENGINES) */
+  uint64_t slots        : 8;     /**< [STATUS] Positions of the ring used by the descriptor. More than 1 if it was split
+                                      (see NFPIOC_WRITE_DMA_DESCRIPTOR) */
+  uint64_t buffer       : 8;     /**< [CONTROL] Handle of the registered buffer of address (lower than NFP_MAX_BUFFERS).
+                                      0 is the buffer of NFPIOC_REGISTER_BUFFER, or the kernel pages if there is none */
+  uint64_t u0           : 38;
   uint64_t number_of_tlps;
   uint64_t latency;
   uint64_t address_offset;          /**< [STATUS] Time attending request TLPs*/
@@ -94,6 +103,80 @@ struct  dma_descriptor_sw {
   uint64_t index;                /**< [CONTROL] Index of the descriptor to update/retrieve information */
 };
 
+/**
+* @brief A vector of descriptors that is written or read in a single IOCTL operation.
+*/
+struct dma_descriptor_batch {
+  struct dma_descriptor_sw *descriptors; /**< [INPUT] Array of descriptors in userspace */
+  uint32_t count;                        /**< [INPUT] Number of elements in descriptors. Maximum MAX_DESCRIPTORS_PER_BATCH */
+  uint32_t processed;                    /**< [OUTPUT] Number of descriptors that were written/read */
+  uint32_t engine;                       /**< [INPUT] DMA engine of every descriptor of the batch */
+};
+
+#define MAX_DESCRIPTORS_PER_BATCH 1024 /**< Size of the descriptor table of an engine */
+#define NFP_MAX_DESCRIPTOR_SLOTS  16   /**< Maximum number of pieces of a split descriptor */
+
+#define NFP_MMAP_BAR0_OFFSET (MAX_PAGES * KERNEL_PAGE_SIZE) /**< mmap offset that maps BAR0 (uncached) instead of the kernel pages.
+                                                               The DMA core only accepts 32/64 bit writes, so it is never write-combined. */
+
+/**
+* @brief Region of the registered buffer that the device accesses directly (see NFP_MMAP_BAR0_OFFSET).
+*/
+struct dma_buffer_map {
+  uint64_t offset;       /**< [INPUT] Offset in the registered buffer (or in the kernel pages) */
+  uint64_t length;       /**< [INPUT] Size of the region. It must be physically contiguous (inside a huge page) */
+  uint64_t bus_address;  /**< [OUTPUT] Address of the region for the device */
+  uint32_t buffer;       /**< [INPUT] Handle of the registered buffer (see dma_descriptor_sw.buffer) */
+};
+
+/**
+* @brief Window size (concurrent tags in memory reads) of a concrete DMA engine.
+*/
+struct dma_window {
+  uint64_t size;    /**< [INPUT] Number of tags */
+  uint32_t engine;  /**< [INPUT] DMA engine (lower than MAX_NUM_DMA_ENGINES) */
+};
+
+/**
+* @brief Configuration of the per-TLP latency log of a DMA engine (struct dma_tlp_log in dma_core.h).
+*/
+struct dma_tlp_log_control {
+  uint32_t engine;        /**< [INPUT] DMA engine (lower than MAX_NUM_DMA_ENGINES) */
+  uint32_t enable;        /**< [INPUT] 1 starts the log from an empty ring, 0 stops it */
+  uint32_t sample_shift;  /**< [INPUT] Only one of every 2^sample_shift memory read requests is recorded */
+};
+
+/**
+* @brief Entries of the per-TLP latency log of a DMA engine that have not been read yet.
+*/
+struct dma_tlp_log_read {
+  uint32_t *latency;  /**< [INPUT] Array in userspace where the entries (cycles of 4 ns) are copied */
+  uint32_t  count;    /**< [INPUT] Number of elements in latency. [OUTPUT] Entries copied */
+  uint32_t  engine;   /**< [INPUT] DMA engine (lower than MAX_NUM_DMA_ENGINES) */
+  uint64_t  tail;     /**< [INPUT] Entries already read since the log was enabled. [OUTPUT] Advanced by count */
+  uint64_t  lost;     /**< [OUTPUT] Entries overwritten by the device before they could be read */
+};
+
+/**
+* @brief Max Payload Size and Max Read Request Size of the device in the PCIe link, in bytes.
+*/
+struct pcie_config {
+  uint32_t max_payload;        /**< [INPUT] MPS to program, 0 keeps it. [OUTPUT] MPS in effect */
+  uint32_t max_read_request;   /**< [INPUT] MRRS to program, 0 keeps it. [OUTPUT] MRRS in effect */
+  uint32_t max_payload_limit;  /**< [OUTPUT] Largest MPS: the capability of the device and the MPS of the bridge above it */
+};
+
+/**
+* @brief How the driver detects the end of a DMA operation.
+*/
+enum nfp_completion_mode {
+  NFP_COMPLETION_POLL   = 0, /**< Busy-poll the enable bit of the engine (default) */
+  NFP_COMPLETION_IRQ    = 1, /**< Sleep until the MSI of the engine is received */
+  NFP_COMPLETION_HYBRID = 2  /**< Busy-poll for NFP_HYBRID_SPIN_US and then sleep */
+};
+
+#define NFP_HYBRID_SPIN_US 50 /**< Busy-poll period of NFP_COMPLETION_HYBRID */
+
 /* IOCTL operations */
 #define IOCTL_MAGIC_NUMBER  '9' /**< Magic number of nfp_driver IOCTL operations.
                                     Check Documentation/magic-number.txt in the kernel tree */
@@ -104,19 +187,94 @@ struct  dma_descriptor_sw {
 
 #define NFPIOC_READ_32  _IOWR(IOCTL_MAGIC_NUMBER, 2, struct reg32) /**< Store the data pointed by BAR0+reg32.offset in reg32.data */
 
-#define NFPIOC_WRITE_DMA_DESCRIPTOR         _IOR(IOCTL_MAGIC_NUMBER, 3, struct dma_descriptor_sw)
+#define NFPIOC_WRITE_DMA_DESCRIPTOR         _IOWR(IOCTL_MAGIC_NUMBER, 3, struct dma_descriptor_sw) /**< Write the [CONTROL] fields
+                                                         of a descriptor. If enable is set and [address, address+length) is not
+                                                         physically contiguous (it crosses the end of a huge page), the descriptor
+                                                         is split in up to NFP_MAX_DESCRIPTOR_SLOTS pieces. They are processed one
+                                                         after another in consecutive positions of the ring, each with the share of
+                                                         number_of_tlps of its length, and slots returns how many positions were
+                                                         used. Every other operation rejects a descriptor that is not contiguous. */
 
 #define NFPIOC_READ_DMA_DESCRIPTOR         _IOWR(IOCTL_MAGIC_NUMBER, 4, struct dma_descriptor_sw)
 
 #define NFPIOC_REGISTER_BUFFER   _IOR(IOCTL_MAGIC_NUMBER, 5, struct dma_transfer) /**< Register a buffer.
                                                          [INPUT]   dma_transfer.data will point to a region of memory
                                                          where we want to transfer to the card.
-                                                         [INPUT]   dma_transfer.length indicates the size of the region. */
+                                                         [INPUT]   dma_transfer.length indicates the size of the region.
+                                                         It replaces the buffer of the handle 0. It fails with EBUSY
+                                                         while an engine leased by the file is running or has descriptors
+                                                         that were not reaped, since they may use the replaced buffer. */
+
+#define NFPIOC_UNREGISTER_BUFFER _IO(IOCTL_MAGIC_NUMBER, 6)  /**< Unregister the buffer of the handle 0. EBUSY in the same
+                                                         cases than NFPIOC_REGISTER_BUFFER. */
+
+#define NFPIOC_WINDOW_SIZE _IOR(IOCTL_MAGIC_NUMBER, 7,uint64_t)  /**< Set the concurrent number of tags in reception of the engine 0. */
+
+#define NFPIOC_WRITE_DMA_DESCRIPTORS _IOWR(IOCTL_MAGIC_NUMBER, 8, struct dma_descriptor_batch) /**< Write the [CONTROL] fields of
+                                                         dma_descriptor_batch.count descriptors in order, as NFPIOC_WRITE_DMA_DESCRIPTOR
+                                                         would do with each of them. The engine is started by the descriptors with
+                                                         enable set (typically only the last one). */
+
+#define NFPIOC_READ_DMA_DESCRIPTORS  _IOWR(IOCTL_MAGIC_NUMBER, 9, struct dma_descriptor_batch) /**< Read the [STATUS] fields of
+                                                         dma_descriptor_batch.count descriptors. */
+
+#define NFPIOC_COMPLETION_MODE _IOR(IOCTL_MAGIC_NUMBER, 10, uint32_t)  /**< Select the completion mode (enum nfp_completion_mode).
+                                                         It fails if the device has no MSI and the mode is not NFP_COMPLETION_POLL. */
+
+#define NFPIOC_SUBMIT_DMA_DESCRIPTORS _IOWR(IOCTL_MAGIC_NUMBER, 11, struct dma_descriptor_batch) /**< Queue dma_descriptor_batch.count
+                                                         descriptors and return without waiting for them. The driver chooses the
+                                                         position of each descriptor in the ring and returns it in its index field.
+                                                         The engine is started (or its run extended) after the last one. While the
+                                                         engine is busy the new descriptors must have the configuration (direction,
+                                                         buffer_size, number_of_tlps, address_mode/offset/inc) of the ones in flight. */
+
+#define NFPIOC_REAP_DMA_DESCRIPTORS   _IOWR(IOCTL_MAGIC_NUMBER, 12, struct dma_descriptor_batch) /**< Retrieve the [STATUS] fields of up to
+                                                         dma_descriptor_batch.count submitted descriptors that have been completed, in
+                                                         order of submission. It does not block: dma_descriptor_batch.processed may be 0.
+                                                         poll() on the device reports POLLIN when there are completed descriptors. */
+
+#define NFPIOC_ENGINE_WINDOW_SIZE _IOR(IOCTL_MAGIC_NUMBER, 13, struct dma_window) /**< Set the concurrent number of tags in
+                                                         reception of dma_window.engine. */
+
+/* The descriptor, window size and TLP log operations only lock the DMA engine they work with, so each
+   engine can be driven from a different thread. The rest of the operations lock the device.
+   The registered buffer and its mappings belong to each open file of the device. The operations over
+   an engine lease it to the file that issues them and fail with EBUSY while another open file holds it.
+   The leases are returned with NFPIOC_RELEASE_ENGINE or when the file is closed. */
+
+#define NFPIOC_MAP_BUFFER _IOWR(IOCTL_MAGIC_NUMBER, 14, struct dma_buffer_map) /**< Map a region of the buffer for the device and
+                                                         return its bus address, so the descriptors can be programmed from userspace
+                                                         through BAR0. The mapping lasts until the buffer is unregistered. */
+
+#define NFPIOC_TLP_LOG_CONTROL _IOR(IOCTL_MAGIC_NUMBER, 15, struct dma_tlp_log_control) /**< Enable or disable the per-TLP
+                                                         latency log of dma_tlp_log_control.engine. Only the emulator implements
+                                                         the log: the driver fails it and NFPIOC_READ_TLP_LOG with EOPNOTSUPP. */
+
+#define NFPIOC_READ_TLP_LOG _IOWR(IOCTL_MAGIC_NUMBER, 16, struct dma_tlp_log_read) /**< Copy the entries of the per-TLP latency
+                                                         log from dma_tlp_log_read.tail on. If the device has already overwritten some
+                                                         of them, they are skipped and counted in lost. The log is read from BAR0, so
+                                                         it is meant to be drained between operations, not in the timed region. */
+
+#define NFPIOC_LEASE_ENGINE _IOR(IOCTL_MAGIC_NUMBER, 17, uint32_t) /**< Lease an engine to the open file before using it,
+                                                         so a busy engine is detected at the start. */
+
+#define NFPIOC_RELEASE_ENGINE _IOR(IOCTL_MAGIC_NUMBER, 18, uint32_t) /**< Return a leased engine. The operation in flight is
+                                                         waited for and the descriptors that were not reaped are discarded. */
+
+#define NFPIOC_REGISTER_BUFFER_HANDLE _IOWR(IOCTL_MAGIC_NUMBER, 19, struct dma_buffer) /**< Register a buffer without replacing
+                                                         the ones already registered. [OUTPUT] dma_buffer.handle identifies it in the buffer
+                                                         field of the descriptors. It fails with ENOSPC if NFP_MAX_BUFFERS - 1 are registered. */
 
-#define NFPIOC_UNREGISTER_BUFFER _IO(IOCTL_MAGIC_NUMBER, 6)  /**< Unregister a buffer. */
+#define NFPIOC_UNREGISTER_BUFFER_HANDLE _IOR(IOCTL_MAGIC_NUMBER, 20, uint32_t) /**< Unregister the buffer of a handle. The rest
+                                                         of the buffers (and their mappings) are kept. EBUSY in the same cases
+                                                         than NFPIOC_REGISTER_BUFFER. */
 
-#define NFPIOC_WINDOW_SIZE _IOR(IOCTL_MAGIC_NUMBER, 7,uint64_t)  /**< Set the concurrent number of tags in reception. */
+#define NFPIOC_PCIE_CONFIG _IOWR(IOCTL_MAGIC_NUMBER, 21, struct pcie_config) /**< Program the MPS and the MRRS of the device
+                                                         (powers of 2 from 128 to 4096 bytes) and return the values in effect. It fails
+                                                         with EINVAL if the link would not accept the TLPs of the DMA core (see
+                                                         dma_common_block) or the MPS is over max_payload_limit, and with EBUSY if an
+                                                         engine is running. */
 
-#define IOC_MAXNR 7 /**< Total number of IOCTL operations. */
+#define IOC_MAXNR 21 /**< Total number of IOCTL operations. */
 
 #endif
@@ -0,0 +1,315 @@
+/**
+* @file address_gen.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Software copy of the address generators of dma_rq_logic.v. Every register keeps the
+* name of the RTL in its comment (see address_gen.h) and address_gen_clock is the always block of
+* the random generator: the new value of each register is computed from the old values of the
+* others, as in a clock edge.
+*
+* Some properties of the RTL that the copy makes visible:
+*  - The first block of a descriptor is always sent to ADDR_AT_DESCRIPTOR, whatever the mode (the
+*    fixed generator only applies ADDRESS_GEN_OFFSET from the second block on).
+*  - The second block of the sequential generator is ADDR+SIZE even if it crosses the 4KB page.
+*    Then it returns to ADDR when the block after the next one would leave the page.
+*  - The random generator takes the page and the offset inside the page from two values of the
+*    LFSR two cycles apart, and it compares the page of the window (relative) with the page of
+*    the last address (absolute). The +4096 correction only applies if ADDR is inside the window.
+*  - ADDRESS_GEN_INCR is not used by any generator.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#include "address_gen.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#define LFSR_BITS   31
+#define LFSR_MASK   0x7FFFFFFFU
+#define PAGE_MASK   (ADDRESS_GEN_PAGE_SIZE - 1UL)
+#define JUMP_LEVELS 64
+
+/* Columns of the transition matrix of the LFSR raised to 2^k */
+static uint32_t lfsr_jump[JUMP_LEVELS][LFSR_BITS];
+static pthread_once_t lfsr_jump_once = PTHREAD_ONCE_INIT;
+
+
+/* random_number_r <= {random_number_r[29:0], random_number_r[30] ^ random_number_r[27]} */
+static inline uint32_t lfsr_step (uint32_t r)
+{
+  return ((r << 1) | (((r >> 30) ^ (r >> 27)) & 1)) & LFSR_MASK;
+}
+
+/* The LFSR is linear over GF(2): the image of a value is the sum of the images of its bits */
+static uint32_t lfsr_apply (const uint32_t *columns, uint32_t r)
+{
+  uint32_t out = 0;
+  int bit;
+
+  for (bit = 0; r; bit++, r >>= 1) {
+    if (r & 1) {
+      out ^= columns[bit];
+    }
+  }
+  return out;
+}
+
+static void lfsr_jump_init (void)
+{
+  int k, bit;
+
+  for (bit = 0; bit < LFSR_BITS; bit++) {
+    lfsr_jump[0][bit] = lfsr_step (1U << bit);
+  }
+  for (k = 1; k < JUMP_LEVELS; k++) {
+    for (bit = 0; bit < LFSR_BITS; bit++) {
+      lfsr_jump[k][bit] = lfsr_apply (lfsr_jump[k - 1], lfsr_jump[k - 1][bit]);
+    }
+  }
+}
+
+uint32_t address_gen_lfsr_advance (uint32_t lfsr, uint64_t cycles)
+{
+  int k;
+
+  lfsr &= LFSR_MASK;
+  if (cycles < JUMP_LEVELS) {
+    while (cycles--) {
+      lfsr = lfsr_step (lfsr);
+    }
+    return lfsr;
+  }
+  pthread_once (&lfsr_jump_once, lfsr_jump_init);
+  for (k = 0; cycles; k++, cycles >>= 1) {
+    if (cycles & 1) {
+      lfsr = lfsr_apply (lfsr_jump[k], lfsr);
+    }
+  }
+  return lfsr;
+}
+
+/* `CLOG2 of dma_rq_logic.v: ceil(log2(x)), between 1 and 12 */
+static uint64_t clog2 (uint64_t x)
+{
+  uint64_t c = 1;
+
+  while (c < 12 && (1UL << c) < x) {
+    c++;
+  }
+  return c;
+}
+
+/* Number of TLPs of a block (mem_*_number_even_tlp_r) */
+static uint64_t tlps_per_block (const struct address_gen_params *p)
+{
+  return p->size / p->max_tlp + (p->size % p->max_tlp ? 1 : 0);
+}
+
+/* Length of the TLP of a block: the last one carries the remainder (mem_*_odd_tlp_words_r) */
+static uint64_t tlp_length (const struct address_gen_params *p, uint64_t tlp_in_block, uint64_t tlps)
+{
+  if (tlp_in_block + 1 < tlps || p->size % p->max_tlp == 0) {
+    return p->max_tlp;
+  }
+  return p->size % p->max_tlp;
+}
+
+/*
+ * One clock edge of the random generator. load_tx is the condition under which tx_rand_*_addr_r
+ * samples ADDR + next_random_address_*_r: every cycle in IDLE, and at the end of each block.
+ */
+static void address_gen_clock (struct address_gen *g, int load_tx)
+{
+  const struct address_gen_params *p = &g->p;
+  uint64_t window = p->host_size - 1;
+  uint32_t lfsr = g->lfsr;
+  uint64_t modulus = g->modulus, candidate = g->candidate, page = g->page, size = g->size, clog_block = g->clog_block;
+  uint64_t block_minus_1 = g->block_minus_1, offset_in_page = g->offset_in_page, non_truncated = g->non_truncated;
+  uint64_t next_random = g->next_random;
+
+  g->lfsr           = lfsr_step (lfsr);
+  g->modulus        = lfsr & window;
+  g->candidate      = modulus;
+  g->page           = (candidate >> 12) != (g->tx_rand >> 12) ? candidate & ~PAGE_MASK : (candidate + ADDRESS_GEN_PAGE_SIZE) & ~PAGE_MASK;
+  g->non_truncated  = (page & ~PAGE_MASK) | offset_in_page;
+  g->next_random    = non_truncated & window;
+  g->size           = p->size;
+  g->clog_block     = clog2 (size);
+  g->block_minus_1  = ((1UL << clog_block) - 1) & PAGE_MASK; // 12 bits wide
+  g->offset_in_page = p->size ? (lfsr & PAGE_MASK) & ~block_minus_1 : 0;
+  if (load_tx) {
+    g->tx_rand = p->base + next_random;
+  }
+  g->cycle++;
+}
+
+/*
+ * Bring the registers to the edge cycle. A long wait is a jump of the LFSR followed by the
+ * ADDRESS_GEN_PIPELINE edges that refill the pipeline, which gives the same registers unless the
+ * generator is idle with ADDR inside the window (the page comparison then depends on the
+ * addresses sampled during the jump).
+ */
+static void address_gen_advance (struct address_gen *g, uint64_t cycle)
+{
+  if (cycle > g->cycle + 2 * ADDRESS_GEN_PIPELINE) {
+    g->lfsr  = address_gen_lfsr_advance (g->lfsr, cycle - ADDRESS_GEN_PIPELINE - g->cycle);
+    g->cycle = cycle - ADDRESS_GEN_PIPELINE;
+  }
+  while (g->cycle < cycle) {
+    address_gen_clock (g, !g->running);
+  }
+}
+
+void address_gen_reset (struct address_gen *g)
+{
+  memset (g, 0, sizeof (struct address_gen));
+  g->lfsr        = ADDRESS_GEN_LFSR_SEED;
+  g->p.host_size = 1;
+  g->p.max_tlp   = 1;
+}
+
+void address_gen_start (struct address_gen *g, const struct address_gen_params *p, uint64_t cycle)
+{
+  if (cycle <= g->cycle) {
+    cycle = g->cycle + 1;
+  }
+  address_gen_advance (g, cycle - 1);
+  g->p = *p;
+  g->running = 0;
+  address_gen_clock (g, 1);
+
+  // IDLE with ENGINE_VALID
+  g->seq_page       = p->base >> 12;
+  g->tx_seq         = p->base + p->size;
+  g->next_seq       = p->base + (p->size << 1);
+  g->address        = p->base;
+  g->tlp            = 0;
+  g->tlp_in_block   = 0;
+  g->tlps_per_block = tlps_per_block (p);
+  g->running        = p->size != 0 && p->number_of_tlps != 0;
+}
+
+int address_gen_tlp (struct address_gen *g, uint64_t cycle, uint64_t *address, uint64_t *length)
+{
+  const struct address_gen_params *p = &g->p;
+  uint64_t tx, wrap;
+
+  if (!g->running) {
+    return 0;
+  }
+  if (cycle <= g->cycle) {
+    cycle = g->cycle + 1;
+  }
+  address_gen_advance (g, cycle - 1);
+
+  *address = g->address;
+  *length  = tlp_length (p, g->tlp_in_block, g->tlps_per_block);
+
+  if (g->tlp_in_block + 1 == g->tlps_per_block) {
+    // End of the block: the next one starts at the output of the generator of the mode
+    tx = p->mode == ADDRESS_GEN_FIX ? p->base + p->offset : p->mode == ADDRESS_GEN_SEQ ? g->tx_seq : g->tx_rand;
+    address_gen_clock (g, 1);
+    wrap = (g->next_seq + p->size) >> 12 != g->seq_page;
+    g->tx_seq       = wrap ? p->base : g->next_seq;
+    g->next_seq     = wrap ? p->base + p->size : g->next_seq + p->size;
+    g->address      = tx;
+    g->tlp_in_block = 0;
+  } else {
+    address_gen_clock (g, 0);
+    g->address += *length;
+    g->tlp_in_block++;
+  }
+
+  g->tlp++;
+  if (g->tlp == p->number_of_tlps) {
+    g->running = 0;
+  }
+  return 1;
+}
+
+int address_gen_footprint (const struct address_gen_params *p, struct address_gen_range *r)
+{
+  struct address_gen g;
+  uint64_t tlps = tlps_per_block (p), first, rest, block, address, length, end = 0;
+  int n = 0;
+
+  if (p->size == 0 || p->number_of_tlps == 0) {
+    return 0;
+  }
+  // The first block is at the base. It may be cut by the end of the descriptor
+  first = p->number_of_tlps < tlps ? p->number_of_tlps * p->max_tlp : p->size;
+  first = first < p->size ? first : p->size;
+  rest  = p->number_of_tlps - (p->number_of_tlps < tlps ? p->number_of_tlps : tlps);
+
+  r[n].offset = 0;
+  r[n].length = first;
+  r[n].stride = 0;
+  r[n].count  = 1;
+  n++;
+  if (rest == 0) {
+    return n;
+  }
+
+  switch (p->mode) {
+  case ADDRESS_GEN_FIX:
+    r[n].offset = p->offset;
+    r[n].length = rest < tlps ? rest * p->max_tlp : p->size;
+    r[n].length = r[n].length < p->size ? r[n].length : p->size;
+    r[n].stride = 0;
+    r[n].count  = 1;
+    n++;
+    break;
+
+  case ADDRESS_GEN_SEQ:
+    // The blocks advance until the generator returns to the base, then they repeat
+    address_gen_reset (&g);
+    address_gen_start (&g, p, 1);
+    while (address_gen_tlp (&g, g.cycle + 1, &address, &length)) {
+      if (address + length - p->base > end) {
+        end = address + length - p->base;
+      }
+      if (g.tlp_in_block == 0 && g.address == p->base) {
+        break;
+      }
+    }
+    r[0].length = end;
+    break;
+
+  default:
+    // Any block (the size rounded up to a power of 2) of any page of the window
+    block = 1UL << clog2 (p->size);
+    block = block < ADDRESS_GEN_PAGE_SIZE ? block : ADDRESS_GEN_PAGE_SIZE;
+    r[0].length = p->size;
+    r[0].stride = block;
+    r[0].count  = p->host_size > block ? p->host_size / block : 1;
+    if (p->size >= block) {
+      r[0].length = (r[0].count - 1) * block + p->size;
+      r[0].stride = 0;
+      r[0].count  = 1;
+    }
+    break;
+  }
+  return n;
+}
@@ -0,0 +1,148 @@
+/**
+* @file address_gen.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Software copy of the address generators of dma_rq_logic.v (FPGA/source/hdl/dma). It
+* produces the address and the length of every TLP of a descriptor, register by register: the
+* fixed (address_mode 0), sequential (1) and random (3) generators, the split of each block of
+* SIZE_AT_DESCRIPTOR bytes in TLPs of MPS/MRRS bytes and the pipeline of the random generator
+* fed by the 31-bit LFSR. The LFSR advances every clock cycle since the reset of the core, so the
+* random addresses depend on the cycle in which each TLP is sent: the caller provides it.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef ADDRESS_GEN_H
+#define ADDRESS_GEN_H
+
+#include <stdint.h>
+
+#define ADDRESS_GEN_FIX          0
+#define ADDRESS_GEN_SEQ          1
+#define ADDRESS_GEN_RAN          3   /**< address_mode 2 selects the random generator as well */
+#define ADDRESS_GEN_PAGE_SIZE    4096
+#define ADDRESS_GEN_LFSR_SEED    1   /**< Value of random_number_r after the reset */
+#define ADDRESS_GEN_PIPELINE     8   /**< Cycles that the random pipeline needs to be refilled after a jump */
+#define ADDRESS_GEN_MAX_FOOTPRINT 2  /**< Ranges returned by address_gen_footprint */
+
+/**
+* @brief The inputs of dma_rq_logic for a descriptor.
+*/
+struct address_gen_params {
+  uint64_t base;           /**< ADDR_AT_DESCRIPTOR: address of the descriptor (bus address) */
+  uint64_t size;           /**< SIZE_AT_DESCRIPTOR: bytes of each block */
+  uint64_t host_size;      /**< SIZE_AT_HOST: window of the random generator. A power of 2 */
+  uint64_t offset;         /**< ADDRESS_GEN_OFFSET of the fixed generator */
+  uint64_t number_of_tlps; /**< NUMBER_TLPS */
+  uint64_t max_tlp;        /**< Bytes of a TLP: MPS for memory writes (and reads of an engine in both directions), MRRS otherwise */
+  uint8_t  mode;           /**< address_mode */
+};
+
+/**
+* @brief Registers of the generators. Initialise it with address_gen_reset, as the reset of the
+* core does, and keep it across the descriptors: the random generator never stops.
+*/
+struct address_gen {
+  struct address_gen_params p;
+  uint64_t cycle;          /**< Clock edge of the values of the registers */
+  uint32_t lfsr;           /**< random_number_r */
+  uint64_t modulus;        /**< random_number_modulus_r */
+  uint64_t candidate;      /**< next_random_address_candidate_r (the +4096 candidate is derived from it) */
+  uint64_t page;           /**< next_random_page_*_non_truncated_r */
+  uint64_t size;           /**< size_at_descriptor_r */
+  uint64_t clog_block;     /**< clog_block_in_boundary_r */
+  uint64_t block_minus_1;  /**< block_in_boundary_minus_1_r */
+  uint64_t offset_in_page; /**< next_*_offset_in_window_r */
+  uint64_t non_truncated;  /**< next_random_address_*_non_truncated_r */
+  uint64_t next_random;    /**< next_random_address_*_r */
+  uint64_t tx_rand;        /**< tx_rand_*_addr_r */
+  uint64_t tx_seq;         /**< tx_seq_*_addr_r */
+  uint64_t next_seq;       /**< next_tx_seq_*_addr_r */
+  uint64_t seq_page;       /**< initial_*_seq_page_r */
+  uint64_t address;        /**< mem_*_addr_pointed_by_descriptor_r: address of the next TLP */
+  uint64_t tlp;            /**< TLPs of the descriptor already sent */
+  uint64_t tlp_in_block;   /**< mem_*_current_tlp_modulus_r - 1 */
+  uint64_t tlps_per_block; /**< mem_*_number_even_tlp_r */
+  uint8_t  running;        /**< The registers of the descriptor hold a start (not IDLE) */
+};
+
+/**
+* @brief A range of the buffer accessed by a descriptor: count chunks of length bytes, stride bytes
+* apart, from offset (relative to the base of the descriptor).
+*/
+struct address_gen_range {
+  uint64_t offset;
+  uint64_t length;
+  uint64_t stride;
+  uint64_t count;
+};
+
+/**
+* @brief Value of the LFSR of the random generator after some clock cycles.
+*
+* @param lfsr The initial value (31 bits).
+* @param cycles Number of clock edges. Long jumps are computed with the powers of the transition
+* matrix, so any value is cheap.
+*/
+uint32_t address_gen_lfsr_advance (uint32_t lfsr, uint64_t cycles);
+
+/**
+* @brief Reset of the core (RST_N): every register to 0 and the LFSR to ADDRESS_GEN_LFSR_SEED at
+* the cycle 0.
+*/
+void address_gen_reset (struct address_gen *g);
+
+/**
+* @brief Start a descriptor: the IDLE state of dma_rq_logic with ENGINE_VALID at the edge cycle.
+* The first TLP is sent at the base address.
+*
+* @param cycle Clock edge since the reset. If it is not later than the last edge of the registers,
+* the next edge is used.
+*/
+void address_gen_start (struct address_gen *g, const struct address_gen_params *p, uint64_t cycle);
+
+/**
+* @brief The next TLP of the descriptor.
+*
+* @param cycle Clock edge in which the TLP is sent. If it is the last TLP of a block, the
+* generators move to the next block in this edge.
+* @param address Where the address of the TLP is stored.
+* @param length Where its length in bytes is stored.
+*
+* @return 1 if a TLP was produced, 0 if the descriptor has already sent number_of_tlps TLPs.
+*/
+int address_gen_tlp (struct address_gen *g, uint64_t cycle, uint64_t *address, uint64_t *length);
+
+/**
+* @brief Bytes that the descriptor may access regardless of the cycles of its TLPs. The fixed and
+* sequential generators are exact. The random one gives every block that it can choose: a block
+* (the size rounded up to a power of 2) at any aligned position of every page of the window.
+*
+* @param r At least ADDRESS_GEN_MAX_FOOTPRINT ranges.
+*
+* @return The number of ranges.
+*/
+int address_gen_footprint (const struct address_gen_params *p, struct address_gen_range *r);
+
+#endif
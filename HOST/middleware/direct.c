@@ -0,0 +1,223 @@
+/**
+* @file direct.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Programming of the DMA engines through BAR0 mapped in userspace. The DMA core
+* only accepts 32/64 bit accesses, so every register is accessed with a single aligned
+* load/store and the mapping is not write-combined.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#include "direct.h"
+#include "init.h"
+#include "emulator.h"
+#include "../include/dma_core.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+/**
+* @brief BAR0 in the process and the bus address of the pages of the buffer.
+*/
+struct direct {
+  volatile uint8_t *bar0;
+  size_t            bar0_length;
+  uint64_t          page_size;
+  uint32_t          npages;
+  uint64_t         *bus_address; /**< A contiguous region per page (malloc) */
+};
+
+static struct direct direct;
+
+
+static inline uint64_t offsetOf (volatile void *reg)
+{
+  return (uint64_t)((volatile uint8_t *)reg - direct.bar0);
+}
+
+/* The model has to see the stores to apply their side effects */
+static inline void notifyStore (volatile void *reg)
+{
+  if (isEmulatedDevice()) {
+    emu_bar0_written (offsetOf (reg));
+  }
+}
+
+static inline void write64 (volatile void *reg, uint64_t value)
+{
+  *(volatile uint64_t *)reg = value;
+  notifyStore (reg);
+}
+
+static inline void write32 (volatile void *reg, uint32_t value)
+{
+  *(volatile uint32_t *)reg = value;
+  notifyStore (reg);
+}
+
+static inline void write16 (volatile void *reg, uint16_t value)
+{
+  *(volatile uint16_t *)reg = value;
+  notifyStore (reg);
+}
+
+static inline uint64_t read64 (volatile void *reg)
+{
+  return *(volatile uint64_t *)reg;
+}
+
+static inline uint32_t read32 (volatile void *reg)
+{
+  return *(volatile uint32_t *)reg;
+}
+
+static uint64_t getTimeNs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int directOpen (uint64_t length, uint64_t page_size)
+{
+  struct dma_buffer_map bm;
+  void *bar0;
+  uint32_t i;
+  int ret;
+
+  memset (&direct, 0, sizeof (struct direct));
+  direct.page_size   = page_size < length ? page_size : length;
+  direct.npages      = (length + direct.page_size - 1) / direct.page_size;
+  direct.bar0_length = DMA_CORE_BAR0_SIZE;
+  direct.bus_address = malloc (direct.npages * sizeof (uint64_t));
+  if (direct.bus_address == NULL) {
+    return -1;
+  }
+
+  if (isEmulatedDevice()) {
+    bar0 = emu_bar0 ();
+  } else {
+    bar0 = mmap (NULL, direct.bar0_length, PROT_READ | PROT_WRITE, MAP_SHARED, getCharDeviceDescriptor(), NFP_MMAP_BAR0_OFFSET);
+    if (bar0 == MAP_FAILED) {
+      perror ("mmap BAR0: ");
+      bar0 = NULL;
+    }
+  }
+  if (bar0 == NULL) {
+    directClose ();
+    return -1;
+  }
+  direct.bar0 = (volatile uint8_t *)bar0;
+
+  for (i = 0; i < direct.npages; i++) {
+    bm.buffer = 0;
+    bm.offset = (uint64_t)i * direct.page_size;
+    bm.length = direct.page_size;
+    ret = isEmulatedDevice() ? emu_ioctl (NFPIOC_MAP_BUFFER, &bm) : ioctl (getCharDeviceDescriptor(), NFPIOC_MAP_BUFFER, &bm);
+    if (ret) {
+      perror ("NFPIOC_MAP_BUFFER: ");
+      directClose ();
+      return -1;
+    }
+    direct.bus_address[i] = bm.bus_address;
+  }
+  return 0;
+}
+
+void directClose (void)
+{
+  if (direct.bar0 && !isEmulatedDevice()) {
+    munmap ((void *)direct.bar0, direct.bar0_length);
+  }
+  free (direct.bus_address);
+  memset (&direct, 0, sizeof (struct direct));
+}
+
+int directWriteDescriptor (struct dma_descriptor_sw *dd)
+{
+  volatile struct dma_engine *eng = &((volatile struct dma_core *)(direct.bar0 + DMA_OFFSET * 8))->dma_engine[dd->engine];
+  volatile struct dma_descriptor *d = &eng->dma_descriptor[dd->index % MAX_NUM_DMA_DESCRIPTORS];
+  uint64_t page = dd->address / direct.page_size;
+  uint64_t extent = dd->address_mode >= 2 && dd->buffer_size > dd->length ? dd->buffer_size : dd->length; // The random generator moves through buffer_size
+  uint64_t start;
+  uint32_t control;
+
+  if (page >= direct.npages || dd->address % direct.page_size + extent > direct.page_size) {
+    fprintf (stderr, "The descriptor is not contained in a page of the buffer\n");
+    return -1;
+  }
+  // The registers of a running engine are not written: the operation in flight uses them
+  if (read32 (eng) & 1) {
+    fprintf (stderr, "The engine %u is still running\n", dd->engine);
+    return -1;
+  }
+
+  // Same steps than writeDMADescriptor (nfpdma.c)
+  write64 (&eng->host_buffer_size, dd->buffer_size);
+  write64 (&eng->number_of_tlps, dd->number_of_tlps);
+  write64 (&eng->address_offset, dd->address_offset);
+  write64 (&eng->address_inc, dd->address_inc);
+  control = dd->is_c2s_op << 2;
+  control += dd->is_s2c_op ? (1 << 3) : 0;
+  control += (dd->address_mode << 4);
+  write32 (eng, control);
+
+  write64 (&d->address, direct.bus_address[page] + dd->address % direct.page_size);
+  write64 (&d->size, dd->length);
+  write64 ((volatile uint8_t *)&d->size + 8, 0); // generate_irq: nobody sleeps
+  write16 (&eng->complete_until_descriptor, dd->index % MAX_NUM_DMA_DESCRIPTORS);
+
+  if (!dd->enable) {
+    return 0;
+  }
+  __sync_synchronize (); // Every store of the descriptor reaches the device before the engine starts
+  write32 (eng, control | 1);
+
+  start = getTimeNs ();
+  while (read32 (eng) & 1) {
+    if (getTimeNs () - start > DIRECT_TIMEOUT_NS) {
+      fprintf (stderr, "Exit by timeout\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void directReadDescriptor (struct dma_descriptor_sw *dd)
+{
+  volatile struct dma_engine *eng = &((volatile struct dma_core *)(direct.bar0 + DMA_OFFSET * 8))->dma_engine[dd->engine];
+  volatile struct dma_descriptor *d = &eng->dma_descriptor[dd->index % MAX_NUM_DMA_DESCRIPTORS];
+
+  dd->latency       = read64 (&d->latency);
+  dd->time_at_req   = read64 (&d->time_at_req);
+  dd->time_at_comp  = read64 (&d->time_at_comp);
+  dd->bytes_at_req  = read64 (&d->bytes_at_req);
+  dd->bytes_at_comp = read64 (&d->bytes_at_comp);
+}
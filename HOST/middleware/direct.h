@@ -0,0 +1,81 @@
+/**
+* @file direct.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Programming of the DMA engines from userspace. BAR0 is mapped in the process
+* (NFP_MMAP_BAR0_OFFSET), so writing a descriptor and polling the end of the operation do
+* not enter the kernel. Only the initial translation of the buffer uses an IOCTL.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef _DIRECT_H_
+#define _DIRECT_H_
+
+#include <stdint.h>
+#include "../include/ioctl_commands.h"
+
+
+#define DIRECT_TIMEOUT_NS 10000000000UL /**< Same limit than the driver for an operation (10s) */
+
+
+/**
+* @brief Map BAR0 and obtain the bus address of every page of the buffer. The buffer must
+* have already been registered (getFreeHugePages) or mapped (getFreePages), and the engines
+* that will be used leased (leaseEngine): the driver only maps BAR0 for a file that holds one.
+*
+* @param length Size of the buffer.
+* @param page_size Size of the pages of the buffer. Each page is mapped independently (the
+* whole buffer for kernel pages, which are contiguous).
+*
+* @return 0 if ok. A negative value if BAR0 or some page could not be mapped.
+*/
+int directOpen (uint64_t length, uint64_t page_size);
+
+/**
+* @brief Unmap BAR0. The pages stay mapped for the device until the buffer is unregistered.
+*/
+void directClose (void);
+
+/**
+* @brief Equivalent to writeDescriptor, without system calls. The registers are written in the
+* same order than the driver does and, if enable is set, the engine is started and its enable
+* bit polled until the end of the operation.
+*
+* @param dd The descriptor. The memory between address and address+buffer_size must be inside a
+* page of the buffer.
+*
+* @return 0 if ok. A negative value if the descriptor is out of the buffer, the engine is still
+* running (nothing is written) or the operation did not finish in DIRECT_TIMEOUT_NS.
+*/
+int directWriteDescriptor (struct dma_descriptor_sw *dd);
+
+/**
+* @brief Equivalent to readDescriptor, without system calls.
+*
+* @param dd The index and engine fields select the descriptor. The [STATUS] fields are written.
+*/
+void directReadDescriptor (struct dma_descriptor_sw *dd);
+
+#endif
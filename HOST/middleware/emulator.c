@@ -0,0 +1,798 @@
+/**
+* @file emulator.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Software model of the DMA core. The register file follows include/dma_core.h
+* and the behaviour of the engines follows dma_engine_manager.v and dma_rq_logic.v.
+* The IOCTL handlers mirror nfp_ioctl (HOST/driver/nfpioctl.c) step by step.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#include "emulator.h"
+#include "address_gen.h"
+#include "../include/ioctl_commands.h"
+#include "../include/dma_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+
+/**
+* @brief State of the model. The fields that are not part of BAR0 reproduce the
+* global state that the driver keeps (ldescriptor, the registered buffer, ...).
+*/
+struct emulator {
+  uint8_t          *bar0;       /**< BAR0 of the device. The DMA core starts at DMA_OFFSET*8 */
+  struct dma_core  *dma;        /**< Pointer to the DMA registers inside bar0 */
+  uint16_t          active_descriptor[MAX_NUM_DMA_ENGINES]; /**< Next descriptor processed by each engine */
+  uint32_t          ldescriptor[MAX_NUM_DMA_ENGINES]; /**< Last descriptor written (same meaning than in nfpdma.c) */
+  uint32_t          async_head[MAX_NUM_DMA_ENGINES];  /**< Oldest submitted descriptor that has not been reaped (same meaning than in nfpdma.c) */
+  struct dma_buffer buffer[NFP_MAX_BUFFERS]; /**< Registered huge page buffers by handle. length == 0 if none */
+  uint8_t          *kpages;     /**< Region returned by emu_mmap (stand-in of mmap_info.page_list) */
+  uint64_t          kpages_length;
+  uint64_t          out_of_bounds; /**< TLPs that pointed outside of the host buffers */
+  uint64_t          cycle;      /**< Clock of the core since its reset, advanced by the modelled time of each operation */
+  uint64_t          c2s_units;  /**< 128-bit units of the stream of the application (app.v) already written to the host */
+  uint64_t          tlp_log_requests[MAX_NUM_DMA_ENGINES]; /**< Memory read requests of each engine since its TLP log was enabled */
+  struct address_gen wr_gen;    /**< Address generators of dma_rq_logic (memory writes and memory reads) */
+  struct address_gen rd_gen;
+  uint8_t           max_payload;      /**< MPS and MRRS of the link, encoded as in dma_common_block. The core of the */
+  uint8_t           max_read_request; /**< model sizes its TLPs with them, so NFPIOC_PCIE_CONFIG changes its traffic */
+};
+
+static struct emulator emu; /**< The one and only emulated device */
+
+/** The driver only serialises the operations over the same engine. The model completes the
+ * operations inside emu_ioctl, so it serialises all of them (the engines do not contend). */
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint64_t emu_sink; /**< Destination of the data "read" by the device */
+
+
+static inline uint64_t ns_to_cycles (uint64_t ns)
+{
+  return (ns + EMU_CLOCK_PERIOD_NS - 1) / EMU_CLOCK_PERIOD_NS;
+}
+
+static inline uint64_t wire_to_cycles (uint64_t bytes)
+{
+  return ns_to_cycles ((bytes * 1000 + EMU_LINK_BYTES_PER_US - 1) / EMU_LINK_BYTES_PER_US);
+}
+
+/* Values that the DMA core reports after a (user) reset. */
+static void emu_reset (void)
+{
+  memset (emu.dma, 0, sizeof (struct dma_core));
+  memset (emu.active_descriptor, 0, sizeof (emu.active_descriptor));
+  emu.dma->dma_common_block.max_payload      = emu.max_payload;
+  emu.dma->dma_common_block.max_read_request = emu.max_read_request;
+  emu.cycle = 0;
+  address_gen_reset (&emu.wr_gen);
+  address_gen_reset (&emu.rd_gen);
+}
+
+/* Check that a TLP falls inside one of the buffers that the host has exposed to the device. */
+static int emu_in_bounds (uint64_t address, uint64_t length)
+{
+  uint64_t start;
+  int i;
+
+  for (i = 0; i < NFP_MAX_BUFFERS; i++) {
+    start = (uint64_t)emu.buffer[i].data;
+    if (emu.buffer[i].length && address >= start && address + length <= start + emu.buffer[i].length) {
+      return 1;
+    }
+  }
+  if (emu.kpages) {
+    start = (uint64_t)emu.kpages;
+    if (address >= start && address + length <= start + emu.kpages_length) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Move the payload of one TLP between the host memory and the device. The data written comes
+   from the C2S stream of app.v: 256-bit words with a 32-bit counter in the less significant bits
+   and zeros in the rest, split by dma_rq_logic in two 128-bit units. S2C data is discarded. */
+static void emu_touch (uint64_t address, uint64_t length, int is_write)
+{
+  uint64_t i;
+  uint64_t acum = 0;
+  uint32_t unit[4] = {0, 0, 0, 0};
+
+  if (!emu_in_bounds (address, length)) {
+    emu.out_of_bounds++;
+    return;
+  }
+
+  if (is_write) {
+    for (i = 0; i < length; i += sizeof (unit), emu.c2s_units++) {
+      unit[0] = emu.c2s_units & 1 ? 0 : (uint32_t)(emu.c2s_units >> 1);
+      memcpy ((void *)(address + i), unit, length - i < sizeof (unit) ? length - i : sizeof (unit));
+    }
+  } else {
+    for (i = 0; i < length; i += 64) {
+      acum += ((volatile uint8_t *)address)[i];
+    }
+    emu_sink += acum;
+  }
+}
+
+/* Record the latency of a memory read request in the log of the engine (struct dma_tlp_log) */
+static void emu_log_tlp (int e, uint64_t cycles)
+{
+  struct dma_tlp_log *log = &emu.dma->dma_engine[e].tlp_log;
+
+  if (log->enable && (emu.tlp_log_requests[e]++ & ((1ULL << log->sample_shift) - 1)) == 0) {
+    log->latency[log->head % DMA_TLP_LOG_ENTRIES] = cycles < UINT32_MAX ? cycles : UINT32_MAX;
+    log->head++;
+  }
+}
+
+/**
+* @brief Execute number_of_tlps TLPs in one direction. The addresses come from the generators of
+* dma_rq_logic (address_gen.c), clocked with the cycle in which the model sends each TLP.
+*
+* @return The number of cycles that the transfer would take in a real link.
+*/
+static uint64_t emu_transfer (struct dma_engine *eng, struct dma_descriptor *d, int is_write,
+                              uint64_t *bytes, uint64_t *req_cycles)
+{
+  struct dma_common_block *cb = &emu.dma->dma_common_block;
+  struct address_gen *g = is_write ? &emu.wr_gen : &emu.rd_gen;
+  struct address_gen_params p;
+  uint64_t mps     = 128ULL << cb->max_payload;
+  uint64_t window  = eng->total_bytes ? (eng->total_bytes < EMU_MAX_TAGS ? eng->total_bytes : EMU_MAX_TAGS) : 1;
+  uint64_t start   = emu.cycle + 1;
+  uint64_t tlp = 0, address, len, wire = 0, sent;
+  uint64_t link_free = start, arrival;
+  uint64_t tags[EMU_MAX_TAGS]; // Cycle in which the completions of the request that holds each tag end
+
+  *bytes = 0;
+  *req_cycles = 0;
+  if (d->size == 0 || eng->number_of_tlps == 0) { // Nothing is sent, as in the FPGA
+    return 0;
+  }
+
+  // The memory reads of an engine that also writes use TLPs of MPS bytes, as dma_rq_logic does
+  p.base           = d->address;
+  p.size           = d->size;
+  p.host_size      = eng->host_buffer_size ? eng->host_buffer_size : 1;
+  p.offset         = eng->address_offset;
+  p.number_of_tlps = eng->number_of_tlps;
+  p.max_tlp        = is_write || eng->is_c2s ? mps : 128ULL << cb->max_read_request;
+  p.mode           = eng->address_mode;
+  address_gen_start (g, &p, start);
+
+  // A write leaves when the previous ones are on the wire. A read request also waits for a free
+  // tag once "window" of them are outstanding: the tag is released when the last completion of
+  // its request leaves the link. The completions arrive after the round trip time, or once the
+  // completions of the previous requests have left the link
+  for (sent = start; address_gen_tlp (g, sent, &address, &len); tlp++) {
+    emu_touch (address, len, is_write);
+    if (!is_write) {
+      arrival   = sent + ns_to_cycles (EMU_READ_LATENCY_NS);
+      link_free = (arrival > link_free ? arrival : link_free) + wire_to_cycles (len + (len + mps - 1) / mps * EMU_TLP_OVERHEAD_BYTES);
+      tags[tlp % window] = link_free;
+      emu_log_tlp (eng - emu.dma->dma_engine, link_free - sent);
+    }
+
+    *bytes += len;
+    wire   += (is_write ? len : 0) + EMU_TLP_OVERHEAD_BYTES;
+    sent    = start + wire_to_cycles (wire);
+    if (!is_write && tlp + 1 >= window && tags[(tlp + 1) % window] > sent) {
+      sent = tags[(tlp + 1) % window];
+    }
+  }
+
+  *req_cycles = wire_to_cycles (wire);
+  if (is_write) {
+    emu.cycle += *req_cycles;
+    return *req_cycles;
+  }
+
+  // Memory reads: the transfer ends with the last completion
+  emu.cycle = link_free;
+  return link_free - start + 1;
+}
+
+/*
+ * Process one descriptor and fill its [STATUS] fields. dma_engine_manager.v stores the
+ * counters once active_index_descriptor_r has already advanced, so the status of
+ * descriptor i is found in the slot i+1 (benchmark.c reads it from there).
+ */
+static void emu_descriptor_run (struct dma_engine *eng, uint16_t index)
+{
+  struct dma_descriptor *d = &eng->dma_descriptor[index];
+  struct dma_descriptor *status = &eng->dma_descriptor[(index + 1) % MAX_NUM_DMA_DESCRIPTORS];
+  uint64_t wr_bytes = 0, rd_bytes = 0, wr_req = 0, rd_req = 0;
+  uint64_t wr_cycles = 0, rd_cycles = 0;
+
+  if (eng->is_c2s) {
+    wr_cycles = emu_transfer (eng, d, 1, &wr_bytes, &wr_req);
+  }
+  if (eng->is_s2c) {
+    rd_cycles = emu_transfer (eng, d, 0, &rd_bytes, &rd_req);
+  }
+
+  status->latency       = wr_cycles + rd_cycles;
+  status->time_at_req   = wr_req + rd_req;
+  status->time_at_comp  = rd_cycles;
+  status->bytes_at_req  = wr_bytes / 4;
+  status->bytes_at_comp = rd_bytes / 4;
+  eng->total_time += status->latency;
+}
+
+/* The engine processes the descriptors from the active one until complete_until_descriptor. */
+static void emu_engine_run (int e)
+{
+  struct dma_engine *eng = &emu.dma->dma_engine[e];
+  uint16_t index = emu.active_descriptor[e];
+  uint8_t last;
+
+  emu.dma->dma_common_block.engine_finished &= ~(1 << e);
+  do {
+    emu_descriptor_run (eng, index);
+    last  = index == eng->complete_until_descriptor % MAX_NUM_DMA_DESCRIPTORS;
+    index = (index + 1) % MAX_NUM_DMA_DESCRIPTORS;
+  } while (!last);
+
+  emu.active_descriptor[e] = index;
+  eng->enable = 0;
+  emu.dma->dma_common_block.engine_finished |= 1 << e;
+}
+
+/* Side effects of a write in BAR0. The register has already been updated. */
+static void emu_register_written (uint64_t offset)
+{
+  uint64_t dma_start = DMA_OFFSET * 8;
+  uint64_t common    = dma_start + (uint64_t)((uint8_t *)&emu.dma->dma_common_block - (uint8_t *)emu.dma);
+  int e;
+
+  if (offset == common) {
+    if (emu.dma->dma_common_block.user_reset) {
+      emu_reset ();
+    }
+    return;
+  }
+
+  for (e = 0; e < MAX_NUM_DMA_ENGINES; e++) {
+    if (offset == dma_start + (uint64_t)e * sizeof (struct dma_engine) + offsetof (struct dma_engine, tlp_log)) {
+      if (emu.dma->dma_engine[e].tlp_log.enable) {
+        emu.dma->dma_engine[e].tlp_log.head = 0;
+        emu.tlp_log_requests[e] = 0;
+      }
+    }
+    if (offset == dma_start + (uint64_t)e * sizeof (struct dma_engine)) {
+      if (emu.dma->dma_engine[e].reset) {
+        emu.dma->dma_engine[e].total_time = 0;
+        emu.dma->dma_engine[e].reset = 0;
+      }
+      if (emu.dma->dma_engine[e].enable) {
+        emu_engine_run (e);
+      }
+    }
+  }
+}
+
+/* Counterpart of descriptorExtent (nfpioctl.c): the random generator moves through the whole buffer_size window */
+static uint64_t emu_descriptor_extent (struct dma_descriptor_sw *dd)
+{
+  if (dd->address_mode >= 2 && dd->buffer_size > dd->length) {
+    return dd->buffer_size;
+  }
+  return dd->length;
+}
+
+/* Translate the offset of a descriptor to an address of the model. Each buffer of the model is a
+   single contiguous region, so a descriptor never has to be split (see translateDescriptorAddress). */
+static int emu_descriptor_address (struct dma_descriptor_sw *dd)
+{
+  struct dma_buffer *b = dd->buffer < NFP_MAX_BUFFERS ? &emu.buffer[dd->buffer] : NULL;
+
+  if (dd->buffer == 0 && b->length == 0) { // Mmap buffer
+    dd->address = (uint64_t)emu.kpages + dd->address;
+  } else if (b != NULL && b->length && dd->address + emu_descriptor_extent (dd) <= b->length) {
+    dd->address = (uint64_t)b->data + dd->address;
+  } else {
+    fprintf (stderr, "nfp-emu: Error while computing the physical address of the memory\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* Counterpart of writeDMADescriptor (nfpdma.c) */
+static void emu_write_descriptor (struct dma_descriptor_sw *dd)
+{
+  struct dma_engine *eng = &emu.dma->dma_engine[dd->engine];
+  uint32_t *ldescriptor = &emu.ldescriptor[dd->engine];
+  uint32_t control;
+
+  eng->host_buffer_size = dd->buffer_size;
+  eng->number_of_tlps   = dd->number_of_tlps;
+  eng->address_offset   = dd->address_offset;
+  eng->address_inc      = dd->address_inc;
+
+  eng->dma_descriptor[dd->index].address = dd->address;
+  eng->dma_descriptor[dd->index].size    = dd->length;
+
+  control = dd->is_c2s_op << 2;
+  control += dd->is_s2c_op ? (1 << 3) : 0;
+  control += (dd->address_mode << 4);
+  memcpy (eng, &control, 4);
+
+  *ldescriptor = *ldescriptor % MAX_NUM_DMA_DESCRIPTORS;
+  eng->complete_until_descriptor = *ldescriptor;
+  *ldescriptor = (*ldescriptor + 1) % MAX_NUM_DMA_DESCRIPTORS;
+
+  if (!dd->enable) {
+    return;
+  }
+  control |= 1;
+  memcpy (eng, &control, 4);
+  emu_register_written (DMA_OFFSET * 8 + dd->engine * sizeof (struct dma_engine));
+  emu.async_head[dd->engine] = *ldescriptor;
+}
+
+/* Counterpart of readDMADescriptor (nfpdma.c) */
+static int emu_read_descriptor (struct dma_descriptor_sw *dd)
+{
+  struct dma_descriptor *d = &emu.dma->dma_engine[dd->engine].dma_descriptor[dd->index % MAX_NUM_DMA_DESCRIPTORS];
+
+  if (dd->index >= MAX_NUM_DMA_DESCRIPTORS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  dd->latency       = d->latency;
+  dd->time_at_req   = d->time_at_req;
+  dd->time_at_comp  = d->time_at_comp;
+  dd->bytes_at_req  = d->bytes_at_req;
+  dd->bytes_at_comp = d->bytes_at_comp;
+  return 0;
+}
+
+
+int emu_open (void)
+{
+  memset (&emu, 0, sizeof (struct emulator));
+  emu.bar0 = calloc (1, DMA_CORE_BAR0_SIZE);
+  if (emu.bar0 == NULL) {
+    return -1;
+  }
+  emu.dma = (struct dma_core *) (emu.bar0 + DMA_OFFSET * 8);
+  emu.max_payload      = EMU_DEFAULT_MAX_PAYLOAD;
+  emu.max_read_request = EMU_DEFAULT_MAX_READ_REQ;
+  emu_reset ();
+  return 0;
+}
+
+void emu_close (void)
+{
+  if (emu.out_of_bounds) {
+    fprintf (stderr, "nfp-emu: %ld TLPs pointed outside of the registered buffers\n", emu.out_of_bounds);
+  }
+  free (emu.bar0);
+  memset (&emu, 0, sizeof (struct emulator));
+}
+
+/* Counterpart of the submit path of nfp_ioctl. The model completes the descriptors before returning. */
+static int emu_submit_batch (struct dma_descriptor_batch *batch)
+{
+  struct dma_descriptor_sw dd, *first = batch->descriptors;
+  uint32_t e = batch->engine;
+  uint32_t pending = 0;
+  int invalid = 0;
+
+  for (batch->processed = 0; batch->processed < batch->count; batch->processed++) {
+    pending = (emu.ldescriptor[e] + MAX_NUM_DMA_DESCRIPTORS - emu.async_head[e]) % MAX_NUM_DMA_DESCRIPTORS;
+    dd = batch->descriptors[batch->processed];
+    dd.engine = e;
+    // The previous batches have been completed: the descriptors of this one share the configuration of the first
+    if (dd.is_c2s_op != first->is_c2s_op || dd.is_s2c_op != first->is_s2c_op || dd.address_mode != first->address_mode ||
+        dd.buffer_size != first->buffer_size || dd.number_of_tlps != first->number_of_tlps ||
+        dd.address_offset != first->address_offset || dd.address_inc != first->address_inc) {
+      break;
+    }
+    if (pending == MAX_NUM_DMA_DESCRIPTORS - 1) {
+      break;
+    }
+    if (emu_descriptor_address (&dd)) {
+      invalid = 1;
+      break;
+    }
+    dd.index  = emu.ldescriptor[e];
+    dd.enable = 0;
+    emu_write_descriptor (&dd);
+    batch->descriptors[batch->processed].index  = dd.index;
+    batch->descriptors[batch->processed].engine = e;
+  }
+  if (batch->processed == 0 && batch->count) {
+    errno = invalid ? EINVAL : ENOSPC;
+    return -1;
+  }
+  if (batch->processed) { // Like startDMAEngine, the engine only runs the descriptors of this batch
+    emu.dma->dma_engine[e].enable = 1;
+    emu_register_written (DMA_OFFSET * 8 + e * sizeof (struct dma_engine));
+  }
+  return 0;
+}
+
+/* Counterpart of the reap path of nfp_ioctl */
+static int emu_reap_batch (struct dma_descriptor_batch *batch)
+{
+  struct dma_descriptor_sw *dd;
+  uint32_t e = batch->engine;
+
+  for (batch->processed = 0; batch->processed < batch->count && emu.async_head[e] != emu.active_descriptor[e]; batch->processed++) {
+    dd = &batch->descriptors[batch->processed];
+    memset (dd, 0, sizeof (struct dma_descriptor_sw));
+    dd->engine = e;
+    dd->index  = (emu.async_head[e] + 1) % MAX_NUM_DMA_DESCRIPTORS; // The status is stored in the next position
+    emu_read_descriptor (dd);
+    dd->index = emu.async_head[e];
+    emu.async_head[e] = (emu.async_head[e] + 1) % MAX_NUM_DMA_DESCRIPTORS;
+  }
+  return 0;
+}
+
+/* Counterpart of the batch path of nfp_ioctl. The descriptors of the user are not modified. */
+static int emu_descriptor_batch (struct dma_descriptor_batch *batch, int write)
+{
+  struct dma_descriptor_sw dd;
+
+  if (batch->count > MAX_DESCRIPTORS_PER_BATCH) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (batch->processed = 0; batch->processed < batch->count; batch->processed++) {
+    if (!write) {
+      batch->descriptors[batch->processed].engine = batch->engine;
+      if (emu_read_descriptor (&batch->descriptors[batch->processed])) {
+        return -1;
+      }
+      continue;
+    }
+    dd = batch->descriptors[batch->processed];
+    dd.engine = batch->engine;
+    if (dd.index >= MAX_NUM_DMA_DESCRIPTORS || emu_descriptor_address (&dd)) {
+      errno = EINVAL;
+      return -1;
+    }
+    emu_write_descriptor (&dd);
+  }
+  return 0;
+}
+
+/* Counterpart of readTlpLog (nfpioctl.c) and dma_read_tlp_log (nfpdma.c) */
+static void emu_read_tlp_log (struct dma_tlp_log_read *lr)
+{
+  struct dma_tlp_log *log = &emu.dma->dma_engine[lr->engine].tlp_log;
+  uint64_t first;
+  uint32_t n, copied = 0;
+
+  lr->lost = 0;
+  if (log->head - lr->tail > DMA_TLP_LOG_ENTRIES) {
+    lr->lost = log->head - lr->tail - DMA_TLP_LOG_ENTRIES;
+    lr->tail = log->head - DMA_TLP_LOG_ENTRIES;
+  }
+  if (lr->count > log->head - lr->tail) {
+    lr->count = log->head - lr->tail;
+  }
+  while (copied < lr->count) {
+    first = (lr->tail + copied) % DMA_TLP_LOG_ENTRIES;
+    n     = lr->count - copied < DMA_TLP_LOG_ENTRIES - first ? lr->count - copied : DMA_TLP_LOG_ENTRIES - first;
+    memcpy (lr->latency + copied, &log->latency[first], n * sizeof (uint32_t));
+    copied += n;
+  }
+  lr->tail += copied;
+}
+
+/* Engine of the descriptor, window size and TLP log commands (MAX_NUM_DMA_ENGINES if out of range). -1 for the rest of them */
+static int emu_engine (unsigned long request, void *arg)
+{
+  switch (request) {
+  case NFPIOC_WINDOW_SIZE:
+    return 0;
+  case NFPIOC_ENGINE_WINDOW_SIZE:
+    return ((struct dma_window *)arg)->engine < MAX_NUM_DMA_ENGINES ? ((struct dma_window *)arg)->engine : MAX_NUM_DMA_ENGINES;
+  case NFPIOC_WRITE_DMA_DESCRIPTOR:
+  case NFPIOC_READ_DMA_DESCRIPTOR:
+    return ((struct dma_descriptor_sw *)arg)->engine;
+  case NFPIOC_WRITE_DMA_DESCRIPTORS:
+  case NFPIOC_READ_DMA_DESCRIPTORS:
+  case NFPIOC_SUBMIT_DMA_DESCRIPTORS:
+  case NFPIOC_REAP_DMA_DESCRIPTORS:
+    return ((struct dma_descriptor_batch *)arg)->engine < MAX_NUM_DMA_ENGINES ? ((struct dma_descriptor_batch *)arg)->engine : MAX_NUM_DMA_ENGINES;
+  case NFPIOC_TLP_LOG_CONTROL:
+    return ((struct dma_tlp_log_control *)arg)->engine < MAX_NUM_DMA_ENGINES ? ((struct dma_tlp_log_control *)arg)->engine : MAX_NUM_DMA_ENGINES;
+  case NFPIOC_READ_TLP_LOG:
+    return ((struct dma_tlp_log_read *)arg)->engine < MAX_NUM_DMA_ENGINES ? ((struct dma_tlp_log_read *)arg)->engine : MAX_NUM_DMA_ENGINES;
+  case NFPIOC_LEASE_ENGINE:
+  case NFPIOC_RELEASE_ENGINE:
+    return *(uint32_t *)arg < MAX_NUM_DMA_ENGINES ? *(uint32_t *)arg : MAX_NUM_DMA_ENGINES;
+  }
+  return -1;
+}
+
+/* The buffer of a handle cannot be replaced nor unregistered while the descriptors submitted to an
+   engine have not been reaped (see dma_context_busy). The engines of the model are never running
+   outside of an IOCTL */
+static int emu_buffer_busy (uint32_t handle)
+{
+  int e;
+
+  if (emu.buffer[handle].length == 0) {
+    return 0;
+  }
+  for (e = 0; e < MAX_NUM_DMA_ENGINES && emu.ldescriptor[e] == emu.async_head[e]; e++);
+  if (e < MAX_NUM_DMA_ENGINES) {
+    errno = EBUSY;
+    return 1;
+  }
+  return 0;
+}
+
+/* Register a buffer in a handle */
+static void emu_register_buffer (uint32_t handle, struct dma_buffer *db)
+{
+  uint64_t offset;
+
+  emu.buffer[handle] = *db;
+  // Fault in every page for writing, as the driver does when it pins them. Otherwise the pages
+  // that were never written share the zero page and their lines alias in the caches
+  for (offset = 0; db->data != NULL && offset < db->length; offset += KERNEL_PAGE_SIZE) {
+    ((volatile uint8_t *)db->data)[offset] = ((volatile uint8_t *)db->data)[offset];
+  }
+}
+
+/* Encoding of dma_common_block of a size in bytes (0 keeps the current one). -1 if it is not a power of 2 from 128 to 4096 */
+static int emu_size_code (uint32_t bytes, int current)
+{
+  int code;
+
+  if (bytes == 0) {
+    return current;
+  }
+  for (code = 0; code <= 5 && (128U << code) != bytes; code++);
+  return code <= 5 ? code : -1;
+}
+
+/* NFPIOC_PCIE_CONFIG. The model completes every operation inside the IOCTL, so no engine is running */
+static int emu_pcie_config (struct pcie_config *pc)
+{
+  int mps = emu_size_code (pc->max_payload, emu.max_payload);
+  int mrrs = emu_size_code (pc->max_read_request, emu.max_read_request);
+
+  if (mps < 0 || mrrs < 0 || mps > EMU_MAX_PAYLOAD_LIMIT) {
+    errno = EINVAL;
+    return -1;
+  }
+  emu.max_payload      = mps;
+  emu.max_read_request = mrrs;
+  emu.dma->dma_common_block.max_payload      = mps;
+  emu.dma->dma_common_block.max_read_request = mrrs;
+  pc->max_payload       = 128U << mps;
+  pc->max_read_request  = 128U << mrrs;
+  pc->max_payload_limit = 128U << EMU_MAX_PAYLOAD_LIMIT;
+  return 0;
+}
+
+/* Process a command once emu_lock is held */
+static int emu_ioctl_locked (unsigned long request, void *arg)
+{
+  struct reg32 *r = (struct reg32 *)arg;
+  struct dma_descriptor_sw *dd = (struct dma_descriptor_sw *)arg;
+  struct dma_buffer *db = (struct dma_buffer *)arg;
+  struct dma_descriptor_sw dd_copy;
+  struct dma_tlp_log_control *lc = (struct dma_tlp_log_control *)arg;
+  uint32_t handle;
+
+  if (emu.bar0 == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+
+  switch (request) {
+  case NFPIOC_WINDOW_SIZE:
+    emu.dma->dma_engine[0].total_bytes = *(uint64_t *)arg;
+    break;
+
+  case NFPIOC_ENGINE_WINDOW_SIZE:
+    emu.dma->dma_engine[((struct dma_window *)arg)->engine].total_bytes = ((struct dma_window *)arg)->size;
+    break;
+
+  case NFPIOC_WRITE_32:
+    if (r->bar == 0 && r->offset + 4 <= DMA_CORE_BAR0_SIZE) {
+      memcpy (emu.bar0 + r->offset, &r->data, 4);
+      emu_register_written (r->offset);
+    }
+    break;
+
+  case NFPIOC_READ_32:
+    r->data = 0;
+    if (r->bar == 0 && r->offset + 4 <= DMA_CORE_BAR0_SIZE) {
+      memcpy (&r->data, emu.bar0 + r->offset, 4);
+    }
+    break;
+
+  case NFPIOC_WRITE_DMA_DESCRIPTOR:
+    dd_copy = *dd; // The driver works over a copy of the structure
+    if (dd_copy.index >= MAX_NUM_DMA_DESCRIPTORS || emu_descriptor_address (&dd_copy)) {
+      errno = EINVAL;
+      return -1;
+    }
+    emu_write_descriptor (&dd_copy);
+    dd->slots = 1;
+    break;
+
+  case NFPIOC_READ_DMA_DESCRIPTOR:
+    return emu_read_descriptor (dd);
+
+  case NFPIOC_WRITE_DMA_DESCRIPTORS:
+  case NFPIOC_READ_DMA_DESCRIPTORS:
+    return emu_descriptor_batch ((struct dma_descriptor_batch *)arg, request == NFPIOC_WRITE_DMA_DESCRIPTORS);
+
+  case NFPIOC_SUBMIT_DMA_DESCRIPTORS:
+    return emu_submit_batch ((struct dma_descriptor_batch *)arg);
+
+  case NFPIOC_REAP_DMA_DESCRIPTORS:
+    return emu_reap_batch ((struct dma_descriptor_batch *)arg);
+
+  case NFPIOC_COMPLETION_MODE:
+    // The model completes every operation inside the IOCTL, so every mode behaves the same
+    if (*(uint32_t *)arg > NFP_COMPLETION_HYBRID) {
+      errno = EINVAL;
+      return -1;
+    }
+    break;
+
+  case NFPIOC_MAP_BUFFER:
+    // The model uses the addresses of the process as bus addresses
+    memset (&dd_copy, 0, sizeof (struct dma_descriptor_sw));
+    dd_copy.address = ((struct dma_buffer_map *)arg)->offset;
+    dd_copy.length  = ((struct dma_buffer_map *)arg)->length;
+    dd_copy.buffer  = ((struct dma_buffer_map *)arg)->buffer < NFP_MAX_BUFFERS ? ((struct dma_buffer_map *)arg)->buffer : NFP_MAX_BUFFERS;
+    if (((struct dma_buffer_map *)arg)->length == 0 || emu_descriptor_address (&dd_copy)) {
+      errno = EINVAL;
+      return -1;
+    }
+    ((struct dma_buffer_map *)arg)->bus_address = dd_copy.address;
+    break;
+
+  case NFPIOC_TLP_LOG_CONTROL:
+    emu.dma->dma_engine[lc->engine].tlp_log.enable       = lc->enable ? 1 : 0;
+    emu.dma->dma_engine[lc->engine].tlp_log.sample_shift = lc->sample_shift;
+    emu_register_written (DMA_OFFSET * 8 + (uint64_t)lc->engine * sizeof (struct dma_engine) + offsetof (struct dma_engine, tlp_log));
+    break;
+
+  case NFPIOC_READ_TLP_LOG:
+    emu_read_tlp_log ((struct dma_tlp_log_read *)arg);
+    break;
+
+  case NFPIOC_REGISTER_BUFFER:
+    if (emu_buffer_busy (0)) {
+      return -1;
+    }
+    emu_register_buffer (0, db);
+    break;
+
+  case NFPIOC_UNREGISTER_BUFFER:
+    if (emu_buffer_busy (0)) {
+      return -1;
+    }
+    memset (&emu.buffer[0], 0, sizeof (struct dma_buffer));
+    break;
+
+  case NFPIOC_REGISTER_BUFFER_HANDLE:
+    for (handle = 1; handle < NFP_MAX_BUFFERS && emu.buffer[handle].length; handle++);
+    if (handle == NFP_MAX_BUFFERS) {
+      errno = ENOSPC;
+      return -1;
+    }
+    emu_register_buffer (handle, db);
+    db->handle = handle;
+    break;
+
+  case NFPIOC_UNREGISTER_BUFFER_HANDLE:
+    if (*(uint32_t *)arg >= NFP_MAX_BUFFERS) {
+      errno = EINVAL;
+      return -1;
+    }
+    if (emu_buffer_busy (*(uint32_t *)arg)) {
+      return -1;
+    }
+    memset (&emu.buffer[*(uint32_t *)arg], 0, sizeof (struct dma_buffer));
+    break;
+
+  case NFPIOC_LEASE_ENGINE:   // The emulator has a single context: the engines are always free
+  case NFPIOC_RELEASE_ENGINE:
+    break;
+
+  case NFPIOC_PCIE_CONFIG:
+    return emu_pcie_config ((struct pcie_config *)arg);
+
+  default:
+    errno = ENOTTY;
+    return -1;
+  }
+
+  return 0;
+}
+
+int emu_ioctl (unsigned long request, void *arg)
+{
+  int ret;
+
+  if (emu_engine (request, arg) >= MAX_NUM_DMA_ENGINES) {
+    errno = EINVAL;
+    return -1;
+  }
+  pthread_mutex_lock (&emu_lock);
+  ret = emu_ioctl_locked (request, arg);
+  pthread_mutex_unlock (&emu_lock);
+  return ret;
+}
+
+void *emu_bar0 (void)
+{
+  return emu.bar0;
+}
+
+void emu_bar0_written (uint64_t offset)
+{
+  pthread_mutex_lock (&emu_lock);
+  emu_register_written (offset);
+  pthread_mutex_unlock (&emu_lock);
+}
+
+void *emu_mmap (size_t length)
+{
+  void *address;
+
+  if (emu.kpages) { // The driver also offers a single region of kernel pages
+    return MAP_FAILED;
+  }
+  address = mmap (NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (address != MAP_FAILED) {
+    emu.kpages = address;
+    emu.kpages_length = length;
+  }
+  return address;
+}
+
+void emu_munmap (void *address, size_t length)
+{
+  if (address == emu.kpages) {
+    emu.kpages = NULL;
+    emu.kpages_length = 0;
+  }
+  munmap (address, length);
+}
@@ -0,0 +1,107 @@
+/**
+* @file emulator.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Software model of the DMA core. It emulates the register file of BAR0
+* (struct dma_core) and answers the same IOCTL commands than the nfp_driver, so the
+* user programs can run without a board.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef _EMULATOR_H_
+#define _EMULATOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define EMU_CLOCK_PERIOD_NS      4     /**< Period of the clock of the DMA core. Every time counter is expressed in cycles */
+#define EMU_LINK_BYTES_PER_US    7877  /**< Usable bandwidth of a PCIe Gen3 x8 link (8 GT/s * 8 lanes * 128/130) */
+#define EMU_TLP_OVERHEAD_BYTES   24    /**< Framing, sequence number, 4DW header and LCRC of each TLP */
+#define EMU_READ_LATENCY_NS      500   /**< Round trip time of a memory read request in the host */
+#define EMU_MAX_TAGS             32    /**< Tags of the read requests of dma_rq_logic (the window is limited to them) */
+#define EMU_DEFAULT_MAX_PAYLOAD  1     /**< 256 bytes, encoded as in dma_common_block */
+#define EMU_DEFAULT_MAX_READ_REQ 2     /**< 512 bytes, encoded as in dma_common_block */
+#define EMU_MAX_PAYLOAD_LIMIT    2     /**< 512 bytes: the largest MPS of the device and the root port of the model */
+
+
+/**
+* @brief Create the register file of the model and reset it.
+*
+* @return 0 if the model could be created.
+*/
+int emu_open (void);
+
+/**
+* @brief Destroy the model and every resource associated to it.
+*/
+void emu_close (void);
+
+/**
+* @brief Equivalent to ioctl(fd, request, arg) over /dev/nfp.
+*
+* @param request One of the NFPIOC_* commands in include/ioctl_commands.h
+* @param arg The argument of the command.
+*
+* @return 0 if ok. -1 and errno set to ENOTTY for an unknown command or to EINVAL for an engine
+* that does not exist.
+*/
+int emu_ioctl (unsigned long request, void *arg);
+
+/**
+* @brief Equivalent to mmap(NULL, DMA_CORE_BAR0_SIZE, ..., fd, NFP_MMAP_BAR0_OFFSET) over /dev/nfp:
+* the register file of the model. The stores in it must be notified with emu_bar0_written.
+*
+* @return The address of BAR0. NULL if the model is not open.
+*/
+void *emu_bar0 (void);
+
+/**
+* @brief Apply the side effects of a store in the BAR0 returned by emu_bar0 (for instance,
+* start an engine).
+*
+* @param offset Offset of the register in BAR0.
+*/
+void emu_bar0_written (uint64_t offset);
+
+/**
+* @brief Equivalent to mmap(NULL, length, ..., fd, 0) over /dev/nfp. It provides the
+* buffer of kernel pages used when no huge page buffer has been registered.
+*
+* @param length Size in bytes of the region.
+*
+* @return The address of the region. MAP_FAILED in case of error.
+*/
+void *emu_mmap (size_t length);
+
+/**
+* @brief Release a region returned by emu_mmap.
+*
+* @param address The address returned by emu_mmap.
+* @param length The size that was requested.
+*/
+void emu_munmap (void *address, size_t length);
+
+#endif
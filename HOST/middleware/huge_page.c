@@ -31,7 +31,9 @@
 #include "huge_page.h"
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#include <linux/mempolicy.h>
 
 
 
@@ -44,11 +46,103 @@
 #endif
 
 static uint64_t sz = 0;
+static int anonymous = 0; /**< Serve anonymous memory because there are no huge pages */
+static int numa_node = HUGEPAGE_ANY_NODE; /**< Node where the pages are allocated */
+static int backing = HUGEPAGE_DEFAULT;    /**< enum hugepage_backing */
+
+#define HUGEPAGE_2M_SIZE (2UL*1024UL*1024UL)
+#define HUGEPAGE_1G_SIZE (1024UL*1024UL*1024UL)
+
+#define NODEMASK_BITS (8 * sizeof (unsigned long)) /**< Nodes that fit in the mask of mbind */
+
+static uint64_t system_hugepage_size();
+static uint64_t system_hugepage_number();
+
+/* Bind the region to numa_node and fault it in, so the pages are taken from the node now */
+static int bind_hugepage (struct hugepage *hp)
+{
+  unsigned long mask = 1UL << numa_node;
+  uint64_t i, step = hugepage_size();
+
+  if (numa_node == HUGEPAGE_ANY_NODE) {
+    return 0;
+  }
+  if (numa_node >= NODEMASK_BITS ||
+      syscall (SYS_mbind, hp->data, sz, MPOL_BIND, &mask, NODEMASK_BITS, MPOL_MF_STRICT) < 0) {
+    perror ("mbind");
+    return -1;
+  }
+  for (i = 0; i < sz; i += step) {
+    ((volatile uint8_t *)hp->data)[i] = 0;
+  }
+  return 0;
+}
+
+/* Anonymous memory aligned to 2MB and marked for transparent huge pages */
+static void *alloc_thp (uint64_t size)
+{
+  uint8_t *p, *aligned;
+  uint64_t extra;
+
+  p = mmap (NULL, size + HUGEPAGE_2M_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  aligned = (uint8_t *)(((uint64_t)p + HUGEPAGE_2M_SIZE - 1) & ~(HUGEPAGE_2M_SIZE - 1));
+  extra = aligned - p;
+  if (extra) {
+    munmap (p, extra);
+  }
+  munmap (aligned + size, HUGEPAGE_2M_SIZE - extra);
+
+  if (madvise (aligned, size, MADV_HUGEPAGE)) {
+    perror ("madvise");
+  }
+  return aligned;
+}
 
 int alloc_hugepage (struct hugepage *hp, uint64_t size)
 {
+  uint64_t i;
+
   sz = size;
 
+  if (backing == HUGEPAGE_THP || (!anonymous && backing != HUGEPAGE_DEFAULT)) {
+    hp->identifier = -1;
+    if (backing == HUGEPAGE_THP) {
+      hp->data = alloc_thp (sz);
+    } else {
+      hp->data = mmap (NULL, sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB | ((backing == HUGEPAGE_1G ? 30 : 21) << MAP_HUGE_SHIFT), -1, 0);
+    }
+    if (hp->data == MAP_FAILED) {
+      perror ("mmap");
+      return -1;
+    }
+    if (bind_hugepage (hp)) {
+      munmap (hp->data, sz);
+      return -1;
+    }
+    for (i = 0; i < sz; i += HUGEPAGE_2M_SIZE) { // Fault in a huge page per 2MB before the driver pins them
+      ((volatile uint8_t *)hp->data)[i] = 0;
+    }
+    return 0;
+  }
+
+  if (anonymous) {
+    hp->identifier = -1;
+    hp->data = mmap (NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (hp->data == MAP_FAILED) {
+      perror ("mmap");
+      return -1;
+    }
+    if (bind_hugepage (hp)) {
+      munmap (hp->data, sz);
+      return -1;
+    }
+    return 0;
+  }
+
   hp->identifier = open (FILE_NAME, O_CREAT | O_RDWR, 0755);
 
   if (hp->identifier < 0) {
@@ -68,6 +162,12 @@ int alloc_hugepage (struct hugepage *hp, uint64_t size)
     unlink (FILE_NAME);
     return -1;
   }
+  if (bind_hugepage (hp)) {
+    munmap (hp->data, sz);
+    close (hp->identifier);
+    unlink (FILE_NAME);
+    return -1;
+  }
 
   return 0;
 }
@@ -75,12 +175,14 @@ int alloc_hugepage (struct hugepage *hp, uint64_t size)
 void free_hugepage (struct hugepage *hp)
 {
   munmap (hp->data, sz);
-  close (hp->identifier);
-  unlink(FILE_NAME);
+  if (hp->identifier >= 0) {
+    close (hp->identifier);
+    unlink(FILE_NAME);
+  }
   memset (hp, 0, sizeof (struct hugepage));
 }
 
-uint64_t hugepage_size()
+static uint64_t system_hugepage_size()
 {
   struct stat s;
   int err = stat("/sys/kernel/mm/hugepages", &s);
@@ -96,10 +198,10 @@ uint64_t hugepage_size()
           return 0;
         }
         //printf("Size = %ld\n", 2*1024);
-        return 2048;
+        return HUGEPAGE_2M_SIZE;
       } else {
         //printf("Size = %ld\n", 1024*1024*1024);
-        return 1024 * 1024 * 1024;
+        return HUGEPAGE_1G_SIZE;
       }
     } else {
       return 0;
@@ -107,13 +209,20 @@ uint64_t hugepage_size()
   }
   return 0;
 }
-uint64_t hugepage_number()
+static uint64_t system_hugepage_number()
 {
   uint64_t npages;
   char string[200];
   FILE* f;
 
-  sprintf(string, "/sys/kernel/mm/hugepages/hugepages-%ldkB/free_hugepages", hugepage_size() / 1024);
+  if (backing == HUGEPAGE_THP) { // Any anonymous memory can be used
+    return 1;
+  }
+  if (numa_node == HUGEPAGE_ANY_NODE) {
+    sprintf(string, "/sys/kernel/mm/hugepages/hugepages-%ldkB/free_hugepages", hugepage_size() / 1024);
+  } else {
+    sprintf(string, "/sys/devices/system/node/node%d/hugepages/hugepages-%ldkB/free_hugepages", numa_node, hugepage_size() / 1024);
+  }
   f = fopen(string, "r");
   if (f == NULL) {
     return 0;
@@ -124,3 +233,63 @@ uint64_t hugepage_number()
 
   return npages;
 }
+
+uint64_t hugepage_size()
+{
+  switch (backing) {
+  case HUGEPAGE_2M:
+  case HUGEPAGE_THP:
+    return HUGEPAGE_2M_SIZE;
+  case HUGEPAGE_1G:
+    return HUGEPAGE_1G_SIZE;
+  }
+  return anonymous ? ANONYMOUS_HUGEPAGE_SIZE : system_hugepage_size();
+}
+
+uint64_t hugepage_number()
+{
+  return anonymous ? 1 : system_hugepage_number();
+}
+
+void hugepage_anonymous_fallback(int enable)
+{
+  /* The decision is taken once: the free huge pages drop after every allocation */
+  anonymous = enable && system_hugepage_number() == 0;
+}
+
+void hugepage_set_backing(int b)
+{
+  backing = b;
+}
+
+void hugepage_set_node(int node)
+{
+  numa_node = node;
+}
+
+int hugepage_get_node(void *address)
+{
+  int node;
+
+  if (syscall (SYS_get_mempolicy, &node, NULL, 0, address, MPOL_F_NODE | MPOL_F_ADDR) < 0) {
+    return HUGEPAGE_ANY_NODE;
+  }
+  return node;
+}
+
+int hugepage_numa_nodes()
+{
+  char string[200];
+  struct stat s;
+  int nodes = 0;
+
+  while (1) {
+    sprintf(string, "/sys/devices/system/node/node%d", nodes);
+    if (stat(string, &s) == -1) {
+      break;
+    }
+    nodes++;
+  }
+
+  return nodes ? nodes : 1;
+}
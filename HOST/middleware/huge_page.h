@@ -44,6 +44,18 @@
 //#define NUMBER_HUGEPAGE 8UL                 /**< Number of pages */
 #define FILE_NAME     "/dev/hugepages/test"    /**< File associated with the page (mmap will be invoked under a fd
                                             pointing to this file). */
+#define ANONYMOUS_HUGEPAGE_SIZE (1024UL*1024UL*1024UL) /**< Size reported when the anonymous fallback is active */
+#define HUGEPAGE_ANY_NODE       -1                     /**< No NUMA node has been selected */
+
+/**
+* @brief Memory that backs the buffers of alloc_hugepage.
+*/
+enum hugepage_backing {
+  HUGEPAGE_DEFAULT, /**< A file in hugetlbfs (FILE_NAME): pages of the default size of the system */
+  HUGEPAGE_2M,      /**< Anonymous huge pages of 2MB (MAP_HUGETLB) */
+  HUGEPAGE_1G,      /**< Anonymous huge pages of 1GB (MAP_HUGETLB) */
+  HUGEPAGE_THP      /**< Transparent huge pages of 2MB. The kernel may not back every page with a huge one */
+};
 
 
 /**
@@ -88,4 +100,46 @@ uint64_t hugepage_size();
  * @return The total number of free huge pages
  */
 uint64_t hugepage_number();
+
+/**
+ * @brief Let the library use anonymous memory when there are no free huge pages in the
+ * system. It is used together with the emulated device, where the memory does not need
+ * to be physically contiguous.
+ *
+ * @param enable 1 to activate the fallback, 0 to deactivate it
+ */
+void hugepage_anonymous_fallback(int enable);
+
+/**
+ * @brief Select the memory of the following alloc_hugepage calls. hugepage_size and
+ * hugepage_number report the pages of that backing.
+ *
+ * @param backing A value of enum hugepage_backing.
+ */
+void hugepage_set_backing(int backing);
+
+/**
+ * @brief Select the NUMA node of the memory of the following alloc_hugepage calls. The
+ * pages are bound (MPOL_BIND) to the node, so the allocation fails instead of landing in
+ * another node. hugepage_number reports the free huge pages of the node.
+ *
+ * @param node The node. HUGEPAGE_ANY_NODE leaves the placement to the kernel.
+ */
+void hugepage_set_node(int node);
+
+/**
+ * @brief Get the NUMA node where a page of memory resides.
+ *
+ * @param address An address of the page. It must have been accessed.
+ *
+ * @return The node. HUGEPAGE_ANY_NODE if it cannot be determined.
+ */
+int hugepage_get_node(void *address);
+
+/**
+ * @brief Get the number of NUMA nodes of the system.
+ *
+ * @return The number of nodes (1 in a system without NUMA).
+ */
+int hugepage_numa_nodes();
 #endif
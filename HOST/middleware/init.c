@@ -29,6 +29,8 @@
 */
 #include "init.h"
 #include "debug.h"
+#include "emulator.h"
+#include "huge_page.h"
 
 #include "../include/ioctl_commands.h"
 
@@ -38,11 +40,13 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <glob.h>
 #ifndef __USE_GNU
 #define __USE_GNU
 #endif
@@ -50,6 +54,7 @@
 
 
 static int fd = 0;
+static int emulated = 0; /**< The device is the software model in emulator.c */
 
 /**
 * @brief This function invoke the scheduler to use the indicate CPU.
@@ -68,12 +73,23 @@ static void set_affinity()
 int rte_eal_init (int argc, char **argv)
 {
   FILE *log;
+  const char *device = getenv (NFP_DEVICE_ENV);
   /* Set up log */
   log = fdopen (STDOUT_FILENO, "w");
   rte_openlog_stream (log);
   set_affinity();
+
+  if (device != NULL && !strcmp (device, NFP_DEVICE_EMULATOR)) {
+    if (emu_open ()) {
+      rte_exit (-1, "Error creating the software model of the device\n");
+    }
+    emulated = 1;
+    hugepage_anonymous_fallback (1); /* Do not require hugetlbfs to run the emulated device */
+    return 0;
+  }
+
   /* Alloc huge pages. */
-  fd = open ("/dev/nfp", O_RDWR);
+  fd = open (device != NULL ? device : "/dev/nfp", O_RDWR);
 
   if (fd <= 0) {
     rte_exit (-1, "Error opening /dev/nfp. Do you have privileges?\n");
@@ -90,10 +106,15 @@ void rte_free (int exit_code, const char *format, ...)
   rte_vlog (0, 0, format, ap);
   va_end (ap);
 
+  fflush (stdout); /* The log shares the descriptor of stdout */
   if (fd) {
     fclose (rte_actuallog_stream());
     close (fd);
     fd = 0;
+  } else if (emulated) {
+    fclose (rte_actuallog_stream());
+    emu_close ();
+    emulated = 0;
   }
 }
 
@@ -108,3 +129,72 @@ int getCharDeviceDescriptor (void)
 {
   return fd;
 }
+
+int isEmulatedDevice (void)
+{
+  return emulated;
+}
+
+int getDeviceNumaNode (void)
+{
+  glob_t g;
+  FILE *f;
+  int node = -1;
+
+  if (emulated || glob (NFP_PCI_NUMA_NODE_GLOB, 0, NULL, &g)) {
+    return -1;
+  }
+  f = fopen (g.gl_pathv[0], "r");
+  if (f != NULL) {
+    if (fscanf (f, "%d", &node) != 1) {
+      node = -1;
+    }
+    fclose (f);
+  }
+  globfree (&g);
+  return node;
+}
+
+int setNumaAffinity (int node)
+{
+  cpu_set_t my_set;
+  char path[128];
+  FILE *f;
+  int first, last, cpu;
+  char sep;
+
+  if (node < 0) {
+    set_affinity();
+    return 0;
+  }
+
+  /* The cpulist has the format 0-3,8-11 */
+  snprintf (path, sizeof (path), "/sys/devices/system/node/node%d/cpulist", node);
+  f = fopen (path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  CPU_ZERO (&my_set);
+  while (fscanf (f, "%d", &first) == 1) {
+    last = first;
+    sep  = fgetc (f);
+    if (sep == '-') {
+      if (fscanf (f, "%d", &last) != 1) {
+        break;
+      }
+      sep = fgetc (f);
+    }
+    for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET (cpu, &my_set);
+    }
+    if (sep != ',') {
+      break;
+    }
+  }
+  fclose (f);
+
+  if (CPU_COUNT (&my_set) == 0) {
+    return -1;
+  }
+  return sched_setaffinity (0, sizeof (cpu_set_t), &my_set);
+}
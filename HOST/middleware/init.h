@@ -37,8 +37,14 @@
 #define CPU_AFFINITY 0x00        /**< CPU mask. The user design will use the proccessor 0 (see isolcpus) */
 #define DATA_IN_FIFO_BEFORE_PROCEED 1000 /**< Number of 64 bits words in the fifo design before transmit any data */
 
+#define NFP_DEVICE_ENV      "NFP_DEVICE"  /**< Environment variable that selects the device. /dev/nfp if it is not defined */
+#define NFP_DEVICE_EMULATOR "emulator"    /**< Value of NFP_DEVICE that selects the software model of the DMA core (emulator.h) */
+#define NFP_PCI_NUMA_NODE_GLOB "/sys/bus/pci/drivers/nfp/0000:*/numa_node" /**< NUMA node of the boards bound to the nfp driver */
+
 /**
 * @brief This function will alloc the HP memory and start the HW traffic generator.
+* The device is /dev/nfp unless the environment variable NFP_DEVICE indicates another
+* char device or NFP_DEVICE_EMULATOR, that selects the software model of the DMA core.
 *
 * @param argc The number of user arguments.
 * @param argv User arguments.
@@ -78,4 +84,29 @@ void rte_exit (int exit_code, const char *format, ...);
 */
 int getCharDeviceDescriptor (void);
 
+/**
+* @brief Check if the software model of the device is in use instead of /dev/nfp.
+*
+* @return 1 if the device is emulated, 0 otherwise.
+*/
+int isEmulatedDevice (void);
+
+/**
+* @brief Get the NUMA node local to the device (the node of its PCIe root port), as
+* reported by the PCI subsystem for the devices bound to the nfp driver.
+*
+* @return The node. -1 if it is unknown (emulated device, system without NUMA).
+*/
+int getDeviceNumaNode (void);
+
+/**
+* @brief Pin the calling thread to the CPUs of a NUMA node. The threads it creates
+* afterwards inherit the affinity.
+*
+* @param node The node. -1 restores the default affinity (CPU_AFFINITY).
+*
+* @return 0 if ok, a negative value if the node does not exist or has no CPUs.
+*/
+int setNumaAffinity (int node);
+
 #endif
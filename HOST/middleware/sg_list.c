@@ -0,0 +1,111 @@
+/**
+* @file sg_list.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Scatter-gather lists of small buffers walked by the DMA engines (see sg_list.h).
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#include "sg_list.h"
+#include "transfer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+int sg_list_strided (struct sg_list *l, uint32_t handle, uint64_t buffer_size, uint64_t region_size, uint32_t count, uint64_t length)
+{
+  uint64_t align = SG_LIST_MIN_ALIGN, stride;
+  uint32_t i;
+
+  memset (l, 0, sizeof (struct sg_list));
+  while (align < length) {
+    align <<= 1;
+  }
+  if (count == 0 || length == 0 || align > region_size) {
+    return -1;
+  }
+  stride = buffer_size / count / align * align;
+  if (stride == 0) {
+    return -1;
+  }
+  l->entry = malloc (count * sizeof (struct sg_entry));
+  if (l->entry == NULL) {
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    l->entry[i].offset = i * stride;
+    l->entry[i].length = length;
+  }
+  l->count  = count;
+  l->handle = handle;
+  l->length = length;
+  l->align  = align;
+  l->stride = stride;
+  return 0;
+}
+
+uint32_t sg_list_register (struct sg_list *l, uint64_t region_size, uint32_t *regions)
+{
+  uint64_t region, last = UINT64_MAX, bus_address;
+  uint32_t i, mapped = 0;
+  int full = 0;
+
+  *regions = 0;
+  for (i = 0; i < l->count; i++) {
+    region = l->entry[i].offset / region_size;
+    if (region == last) { // A region that holds consecutive entries is mapped once
+      continue;
+    }
+    last = region;
+    (*regions)++;
+    if (!full && mapBuffer (l->handle, region * region_size, region_size, &bus_address) == 0) {
+      mapped++;
+    } else {
+      full = 1; // The mappings of the driver are exhausted: the regions are only counted
+    }
+  }
+  return mapped;
+}
+
+void sg_list_descriptors (const struct sg_list *l, uint64_t first, const struct dma_descriptor_sw *model, struct dma_descriptor_sw *d, uint32_t n)
+{
+  const struct sg_entry *e;
+  uint32_t k;
+
+  for (k = 0; k < n; k++) {
+    e = &l->entry[(first + k) % l->count];
+    d[k]         = *model;
+    d[k].buffer  = l->handle;
+    d[k].address = e->offset;
+    d[k].length  = e->length;
+  }
+}
+
+void sg_list_free (struct sg_list *l)
+{
+  free (l->entry);
+  memset (l, 0, sizeof (struct sg_list));
+}
@@ -0,0 +1,101 @@
+/**
+* @file sg_list.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+*
+* @brief Scatter-gather lists: many small buffers (packet buffers, for instance) inside a
+* registered buffer. The DMA engine walks a list with one descriptor per entry: the descriptors
+* only differ in their address, so they can be queued back to back while the engine is busy (see
+* NFPIOC_SUBMIT_DMA_DESCRIPTORS) and the ring of the engine is the list that the device follows.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef SG_LIST_H
+#define SG_LIST_H
+
+#include <stdint.h>
+#include "../include/ioctl_commands.h"
+
+#define SG_LIST_MIN_ALIGN 64 /**< Entries of sg_list_strided start at a cache line at least */
+
+/**
+* @brief A buffer of the list, relative to the registered buffer.
+*/
+struct sg_entry {
+  uint64_t offset;
+  uint64_t length;
+};
+
+/**
+* @brief A list of buffers. Every entry of a list walked by one engine must have the same length:
+* the configuration of the engine (number of TLPs, size) is shared by the descriptors in flight.
+*/
+struct sg_list {
+  struct sg_entry *entry;
+  uint32_t         count;
+  uint32_t         handle;  /**< Registered buffer of the entries (dma_descriptor_sw.buffer) */
+  uint64_t         length;  /**< Length of every entry */
+  uint64_t         align;   /**< Power of 2 that aligns every entry and is not smaller than length */
+  uint64_t         stride;  /**< sg_list_strided: distance between consecutive entries. 0 for other lists */
+};
+
+/**
+* @brief Build a list of count buffers of length bytes spread evenly over a buffer: the entry i is
+* at i * stride, with the largest stride that is a multiple of the alignment (length rounded up to
+* a power of 2) and fits count entries in buffer_size. As the entries are aligned, none of them
+* crosses a region of region_size bytes (a huge page).
+*
+* @param l The list. sg_list_free releases it.
+* @param handle Registered buffer of the entries.
+* @param buffer_size Length of the registered buffer.
+* @param region_size Physically contiguous regions of the buffer (its page size). A power of 2.
+*
+* @return 0 if ok, -1 if the entries do not fit or they would cross a region.
+*/
+int sg_list_strided (struct sg_list *l, uint32_t handle, uint64_t buffer_size, uint64_t region_size, uint32_t count, uint64_t length);
+
+/**
+* @brief Map for the device, once, every region of region_size bytes that holds an entry. The
+* descriptors of the list then reuse those mappings (the DMA map cache of the driver looks up the
+* region that contains a descriptor), so the walk does not map and unmap each small buffer.
+*
+* @param regions Where the number of regions that hold an entry is stored.
+*
+* @return The number of regions mapped. The driver keeps DMA_MAP_CACHE_ENTRIES mappings per open
+* file: the entries of the rest of the regions are mapped by each descriptor.
+*/
+uint32_t sg_list_register (struct sg_list *l, uint64_t region_size, uint32_t *regions);
+
+/**
+* @brief Write n descriptors that walk the list from the entry first (modulo count). Each one is
+* a copy of model with the address and the length of its entry.
+*/
+void sg_list_descriptors (const struct sg_list *l, uint64_t first, const struct dma_descriptor_sw *model, struct dma_descriptor_sw *d, uint32_t n);
+
+/**
+* @brief Release the memory of a list.
+*/
+void sg_list_free (struct sg_list *l);
+
+#endif
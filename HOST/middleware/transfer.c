@@ -30,31 +30,52 @@
 #include "transfer.h"
 #include "init.h"
 #include "huge_page.h"
+#include "emulator.h"
 #include "../include/ioctl_commands.h"
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
 
 static struct hugepage hp; /**< Local variable that stores the fields associated to the current map */
+static struct buffer_registration registration; /**< Cost of the registration of hp */
+
+/* Monotonic time in ns */
+static uint64_t now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* Send the request to /dev/nfp or to the software model of the device */
+static int device_ioctl (unsigned long request, void *arg)
+{
+  if (isEmulatedDevice()) {
+    return emu_ioctl (request, arg);
+  }
+  return ioctl (getCharDeviceDescriptor(), request, arg);
+}
 
 uint32_t writeWord (uint8_t bar, uint32_t offset, uint32_t data)
 {
   struct reg32 reg;
-  int fd = getCharDeviceDescriptor();
   reg.bar    = bar;
   reg.data   = data;
   reg.offset = offset;
-  ioctl (fd, NFPIOC_WRITE_32, &reg);
+  device_ioctl (NFPIOC_WRITE_32, &reg);
   return reg.data;
 }
 
 uint32_t readWord (uint8_t bar, uint32_t offset)
 {
   struct reg32 reg;
-  int fd = getCharDeviceDescriptor();
   reg.bar    = bar;
   reg.data   = 0;
   reg.offset = offset;
-  ioctl (fd, NFPIOC_READ_32, &reg);
+  device_ioctl (NFPIOC_READ_32, &reg);
   return reg.data;
 }
 
@@ -63,7 +84,11 @@ void *getFreePages(uint32_t npages)
   int fd = getCharDeviceDescriptor();
 
   void * address = NULL;
-  address = mmap(NULL, KERNEL_PAGE_SIZE * npages, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (isEmulatedDevice()) {
+    address = emu_mmap(KERNEL_PAGE_SIZE * npages);
+  } else {
+    address = mmap(NULL, KERNEL_PAGE_SIZE * npages, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
   if (address == MAP_FAILED) {
     perror("mmap: ");
     return NULL;
@@ -73,7 +98,11 @@ void *getFreePages(uint32_t npages)
 
 void unsetFreePages(void *address, uint32_t npages)
 {
-  munmap(address, KERNEL_PAGE_SIZE * npages);
+  if (isEmulatedDevice()) {
+    emu_munmap(address, KERNEL_PAGE_SIZE * npages);
+  } else {
+    munmap(address, KERNEL_PAGE_SIZE * npages);
+  }
 }
 
 void *getFreeHugePages(uint32_t npages)
@@ -82,6 +111,8 @@ void *getFreeHugePages(uint32_t npages)
 
   int fd = getCharDeviceDescriptor();
 
+  memset (&db, 0, sizeof (struct dma_buffer));
+
   uint64_t tsize;
 
   if (npages == 0) { // Alloc all possible free hugepages if 0
@@ -90,7 +121,9 @@ void *getFreeHugePages(uint32_t npages)
   tsize = npages * hugepage_size();
 
   if (alloc_hugepage (&hp, tsize)) {
-    close (fd);
+    if (!isEmulatedDevice()) {
+      close (fd);
+    }
     rte_exit (-1, "Hugepage alloc error\n");
   }
 
@@ -104,43 +137,222 @@ void *getFreeHugePages(uint32_t npages)
 
   /* Comunicate driver the initial setup */
   /* di must point to the region of data and indicates its length */
-  ioctl (fd, NFPIOC_REGISTER_BUFFER, &db);
+  memset (&registration, 0, sizeof (struct buffer_registration));
+  registration.bytes     = tsize;
+  registration.hugepages = npages;
+  registration.register_ns = now_ns ();
+  device_ioctl (NFPIOC_REGISTER_BUFFER, &db);
+  registration.register_ns = now_ns () - registration.register_ns;
   return hp.data;
 }
 
 
 void unsetHugeFreePages(void *address, uint32_t npages)
 {
-  int fd = getCharDeviceDescriptor();
-
   if (hp.data) {
-    ioctl (fd, NFPIOC_UNREGISTER_BUFFER);
+    registration.unregister_ns = now_ns ();
+    device_ioctl (NFPIOC_UNREGISTER_BUFFER, NULL);
+    registration.unregister_ns = now_ns () - registration.unregister_ns;
     free_hugepage (&hp);    /* Protect against possible reentry. */
   }
 }
 
-uint32_t writeDescriptor (struct dma_descriptor_sw *l)
+uint32_t registerBuffer (void *data, uint64_t length, uint64_t page_size, uint32_t *handle)
 {
-  int fd = getCharDeviceDescriptor();
+  struct dma_buffer db;
+
+  memset (&db, 0, sizeof (struct dma_buffer));
+  db.is_hp   = page_size > KERNEL_PAGE_SIZE;
+  db.data    = data;
+  db.length  = length;
+  db.hp_size = page_size;
+  db.n_hp    = page_size ? (length + page_size - 1) / page_size : 0;
+  if (device_ioctl (NFPIOC_REGISTER_BUFFER_HANDLE, &db)) {
+    return 1;
+  }
+  *handle = db.handle;
+  return 0;
+}
 
-  ioctl (fd, NFPIOC_WRITE_DMA_DESCRIPTOR, l);
+uint32_t unregisterBuffer (uint32_t handle)
+{
+  return device_ioctl (NFPIOC_UNREGISTER_BUFFER_HANDLE, &handle) ? 1 : 0;
+}
+
+uint32_t mapBuffer (uint32_t handle, uint64_t offset, uint64_t length, uint64_t *bus_address)
+{
+  struct dma_buffer_map bm;
+
+  bm.buffer = handle;
+  bm.offset = offset;
+  bm.length = length;
+  if (device_ioctl (NFPIOC_MAP_BUFFER, &bm)) {
+    return 1;
+  }
+  *bus_address = bm.bus_address;
+  return 0;
+}
+
+void getBufferRegistration (struct buffer_registration *br)
+{
+  *br = registration;
+}
+
+uint32_t writeDescriptor (struct dma_descriptor_sw *l)
+{
+  device_ioctl (NFPIOC_WRITE_DMA_DESCRIPTOR, l);
   return 0;
 }
 
 uint32_t readDescriptor (struct dma_descriptor_sw *l)
 {
-  int fd = getCharDeviceDescriptor();
+  struct dma_descriptor_sw piece;
+  uint32_t i;
 
-  ioctl (fd, NFPIOC_READ_DMA_DESCRIPTOR, l);
+  device_ioctl (NFPIOC_READ_DMA_DESCRIPTOR, l);
+  // A split descriptor: the status of each piece is in its own position
+  for (i = 1; i < l->slots; i++) {
+    piece = *l;
+    piece.index = (l->index + i) % MAX_DESCRIPTORS_PER_BATCH;
+    device_ioctl (NFPIOC_READ_DMA_DESCRIPTOR, &piece);
+    l->latency       += piece.latency;
+    l->time_at_req   += piece.time_at_req;
+    l->time_at_comp  += piece.time_at_comp;
+    l->bytes_at_req  += piece.bytes_at_req;
+    l->bytes_at_comp += piece.bytes_at_comp;
+  }
   return 0;
 }
 
+uint32_t writeDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine)
+{
+  struct dma_descriptor_batch batch;
+
+  batch.descriptors = l;
+  batch.count       = n;
+  batch.processed   = 0;
+  batch.engine      = engine;
+  device_ioctl (NFPIOC_WRITE_DMA_DESCRIPTORS, &batch);
+  return batch.processed;
+}
+
+uint32_t readDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine)
+{
+  struct dma_descriptor_batch batch;
+
+  batch.descriptors = l;
+  batch.count       = n;
+  batch.processed   = 0;
+  batch.engine      = engine;
+  device_ioctl (NFPIOC_READ_DMA_DESCRIPTORS, &batch);
+  return batch.processed;
+}
+
+uint32_t submitDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine)
+{
+  struct dma_descriptor_batch batch;
+
+  batch.descriptors = l;
+  batch.count       = n;
+  batch.processed   = 0;
+  batch.engine      = engine;
+  device_ioctl (NFPIOC_SUBMIT_DMA_DESCRIPTORS, &batch);
+  return batch.processed;
+}
+
+uint32_t reapDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine)
+{
+  struct dma_descriptor_batch batch;
+
+  batch.descriptors = l;
+  batch.count       = n;
+  batch.processed   = 0;
+  batch.engine      = engine;
+  device_ioctl (NFPIOC_REAP_DMA_DESCRIPTORS, &batch);
+  return batch.processed;
+}
+
+int waitDescriptors (int timeout_ms)
+{
+  struct pollfd pfd;
+
+  if (isEmulatedDevice()) { // The model completes the descriptors when they are submitted
+    return 1;
+  }
+  pfd.fd      = getCharDeviceDescriptor();
+  pfd.events  = POLLIN;
+  pfd.revents = 0;
+  return poll (&pfd, 1, timeout_ms);
+}
+
+uint32_t setCompletionMode (uint32_t mode)
+{
+  return device_ioctl (NFPIOC_COMPLETION_MODE, &mode) ? 1 : 0;
+}
+
 uint32_t setWindowSize (uint64_t ws)
 {
+  device_ioctl (NFPIOC_WINDOW_SIZE, &ws);
 
-  int fd = getCharDeviceDescriptor();
+  return 0;
+}
 
-  ioctl (fd, NFPIOC_WINDOW_SIZE, &ws);
+uint32_t setEngineWindowSize (uint8_t engine, uint64_t ws)
+{
+  struct dma_window window;
+
+  window.size   = ws;
+  window.engine = engine;
+  device_ioctl (NFPIOC_ENGINE_WINDOW_SIZE, &window);
 
   return 0;
 }
+
+uint32_t setTlpLog (uint8_t engine, uint32_t enable, uint32_t sample_shift)
+{
+  struct dma_tlp_log_control lc;
+
+  lc.engine       = engine;
+  lc.enable       = enable;
+  lc.sample_shift = sample_shift;
+  return device_ioctl (NFPIOC_TLP_LOG_CONTROL, &lc) ? 1 : 0;
+}
+
+uint32_t readTlpLog (uint8_t engine, uint32_t *latency, uint32_t n, uint64_t *tail, uint64_t *lost)
+{
+  struct dma_tlp_log_read lr;
+
+  lr.latency = latency;
+  lr.count   = n;
+  lr.engine  = engine;
+  lr.tail    = *tail;
+  lr.lost    = 0;
+  if (device_ioctl (NFPIOC_READ_TLP_LOG, &lr)) {
+    *lost = 0;
+    return 0;
+  }
+  *tail = lr.tail;
+  *lost = lr.lost;
+  return lr.count;
+}
+
+uint32_t leaseEngine (uint8_t engine)
+{
+  uint32_t e = engine;
+
+  return device_ioctl (NFPIOC_LEASE_ENGINE, &e) ? 1 : 0;
+}
+
+uint32_t releaseEngine (uint8_t engine)
+{
+  uint32_t e = engine;
+
+  return device_ioctl (NFPIOC_RELEASE_ENGINE, &e) ? 1 : 0;
+}
+
+uint32_t configurePcie (uint32_t max_payload, uint32_t max_read_request, struct pcie_config *pc)
+{
+  pc->max_payload      = max_payload;
+  pc->max_read_request = max_read_request;
+  return device_ioctl (NFPIOC_PCIE_CONFIG, pc) ? 1 : 0;
+}
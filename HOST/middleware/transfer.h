@@ -60,9 +60,12 @@ uint32_t writeWord (uint8_t bar, uint32_t offset, uint32_t data);
 
 /**
  * @brief Communicate to the driver that the [CONTROL] fields of a descriptor are to be
- * written. *The user must check that the transaction is valid or the system could crash*
+ * written. The engine field selects the DMA engine. *The user must check that the transaction
+ * is valid or the system could crash*
  *
- * @param dma_descriptor_sw The new values specify by the user program
+ * @param dma_descriptor_sw The new values specify by the user program. The slots field is
+ * written: the descriptor may use several positions of the ring if its memory is not contiguous
+ * (see NFPIOC_WRITE_DMA_DESCRIPTOR).
  * @return The possible error code, 0 if ok
  */
 uint32_t writeDescriptor (struct dma_descriptor_sw *l);
@@ -71,11 +74,68 @@ uint32_t writeDescriptor (struct dma_descriptor_sw *l);
  * @brief Communicate to the driver that the [STATUS] fields of a descriptor are to be
  * read. *The user must check that the transaction is valid or the system could crash*
  *
- * @param dma_descriptor_sw The structure where the data will be copied
+ * @param dma_descriptor_sw The structure where the data will be copied. If slots is greater
+ * than 1 the [STATUS] fields of every piece are added up.
  * @return The possible error code, 0 if ok
  */
 uint32_t readDescriptor (struct dma_descriptor_sw *l);
 
+/**
+ * @brief Write the [CONTROL] fields of n descriptors with a single call to the driver. The
+ * descriptors are processed in order, as n invocations of writeDescriptor would do, so the
+ * engine is only started by the descriptors with enable set (typically just the last one).
+ *
+ * @param l Array of descriptors
+ * @param n Number of elements in l. Maximum MAX_DESCRIPTORS_PER_BATCH
+ * @param engine DMA engine of every descriptor of l (the engine field is ignored)
+ * @return The number of descriptors written. Lower than n in case of error
+ */
+uint32_t writeDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine);
+
+/**
+ * @brief Read the [STATUS] fields of n descriptors with a single call to the driver.
+ *
+ * @param l Array of descriptors. The index field selects the descriptor to read
+ * @param n Number of elements in l. Maximum MAX_DESCRIPTORS_PER_BATCH
+ * @param engine DMA engine of every descriptor of l (the engine field is ignored)
+ * @return The number of descriptors read. Lower than n in case of error
+ */
+uint32_t readDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine);
+
+/**
+ * @brief Queue n descriptors and return without waiting for them, so the next ones can be
+ * prepared while the engine is busy. The driver chooses the position of every descriptor in
+ * the ring (the index field is overwritten). While the engine is busy the new descriptors
+ * must share the configuration of the ones in flight.
+ *
+ * @param l Array of descriptors
+ * @param n Number of elements in l. Maximum MAX_DESCRIPTORS_PER_BATCH
+ * @param engine DMA engine of every descriptor of l (the engine field is ignored)
+ * @return The number of descriptors queued. Lower than n if the ring is full
+ */
+uint32_t submitDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine);
+
+/**
+ * @brief Retrieve the [STATUS] fields of the submitted descriptors that have been completed,
+ * in order of submission. It does not block.
+ *
+ * @param l Where the descriptors are stored. The index field is the position in the ring
+ * @param n Maximum number of descriptors to retrieve
+ * @param engine DMA engine whose descriptors are retrieved
+ * @return The number of descriptors stored in l
+ */
+uint32_t reapDescriptors (struct dma_descriptor_sw *l, uint32_t n, uint8_t engine);
+
+/**
+ * @brief Sleep until there are completed descriptors to reap (in any engine). The driver is only woken up by
+ * the interrupts of the device, so it is meant for NFP_COMPLETION_IRQ/NFP_COMPLETION_HYBRID
+ * (with NFP_COMPLETION_POLL just call reapDescriptors in a loop).
+ *
+ * @param timeout_ms Maximum time to wait. A negative value waits forever
+ * @return A positive value if there are descriptors to reap, 0 on timeout, negative on error
+ */
+int waitDescriptors (int timeout_ms);
+
 
 /**
  * @brief Asked the kernel for a buffer sustained on kernel pages
@@ -110,6 +170,57 @@ void unsetFreePages(void *address, uint32_t npages);
  */
 void unsetHugeFreePages(void *address, uint32_t npages);
 
+/**
+ * @brief Register one more buffer in the driver, next to the one of getFreeHugePages (handle 0).
+ * The descriptors select it with their buffer field, so the working set can change between
+ * descriptors without pinning the memory again.
+ *
+ * @param data The buffer (typically huge pages allocated by the caller)
+ * @param length Length of the buffer
+ * @param page_size Size of the pages of the buffer (informative)
+ * @param handle Where the handle of the buffer is stored
+ * @return 0 if everything was OK, 1 if the buffer cannot be pinned or NFP_MAX_BUFFERS are registered
+ */
+uint32_t registerBuffer (void *data, uint64_t length, uint64_t page_size, uint32_t *handle);
+
+/**
+ * @brief Unregister a buffer of registerBuffer. The rest of the buffers are kept.
+ *
+ * @param handle The handle returned by registerBuffer
+ * @return 0 if everything was OK
+ */
+uint32_t unregisterBuffer (uint32_t handle);
+
+/**
+ * @brief Map a region of a registered buffer for the device until the buffer is unregistered.
+ * The descriptors inside the region reuse the mapping.
+ *
+ * @param handle The registered buffer (0 for the one of getFreeHugePages)
+ * @param offset Offset of the region in the buffer
+ * @param length Length of the region. It must be physically contiguous (inside a huge page)
+ * @param bus_address Where the address of the region for the device is stored
+ * @return 0 if everything was OK, 1 if the region cannot be mapped or the driver keeps too many mappings
+ */
+uint32_t mapBuffer (uint32_t handle, uint64_t offset, uint64_t length, uint64_t *bus_address);
+
+/**
+ * @brief Cost of the registration of the buffer of huge pages in the driver, which pins its
+ * pages, measured around the IOCTL operations.
+ */
+struct buffer_registration {
+  uint64_t bytes;         /**< Length of the buffer */
+  uint32_t hugepages;     /**< Number of huge pages of the buffer */
+  uint64_t register_ns;   /**< Time of the registration in getFreeHugePages */
+  uint64_t unregister_ns; /**< Time of the unregistration in unsetHugeFreePages (0 until then) */
+};
+
+/**
+ * @brief Get the cost of the registration of the last buffer returned by getFreeHugePages.
+ *
+ * @param br Where the values are stored
+ */
+void getBufferRegistration (struct buffer_registration *br);
+
 /**
  * @brief Update the number of concurrent tags in memory read requests.
  *
@@ -118,5 +229,75 @@ void unsetHugeFreePages(void *address, uint32_t npages);
  */
 uint32_t setWindowSize (uint64_t ws);
 
+/**
+ * @brief Update the number of concurrent tags in memory read requests of a DMA engine.
+ *
+ * @param engine The DMA engine
+ * @param ws The new value to be established
+ * @return 0 if everything was OK
+ */
+uint32_t setEngineWindowSize (uint8_t engine, uint64_t ws);
+
+/**
+ * @brief Select how the driver detects the end of a DMA operation.
+ *
+ * @param mode NFP_COMPLETION_POLL, NFP_COMPLETION_IRQ or NFP_COMPLETION_HYBRID
+ * @return 0 if everything was OK. Non zero if the mode is not available (no MSI in the device)
+ */
+uint32_t setCompletionMode (uint32_t mode);
+
+/**
+ * @brief Start the per-TLP latency log of a DMA engine from an empty ring, or stop it. The
+ * log records the time from each memory read request until its last completion (see
+ * struct dma_tlp_log).
+ *
+ * @param engine The DMA engine
+ * @param enable 1 to start the log, 0 to stop it
+ * @param sample_shift Only one of every 2^sample_shift memory read requests is recorded
+ * @return 0 if everything was OK
+ */
+uint32_t setTlpLog (uint8_t engine, uint32_t enable, uint32_t sample_shift);
+
+/**
+ * @brief Copy the entries of the per-TLP latency log of a DMA engine that have not been read.
+ *
+ * @param engine The DMA engine
+ * @param latency Where the entries (cycles of 4 ns) are stored
+ * @param n Number of elements in latency
+ * @param tail Entries already read since the log was enabled (0 after setTlpLog). It is advanced
+ * @param lost Where the number of entries overwritten by the device before this call is stored
+ * @return The number of entries stored in latency
+ */
+uint32_t readTlpLog (uint8_t engine, uint32_t *latency, uint32_t n, uint64_t *tail, uint64_t *lost);
+
+/**
+ * @brief Lease a DMA engine to this process. The engines are leased implicitly by their first
+ * operation; leasing them at the start detects that another process is using one of them.
+ *
+ * @param engine The DMA engine
+ * @return 0 if everything was OK, 1 if the engine is held by another open file (errno is EBUSY)
+ */
+uint32_t leaseEngine (uint8_t engine);
+
+/**
+ * @brief Return a leased DMA engine. The operation in flight is waited for and the submitted
+ * descriptors that were not reaped are discarded. The engines are returned on exit as well.
+ *
+ * @param engine The DMA engine
+ * @return 0 if everything was OK
+ */
+uint32_t releaseEngine (uint8_t engine);
+
+/**
+ * @brief Program the Max Payload Size and the Max Read Request Size of the device. The DMA core
+ * reports the sizes of its TLPs in dma_common_block, which must be read again afterwards.
+ *
+ * @param max_payload MPS in bytes, 0 keeps it
+ * @param max_read_request MRRS in bytes, 0 keeps it
+ * @param pc Where the values in effect (and the largest MPS) are stored
+ * @return 0 if everything was OK, 1 if a value is not accepted by the link (EINVAL) or an engine is running (EBUSY)
+ */
+uint32_t configurePcie (uint32_t max_payload, uint32_t max_read_request, struct pcie_config *pc);
+
 
 #endif
@@ -32,35 +32,50 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 #include <sys/mman.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <errno.h>
 #include "nfp_common.h"
 #include <time.h>
 #include "../middleware/huge_page.h"
+#include "../middleware/direct.h"
+#include "../middleware/address_gen.h"
+#include "../middleware/sg_list.h"
+#include "statistics.h"
+#include "results.h"
+#include "cache.h"
+#include "verify.h"
+#include "histogram.h"
 #include "../include/ioctl_commands.h"
+#include "../include/dma_core.h"
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
 
 #define PAGE_SIZE            4096
 #define MAX_WINDOW_SIZE      24
 #define MAX_DMA_DESCRIPTORS  1024
-#define CACHE_SIZE           (16*1024*1024) // 16MB
-#define MAX_READ_REQUEST_SIZE 512
-#define MAX_PAYLOAD           256
 #define DEFAULT_NUMBER_TLPS   512*512
+#define DEFAULT_MAX_SAMPLES   (64*1024) // Limit of the adaptive mode
+#define MIN_ADAPTIVE_SAMPLES  30
+#define ASYNC_TIMEOUT_NS      10000000000UL // Asynchronous mode: maximum time without completions
 
-// Comment the following two lines if huge pages are not required
-#define USE_HUGE_PAGES
-#define NUMBER_PAGES         1
-
-//#define NUMBER_PAGES         MAX_PAGES-1 //If using kenel pages, check that this value do NOT exced the one predefined in HOST/include/ioctl_commands.h
+#define DEFAULT_NUMBER_PAGES 1 // Huge pages of the buffer (-P)
+#define BACKING_KERNEL_PAGES 4 // -H 4k: the MAX_PAGES kernel pages of the driver (HOST/include/ioctl_commands.h) instead of huge pages
+#define MIN_VERIFIED_LINES   0.9  // -E verify: fraction of the sampled lines that must be in the state requested by -c
+#define DEFAULT_WARM_FRACTION 0.5 // -c partial: fraction of the lines that are warmed (-F)
+#define KNEE_THRESHOLD       0.10 // IOTLB suite: relative change of the metric, from the smallest window, that marks the knee
+#define MIN_SUITE_WINDOW     (4*1024UL)
+#define MAX_SUITE_WINDOW     (1024*1024*1024UL)
+#define CYCLE_NS             4    // Period of the clock of the DMA core, the unit of its time counters
+#define DEFAULT_RESULT_RING  (16*1024*1024UL) // Bytes of the ring of each results file (-B)
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(*(arr)))
 #endif
 
-static uint64_t large_array[8 * 1024 * 1024];
-
 
 struct fixed_pattern {
   uint64_t initial_offset;
@@ -72,17 +87,22 @@ struct random_pattern {
 };
 struct sequential_pattern {
 };
+struct sg_pattern {
+  uint64_t count;
+};
 
 union properties {
   struct fixed_pattern      pfix;
   struct random_pattern     pran;
   struct sequential_pattern pseq;
+  struct sg_pattern         psg;
 };
 
 enum pattern {
   FIX, // Fixed: always the same address
   SEQ, // Sequential
-  RAN  // Random
+  RAN, // Random
+  SG   // Scatter-gather: a list of small buffers spread over the buffer, one descriptor per buffer
 };
 
 enum direction {
@@ -94,12 +114,72 @@ enum direction {
 enum cache {
   IGNORE,
   DISCARD,
-  WARM
+  WARM,
+  PARTIAL    // A fraction of the lines warmed and the rest discarded
 };
 
 enum test {
   LATENCY,
-  BANDWIDTH
+  BANDWIDTH,
+  HOST       // Completion time seen by the host
+};
+
+enum summary {
+  RAW,   // One row per descriptor
+  STATS  // One row per point
+};
+
+enum access {
+  IOCTL, // The descriptors go through the driver
+  MMAP   // The descriptors are written in BAR0 mapped in the process
+};
+
+enum suite {
+  NO_SUITE,
+  IOTLB    // Random windows against the page size of the buffer, looking for the knee of each series
+};
+
+#define MAX_SWEEP_VALUES 256 /**< Maximum number of values per axis of a sweep */
+
+/** NUMA nodes given by name. They are resolved with the node local to the device */
+enum numa_node {
+  NODE_ANY    = HUGEPAGE_ANY_NODE, // No binding
+  NODE_LOCAL  = -2,                // The node of the device
+  NODE_REMOTE = -3,                // The first node other than the one of the device
+  NODE_AUTO   = -4                 // Default: the node of the device if it is known, any otherwise
+};
+
+/**
+* @brief A pattern and its properties, as given after -p.
+*/
+struct pattern_spec {
+  uint8_t           pat;
+  union properties  prop;
+};
+
+/**
+* @brief Values of every axis of the test matrix. A single point is a sweep
+* with one value per axis.
+*/
+struct sweep {
+  uint64_t            nbytes[MAX_SWEEP_VALUES];
+  uint64_t            wsize[MAX_SWEEP_VALUES];
+  uint8_t             dir[MAX_SWEEP_VALUES];
+  uint8_t             cache[MAX_SWEEP_VALUES];
+  struct pattern_spec pat[MAX_SWEEP_VALUES];
+  int                 mem_node[MAX_SWEEP_VALUES]; /**< Node of the buffer. The buffer is allocated again for each value */
+  uint8_t             backing[MAX_SWEEP_VALUES];  /**< Memory of the buffer. The buffer is allocated again for each value */
+  uint64_t            max_payload[MAX_SWEEP_VALUES];      /**< MPS programmed in the link. 0 keeps it */
+  uint64_t            max_read_request[MAX_SWEEP_VALUES]; /**< MRRS programmed in the link. 0 keeps it */
+  int                 n_nbytes;
+  int                 n_wsize;
+  int                 n_dir;
+  int                 n_cache;
+  int                 n_pat;
+  int                 n_mem_node;
+  int                 n_backing;
+  int                 n_max_payload;
+  int                 n_max_read_request;
 };
 
 /**
@@ -115,8 +195,91 @@ struct arguments {
   uint8_t           cache;
   union properties  prop;
   char*             file_name;
+  uint8_t           summary;
+  double            precision;   /**< Adaptive mode: relative half width of the 95% CI to reach. 0 disables it */
+  uint64_t          max_samples; /**< Adaptive mode: maximum number of descriptors per point */
+  uint64_t          batch;       /**< Descriptors written/read with a single IOCTL */
+  uint8_t           completion;  /**< enum nfp_completion_mode */
+  uint64_t          queue;       /**< Asynchronous mode: descriptors in flight. 0 uses the synchronous interface */
+  uint8_t           engine_dir[MAX_NUM_DMA_ENGINES]; /**< Concurrent mode: direction of each engine */
+  int               nengines;    /**< Engines driven at the same time. 0 outside of the concurrent mode */
+  uint8_t           access;      /**< enum access */
+  uint8_t           format;      /**< enum result_format of the results file */
+  uint64_t          max_payload;      /**< Metadata of the rows: MPS used by the DMA core in bytes */
+  uint64_t          max_read_request; /**< Metadata of the rows: MRRS used by the DMA core in bytes */
+  uint64_t          page_size;        /**< Metadata of the rows: size of the pages of the buffer */
+  int               cpu_node;    /**< NUMA node of the threads (enum numa_node or a node) */
+  int               mem_node;    /**< In execution: NUMA node where the buffer resides */
+  uint64_t          npages;      /**< Huge pages of the buffer. 0 takes every free huge page */
+  uint8_t           backing;     /**< In execution: enum hugepage_backing or BACKING_KERNEL_PAGES */
+  uint64_t          contiguous;  /**< In execution: largest random window that the buffer can hold */
+  uint8_t           suite;       /**< enum suite */
+  char*             knee_file_name; /**< IOTLB suite: where the knees are written */
+  int               eviction;    /**< -c discard/partial: CACHE_FLUSH and/or CACHE_EVICT */
+  uint8_t           verify_cache; /**< Check the state of the lines accessed by the core after preparing them */
+  double            warm_fraction; /**< -c partial: fraction of the lines that are warmed */
+  uint8_t           verify_data; /**< Check the data written or read by the core after each set of descriptors */
+  uint64_t          verify_seed; /**< -V: seed of the pattern of the first set of descriptors */
+  char*             tlp_file_name; /**< -L: where the histograms of the latency of the memory read requests are written. NULL disables the log */
+  uint64_t          result_ring; /**< -B: bytes of the ring of the background writer of each results file. 0 writes from the measuring thread */
+  uint64_t          budget_ns;    /**< -T: continuous mode limited by time. 0 if it is not used */
+  uint64_t          budget_bytes; /**< -T: continuous mode limited by the bytes of the descriptors. 0 if it is not used */
+  struct sweep      sweep;   /**< Values of the matrix. nbytes...prop hold the point in execution */
 }; /**< Global variable with the user arguments */
 
+static const char *dir_names[]   = {"R", "W", "RW"};
+static const char *cache_names[] = {"ignore", "discard", "warm", "partial"};
+static const char *pattern_names[] = {"FIX", "SEQ", "RAN", "SG"};
+static const char *summary_names[] = {"raw", "stats"};
+static const char *completion_names[] = {"poll", "irq", "hybrid"};
+static const char *access_names[] = {"ioctl", "mmap"};
+static const char *format_names[] = {"csv", "jsonl", "bin"};
+static const char *backing_names[] = {"default", "2m", "1g", "thp", "4k"};
+static const char *suite_names[]   = {"none", "iotlb"};
+static const char *eviction_names[] = {"flush", "evict", "verify"};
+static const char *test_names[]   = {"lat", "bw", "host"};
+static const char *metric_names[] = {"latency_ns", "bandwidth_gbps", "host_completion_ns"};
+static const char *verify_ns_metric     = "verify_ns";     /**< -V: time to fill and check the buffer per set of descriptors */
+static const char *verify_errors_metric = "verify_errors"; /**< -V: wrong units per set of descriptors */
+static const char *tlp_metric           = "tlp_latency_ns"; /**< -L: latency of each memory read request */
+
+/** Columns that identify the point of every row of the results file */
+#define POINT_COLUMNS \
+  {"engine", RESULT_I64}, {"direction", RESULT_STR}, {"test", RESULT_STR}, {"pattern", RESULT_STR}, \
+  {"pattern_param", RESULT_U64}, {"cache", RESULT_STR}, {"window_size", RESULT_U64}, {"size", RESULT_U64}, \
+  {"max_payload", RESULT_U64}, {"max_read_request", RESULT_U64}, {"page_size", RESULT_U64}, \
+  {"completion", RESULT_STR}, {"access", RESULT_STR}, {"batch", RESULT_U64}, {"queue", RESULT_U64}, \
+  {"cpu_node", RESULT_I64}, {"mem_node", RESULT_I64}, {"metric", RESULT_STR}
+#define NUM_POINT_COLUMNS 18
+
+/** Raw summary: a row per descriptor with its [STATUS] fields as read from the core */
+static const struct result_column raw_schema[] = {
+  POINT_COLUMNS, {"descriptor", RESULT_U64}, {"value", RESULT_F64}, {"latency", RESULT_U64},
+  {"time_at_req", RESULT_U64}, {"time_at_comp", RESULT_U64}, {"bytes_at_req", RESULT_U64}, {"bytes_at_comp", RESULT_U64}
+};
+
+/** Stats summary: a row per point */
+static const struct result_column stats_schema[] = {
+  POINT_COLUMNS, {"samples", RESULT_U64}, {"min", RESULT_F64}, {"median", RESULT_F64}, {"p99", RESULT_F64},
+  {"p99_9", RESULT_F64}, {"max", RESULT_F64}, {"mean", RESULT_F64}, {"stddev", RESULT_F64}, {"ci95_low", RESULT_F64},
+  {"ci95_high", RESULT_F64}
+};
+
+/** Per-TLP latency log: a row per non-empty bucket of the histogram of each point */
+static const struct result_column tlp_schema[] = {
+  POINT_COLUMNS, {"sample_shift", RESULT_U64}, {"lost", RESULT_U64}, {"bucket_low_ns", RESULT_U64},
+  {"bucket_high_ns", RESULT_U64}, {"count", RESULT_U64}
+};
+
+/** IOTLB suite: a row per series of random windows (the median of each point is compared with
+    the one of the smallest window). The windows are the pattern_param of the points */
+static const struct result_column knee_schema[] = {
+  {"backing", RESULT_STR}, {"page_size", RESULT_U64}, {"mem_node", RESULT_I64}, {"direction", RESULT_STR},
+  {"test", RESULT_STR}, {"cache", RESULT_STR}, {"window_size", RESULT_U64}, {"size", RESULT_U64}, {"metric", RESULT_STR},
+  {"first_window", RESULT_U64}, {"baseline", RESULT_F64}, {"knee_window", RESULT_U64}, {"knee_value", RESULT_F64},
+  {"last_window", RESULT_U64}, {"last_value", RESULT_F64}, {"threshold", RESULT_F64}
+};
+
 
 
 
@@ -126,29 +289,114 @@ struct arguments {
 void printUsage()
 {
   printf ("This program has sveral modes of usage:\n"
-          "· $benchmark -t <TEST_TYPE> -d <DIR> -p <PATTERN> [properties] -n <BYTES> -l <NITERS> [-w <WINDOW_SIZE>]  [-c <CACHE_OPTIONS>] [-f <LOGFILE>]\n"
+          "· $benchmark -t <TEST_TYPE> -d <DIR> -p <PATTERN> [properties] -n <BYTES> -l <NITERS> [-w <WINDOW_SIZE>]  [-c <CACHE_OPTIONS>] [-f <LOGFILE>] [-s <SUMMARY>] [-a <PRECISION>] [-m <MAX_SAMPLES>] [-b <BATCH>] [-i <COMPLETION>] [-q <QUEUE_DEPTH>] [-e <ENGINE_DIRS>] [-x <ACCESS>] [-o <FORMAT>] [-C <CPU_NODE>] [-N <MEM_NODES>] [-H <BACKINGS>] [-P <PAGES>] [-S <SUITE>] [-K <KNEEFILE>] [-E <EVICTION>] [-F <FRACTION>] [-V <SEED>] [-L <TLPFILE>] [-B <RING>] [-T <BUDGET>] [-M <MPS>] [-R <MRRS>]\n"
           "\tWhere \n"
-          "\t\t <TEST_TYPE> can be lat or bw: \n"
+          "\t\t <TEST_TYPE> can be lat, bw or host: \n"
           "\t\t\tlat represents Latency test \n"
           "\t\t\tbw represents Bandwidth test \n"
+          "\t\t\thost represents the time since the descriptor is sent to the driver until its completion is notified \n"
           "\t\t <DIR> can be R/W/RW: \n"
           "\t\t\tR represents memory write requests from the FPGA \n"
           "\t\t\tW represents memory read requests from the FPGA \n"
           "\t\t\tRW represents a memory write request from the FPGA that is followed by a memory read request\n"
-          "\t\t <PATTERN> can be FIX/SEQ/RAN for same address,sequential and random access \n"
+          "\t\t <PATTERN> can be FIX/SEQ/RAN/SG for same address,sequential, random and scatter-gather access \n"
           "\t\t\t- FIX <offset>       : Write always to the same address. The offset is referred to the initial position of the software buffer \n"
           "\t\t\t- SEQ                : Write to contiguous positions of memory\n"
           "\t\t\t- RAN <window size>  : Write to random 4KB boundaries\n"
           "\t\t\t\t[WARNING] <window size> must be a power of 2\n"
+          "\t\t\t- SG <count>        : Walk a list of <count> buffers of <BYTES> spread evenly over the buffer (4096 packet\n"
+          "\t\t\t                      buffers of 2KB: -p SG 4096 -n 2048). Each descriptor moves one buffer, in order\n"
           "\t\t <BYTES> is a value greater than 0 (necessarily a multiple of 4). Number of bytes per descriptor\n"
           "\t\t <NITERS> is the number of iterations of the experiment\n"
           "\t\t <WINDOW_SIZE> total tags that can be asked simultaneously in memory reads. Min 1, Max 24 \n"
-          "\t\t <CACHE_OPTIONS> are: \n"
+          "\t\t <CACHE_OPTIONS> are applied to the lines that the core will access with the pattern (RAN: every block\n"
+          "\t\t\tof the window that the generator can choose): \n"
           "\t\t\t- ignore: Do nothing  \n"
-          "\t\t\t- discard: Access in a random way before using the buffer  \n"
-          "\t\t\t- warm: Preload in the cache the buffer before accessing to it \n"
-          "\t\t <LOGFILE> is the file where the log will be saved \n"
-         );
+          "\t\t\t- discard: Remove the lines from the caches (see <EVICTION>) \n"
+          "\t\t\t- warm: Load the lines in the cache before accessing to them \n"
+          "\t\t\t- partial: Warm <FRACTION> of the lines (default %.2f) and discard the rest. The lines are chosen\n"
+          "\t\t\tby a hash of their offset, so they are the same in every descriptor \n"
+          "\t\t <EVICTION> is how the lines are discarded. A list of: \n"
+          "\t\t\t- flush: clflushopt/clflush of every line (default, evict if the CPU cannot flush lines) \n"
+          "\t\t\t- evict: Write an eviction set of %d times the last level cache with the CPUs of <CPU_NODE> \n"
+          "\t\t\t- verify: Time a sample of the lines afterwards and warn if less than %.0f%% of them are in the\n"
+          "\t\t\trequested state \n"
+          "\t\t <SEED> enables the verification of the data: before each set of descriptors (a batch, or <NITERS> with -q)\n"
+          "\t\t\tthe lines that the core will access are filled with a pattern derived from <SEED>, and afterwards every\n"
+          "\t\t\t16 byte unit is checked out of the timed region: W must leave the pattern intact, R and RW must replace it\n"
+          "\t\t\twith the counter of the application of the FPGA (RAN: the blocks that were not chosen keep the pattern).\n"
+          "\t\t\tThe time to fill and check and the wrong units of each set are reported in stderr and, with -s stats, in\n"
+          "\t\t\tthe rows whose metric is %s and %s. R and RW need sizes and offsets multiple of %d. Not available with -e\n"
+          "\t\t <TLPFILE> enables the per-TLP latency log of the engines with memory reads (W, RW): the time from each\n"
+          "\t\t\trequest until its last completion is read from the device after each set of descriptors (out of the timed\n"
+          "\t\t\tregion) and added to a log-linear histogram (%d buckets per power of 2). The non-empty buckets of each point\n"
+          "\t\t\tare written in <TLPFILE> with the format of -o, and -s stats adds the row of the metric %s. If a set\n"
+          "\t\t\thas more requests than the %d entries of the log, only one of every 2^sample_shift is recorded\n"
+          "\t\t <BUDGET> enables the continuous mode: the descriptor ring of the engine is kept full (<QUEUE_DEPTH>, default\n"
+          "\t\t\t%d descriptors) and every completed descriptor is replaced by a new one until the budget ends: a time\n"
+          "\t\t\t(120s) or the bytes of the descriptors (512g). Each sample is a window of <NITERS> descriptors (any\n"
+          "\t\t\tnumber): the bandwidth is the bytes of the window divided by the time between its completions, the\n"
+          "\t\t\tlatency the mean of the descriptors and the host time the time per descriptor. The totals and the times\n"
+          "\t\t\tthat the ring ran dry are reported in stderr. The cache is prepared once. Not available with -e, -a, -x mmap,\n"
+          "\t\t\t-V and -L. The samples are limited by <MAX_SAMPLES>\n"
+          "\t\t <LOGFILE> is the file where the results are appended. Every row carries the point (engine, direction, test,\n"
+          "\t\t\tpattern, cache, window size, size, MPS, MRRS, page size...) and, in the raw summary, the [STATUS] fields\n"
+          "\t\t\tof the descriptor as read from the core (the time counters are cycles of 4 ns)\n"
+          "\t\t <FORMAT> of <LOGFILE>: \n"
+          "\t\t\t- csv: Comma separated values, with a header if the file is empty (default) \n"
+          "\t\t\t- jsonl: One JSON object per row \n"
+          "\t\t\t- bin: Binary columnar format (see user/benchmark/results.h) \n"
+          "\t\t <RING> is the size of the memory that keeps the rows of each results file (default %lum). A background thread\n"
+          "\t\t\twrites them in the file when it is a quarter full, so the file is not written while measuring unless it is\n"
+          "\t\t\tsmall. The rows that went through it and the waits for free space are reported in stderr. 0 writes the\n"
+          "\t\t\trows from the thread that measures\n"
+          "\t\t <SUMMARY> are: \n"
+          "\t\t\t- raw: One row per descriptor (default) \n"
+          "\t\t\t- stats: One row per point with min, median, p99, p99.9, max, mean, stddev and the 95%% confidence interval of the mean\n"
+          "\t\t <PRECISION> enables the adaptive mode (implies -s stats): batches of <NITERS> descriptors are measured until the\n"
+          "\t\t\thalf width of the 95%% confidence interval is below <PRECISION> times the mean (0.01 = 1%%)\n"
+          "\t\t <MAX_SAMPLES> is the maximum number of descriptors per point in the adaptive mode (default %d)\n"
+          "\t\t <BATCH> is the number of descriptors that are written (and read back) with a single call to the driver.\n"
+          "\t\t\tThe engine processes them back to back and the cache is prepared once per batch (default 1)\n"
+          "\t\t <COMPLETION> is how the driver detects the end of an operation: \n"
+          "\t\t\t- poll: Busy-poll the engine (default) \n"
+          "\t\t\t- irq: Sleep until the interrupt (MSI) of the engine \n"
+          "\t\t\t- hybrid: Busy-poll %d us and then sleep until the interrupt \n"
+          "\t\t <QUEUE_DEPTH> enables the asynchronous mode: up to <QUEUE_DEPTH> descriptors are queued in the engine and\n"
+          "\t\t\tnew ones are submitted while it processes the previous ones. The cache is prepared once per <NITERS>\n"
+          "\t\t <ENGINE_DIRS> enables the concurrent mode: one thread per DMA engine (maximum %d) drives them at the same time.\n"
+          "\t\t\tIt is the list of directions of the engines (R,W measures both directions of the link) and replaces -d.\n"
+          "\t\t\tThe engines start each batch together. The bandwidth test adds the rows of the engine -1: the sum of the\n"
+          "\t\t\tbandwidth of the descriptors started together\n"
+          "\t\t <ACCESS> is how the descriptors reach the device: \n"
+          "\t\t\t- ioctl: Through the driver (default) \n"
+          "\t\t\t- mmap: Written in BAR0 mapped in the process and polled without system calls. Not available with -q\n"
+          "\t\t <CPU_NODE> is the NUMA node whose CPUs run the benchmark: a number, local (the node of the device, default\n"
+          "\t\t\tif it is known), remote (the first node other than the one of the device) or any\n"
+          "\t\t <MEM_NODES> is the NUMA node of the buffer, with the same values than <CPU_NODE> (default local if it is\n"
+          "\t\t\tknown). A list (local,remote) measures the whole matrix with a buffer in each node\n"
+          "\t\t <BACKINGS> is the memory of the buffer. A list (4k,2m,1g) measures the whole matrix with each of them: \n"
+          "\t\t\t- default: A file in /dev/hugepages, with the default huge page size of the system (default) \n"
+          "\t\t\t- 2m, 1g: Anonymous huge pages of that size \n"
+          "\t\t\t- thp: Transparent huge pages (2MB). The pages that the kernel does not collapse are split in 4KB regions\n"
+          "\t\t\t- 4k: The kernel pages of the driver (%d pages of 4KB, -P does not apply) \n"
+          "\t\t <PAGES> is the number of huge pages of the buffer (default %d, 0 takes every free huge page). The buffer size\n"
+          "\t\t\tmust be a power of 2. A descriptor that crosses the end of a page is split by the driver (-x ioctl and -b 1)\n"
+          "\t\t <SUITE> runs a predefined experiment: \n"
+          "\t\t\t- iotlb: Random windows (RAN %luk:%lug unless -p is given) with 4k,2m,1g pages (unless -H is given). Implies\n"
+          "\t\t\t-s stats. The windows that do not fit in a contiguous region of the buffer are skipped. For every series\n"
+          "\t\t\tthe knee (the first window whose median differs more than %.0f%% from the one of the smallest window) is\n"
+          "\t\t\twritten in <KNEEFILE> (default /dev/stderr) with the format of -o\n"
+          "\t\t <MPS> and <MRRS> are the Max Payload Size and the Max Read Request Size programmed in the link before each\n"
+          "\t\t\tpoint (128 to 4096 bytes, default: the values of the driver). The rows report the sizes that the DMA core\n"
+          "\t\t\tuses. The values that the link or the core do not accept are skipped. The values of the driver are restored\n"
+          "\t\t\tat the end\n"
+          "\tSweep mode: <BYTES>, <WINDOW_SIZE>, <DIR>, <CACHE_OPTIONS>, <MEM_NODES>, <MPS> and <MRRS> accept a list of values (64,128,256)\n"
+          "\tor a range start:end[:step] where step is *k (default *2) or +k (8:4096, 1:24:+1).\n"
+          "\t-p can be repeated (-p FIX 0 -p SEQ -p RAN 512m). Every combination is measured without\n"
+          "\tclosing the device.\n",
+          DEFAULT_WARM_FRACTION, CACHE_EVICTION_RATIO, MIN_VERIFIED_LINES * 100, verify_ns_metric, verify_errors_metric, VERIFY_UNIT_SIZE, 1 << HISTOGRAM_SUB_BITS, tlp_metric, DMA_TLP_LOG_ENTRIES, MAX_DMA_DESCRIPTORS - 1, DEFAULT_RESULT_RING / (1024 * 1024), DEFAULT_MAX_SAMPLES, NFP_HYBRID_SPIN_US, MAX_NUM_DMA_ENGINES, MAX_PAGES, DEFAULT_NUMBER_PAGES,
+          MIN_SUITE_WINDOW / 1024, MAX_SUITE_WINDOW / (1024 * 1024 * 1024), KNEE_THRESHOLD * 100);
 }
 
 
@@ -177,6 +425,156 @@ static unsigned long int string2bytes(char *s)
   return size;
 }
 
+/**
+ * @brief Parse a list (a,b,c) or a range (start:end[:step]) of sizes. The step is
+ * either *k (geometric, the default is *2) or +k (arithmetic).
+ *
+ * @return The number of values stored in v, a negative value if the string is not valid.
+ */
+static int string2list(char *s, uint64_t *v, int max)
+{
+  char *saveptr, *tok, *end, *step;
+  uint64_t from, to, inc;
+  int n = 0, geometric;
+
+  for (tok = strtok_r(s, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+    if ((end = strchr(tok, ':')) == NULL) {
+      if (n == max) {
+        return -1;
+      }
+      v[n++] = string2bytes(tok);
+      continue;
+    }
+    *end++ = '\0';
+    from = string2bytes(tok);
+    step = strchr(end, ':');
+    if (step != NULL) {
+      *step++ = '\0';
+    }
+    to = string2bytes(end);
+    geometric = step == NULL || *step == '*';
+    inc = step == NULL ? 2 : string2bytes(step + 1);
+    if ((step != NULL && *step != '*' && *step != '+') || (geometric ? inc < 2 || from == 0 : inc == 0)) {
+      return -1;
+    }
+    for (; from <= to; from = geometric ? from * inc : from + inc) {
+      if (n == max) {
+        return -1;
+      }
+      v[n++] = from;
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Parse a comma separated list of names. The position of the name in names is stored in v.
+ *
+ * @return The number of values stored in v, a negative value if some name is not valid.
+ */
+static int string2names(char *s, const char **names, int nnames, uint8_t *v, int max)
+{
+  char *saveptr, *tok;
+  int n = 0, j;
+
+  for (tok = strtok_r(s, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+    for (j = 0; j < nnames && strcasecmp(tok, names[j]); j++);
+    if (j == nnames || n == max) {
+      return -1;
+    }
+    v[n++] = j;
+  }
+  return n;
+}
+
+/**
+* @brief Parse a list of NUMA nodes (0,1 or local,remote).
+*
+* @return The number of nodes, a negative value if some of them is not valid.
+*/
+static int string2nodes(char *s, int *v, int max)
+{
+  char *saveptr, *tok, *end;
+  int n = 0;
+
+  for (tok = strtok_r(s, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+    if (n == max) {
+      return -1;
+    }
+    if (!strcasecmp(tok, "any")) {
+      v[n] = NODE_ANY;
+    } else if (!strcasecmp(tok, "local")) {
+      v[n] = NODE_LOCAL;
+    } else if (!strcasecmp(tok, "remote")) {
+      v[n] = NODE_REMOTE;
+    } else {
+      v[n] = strtol(tok, &end, 10);
+      if (*end != '\0' || v[n] < 0) {
+        return -1;
+      }
+    }
+    n++;
+  }
+  return n;
+}
+
+/**
+* @brief Translate local/remote to the number of a node.
+*
+* @param node A node or a value of enum numa_node.
+* @param local The node of the device. -1 if it is unknown.
+*
+* @return The node, NODE_ANY or a value lower than NODE_ANY if it cannot be resolved.
+*/
+static int resolveNode(int node, int local)
+{
+  int nodes = hugepage_numa_nodes();
+
+  if (node == NODE_ANY || (node == NODE_AUTO && local < 0)) {
+    return NODE_ANY;
+  }
+  if (node == NODE_AUTO) {
+    return local;
+  }
+  if ((node == NODE_LOCAL || node == NODE_REMOTE) && local < 0) {
+    fprintf(stderr, "The NUMA node of the device is unknown\n");
+    return NODE_LOCAL;
+  }
+  if (node == NODE_LOCAL) {
+    return local;
+  }
+  if (node == NODE_REMOTE) {
+    if (nodes < 2) {
+      fprintf(stderr, "There is no remote NUMA node\n");
+      return NODE_REMOTE;
+    }
+    return local ? 0 : 1;
+  }
+  if (node >= nodes) {
+    fprintf(stderr, "The NUMA node %d does not exist\n", node);
+    return NODE_LOCAL;
+  }
+  return node;
+}
+
+/**
+* @brief Configure a random pattern over a window of the buffer.
+*
+* @return A negative value if the window is empty.
+*/
+static int setRandomWindow(struct pattern_spec *ps, uint64_t window)
+{
+  ps->pat = RAN;
+  ps->prop.pran.nsystempages = (window + PAGE_SIZE - 1) / PAGE_SIZE;
+  ps->prop.pran.cachelines = window / 64;
+  ps->prop.pran.windowsize = window;
+  if (ps->prop.pran.nsystempages == 0) {
+    return -1;
+  }
+  srand(time(NULL));
+  return 0;
+}
+
 /**
 * @brief Get information from user parameters.
 *
@@ -187,24 +585,35 @@ static unsigned long int string2bytes(char *s)
 * @return A negative value indicates en error.
 */
 char default_file[] = {"/dev/stdout"};
+char default_knee_file[] = {"/dev/stderr"};
 static int readArguments (int argc, char **argv, struct arguments *arg)
 {
-  int i;
+  int i, n, npages_set = 0;
+  uint64_t window;
+  uint8_t eviction[3];
+  struct sweep *sw = &arg->sweep;
+  struct pattern_spec *ps;
 
-  if (argc < 2 || argc > 18) {
+  if (argc < 2) {
     return -1;
   }
 
   memset (arg, 0, sizeof (struct arguments));
-  arg->wsize = MAX_WINDOW_SIZE; // Default
-  arg->file_name = default_file;
+  arg->file_name   = default_file;
+  arg->cpu_node    = NODE_AUTO;
+  arg->result_ring = DEFAULT_RESULT_RING;
   for (i = 1; i <= argc - 1; i++) {
+    if (i == argc - 1 && strcmp (argv[i], "-h")) { // Every option has at least one value
+      return -1;
+    }
     if (!strcmp (argv[i], "-t")) {
       i++;
       if (strcmp(argv[i], "lat") == 0) {
         arg->test = LATENCY;
       } else if (strcmp(argv[i], "bw") == 0) {
         arg->test = BANDWIDTH;
+      } else if (strcmp(argv[i], "host") == 0) {
+        arg->test = HOST;
       } else {
         return -1;
       }
@@ -213,53 +622,172 @@ static int readArguments (int argc, char **argv, struct arguments *arg)
       arg->file_name = argv[i];
     } else if (!strcmp (argv[i], "-n")) {
       i++;
-      arg->nbytes = string2bytes(argv[i]);
+      if ((sw->n_nbytes = string2list(argv[i], sw->nbytes, MAX_SWEEP_VALUES)) <= 0) {
+        return -1;
+      }
     } else if (!strcmp (argv[i], "-l")) {
       i++;
       arg->niters = string2bytes(argv[i]);
     } else if (!strcmp (argv[i], "-w")) {
       i++;
-      arg->wsize = string2bytes(argv[i]);
+      if ((sw->n_wsize = string2list(argv[i], sw->wsize, MAX_SWEEP_VALUES)) <= 0) {
+        return -1;
+      }
     } else if (!strcmp (argv[i], "-d")) {
       i++;
-      if (strcmp(argv[i], "RW") == 0 || strcmp(argv[i], "rw") == 0 ) {
-        arg->dir = BOTH;
-      } else if (strcmp(argv[i], "R") == 0 || strcmp(argv[i], "r") == 0 ) {
-        arg->dir = D2H;
-      } else if (strcmp(argv[i], "W") == 0 || strcmp(argv[i], "w") == 0 ) {
-        arg->dir = H2D;
-      } else {
+      if ((sw->n_dir = string2names(argv[i], dir_names, ARRAY_SIZE(dir_names), sw->dir, MAX_SWEEP_VALUES)) <= 0) {
         return -1;
       }
     } else if (!strcmp (argv[i], "-c")) {
       i++;
-      if (strcmp(argv[i], "discard") == 0) {
-        arg->cache = DISCARD;
-      } else if (strcmp(argv[i], "warm") == 0) {
-        arg->cache = WARM;
-      } else if (strcmp(argv[i], "ignore") == 0) {
-        arg->cache = IGNORE;
+      if ((sw->n_cache = string2names(argv[i], cache_names, ARRAY_SIZE(cache_names), sw->cache, MAX_SWEEP_VALUES)) <= 0) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-s")) {
+      i++;
+      if (string2names(argv[i], summary_names, ARRAY_SIZE(summary_names), &arg->summary, 1) != 1) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-a")) {
+      i++;
+      arg->precision = atof(argv[i]);
+      if (arg->precision <= 0) {
+        return -1;
+      }
+      arg->summary = STATS;
+    } else if (!strcmp (argv[i], "-i")) {
+      i++;
+      if (string2names(argv[i], completion_names, ARRAY_SIZE(completion_names), &arg->completion, 1) != 1) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-q")) {
+      i++;
+      arg->queue = string2bytes(argv[i]);
+      if (arg->queue >= MAX_DMA_DESCRIPTORS) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-e")) {
+      i++;
+      if ((arg->nengines = string2names(argv[i], dir_names, ARRAY_SIZE(dir_names), arg->engine_dir, MAX_NUM_DMA_ENGINES)) <= 0) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-x")) {
+      i++;
+      if (string2names(argv[i], access_names, ARRAY_SIZE(access_names), &arg->access, 1) != 1) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-o")) {
+      i++;
+      if (string2names(argv[i], format_names, ARRAY_SIZE(format_names), &arg->format, 1) != 1) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-C")) {
+      i++;
+      if (string2nodes(argv[i], &arg->cpu_node, 1) != 1) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-N")) {
+      i++;
+      if ((sw->n_mem_node = string2nodes(argv[i], sw->mem_node, MAX_SWEEP_VALUES)) <= 0) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-H")) {
+      i++;
+      if ((sw->n_backing = string2names(argv[i], backing_names, ARRAY_SIZE(backing_names), sw->backing, MAX_SWEEP_VALUES)) <= 0) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-E")) {
+      i++;
+      if ((n = string2names(argv[i], eviction_names, ARRAY_SIZE(eviction_names), eviction, ARRAY_SIZE(eviction))) <= 0) {
+        return -1;
+      }
+      while (n--) {
+        if (eviction[n] == 2) {
+          arg->verify_cache = 1;
+        } else {
+          arg->eviction |= eviction[n] ? CACHE_EVICT : CACHE_FLUSH;
+        }
+      }
+    } else if (!strcmp (argv[i], "-F")) {
+      i++;
+      arg->warm_fraction = atof(argv[i]);
+      if (arg->warm_fraction <= 0 || arg->warm_fraction >= 1) {
+        fprintf(stderr, "The fraction of warmed lines must be between 0 and 1\n");
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-V")) {
+      i++;
+      arg->verify_data = 1;
+      arg->verify_seed = string2bytes(argv[i]);
+    } else if (!strcmp (argv[i], "-L")) {
+      i++;
+      arg->tlp_file_name = argv[i];
+    } else if (!strcmp (argv[i], "-B")) {
+      i++;
+      arg->result_ring = string2bytes(argv[i]);
+    } else if (!strcmp (argv[i], "-T")) {
+      i++;
+      n = strlen(argv[i]);
+      if (n > 1 && argv[i][n - 1] == 's') {
+        arg->budget_ns = atof(argv[i]) * 1e9;
       } else {
+        arg->budget_bytes = string2bytes(argv[i]);
+      }
+      if (arg->budget_ns == 0 && arg->budget_bytes == 0) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-S")) {
+      i++;
+      if (string2names(argv[i], suite_names, ARRAY_SIZE(suite_names), &arg->suite, 1) != 1) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-K")) {
+      i++;
+      arg->knee_file_name = argv[i];
+    } else if (!strcmp (argv[i], "-P")) {
+      i++;
+      arg->npages = string2bytes(argv[i]);
+      npages_set  = 1;
+    } else if (!strcmp (argv[i], "-b")) {
+      i++;
+      arg->batch = string2bytes(argv[i]);
+    } else if (!strcmp (argv[i], "-m")) {
+      i++;
+      arg->max_samples = string2bytes(argv[i]);
+    } else if (!strcmp (argv[i], "-M")) {
+      i++;
+      if ((sw->n_max_payload = string2list(argv[i], sw->max_payload, MAX_SWEEP_VALUES)) <= 0) {
+        return -1;
+      }
+    } else if (!strcmp (argv[i], "-R")) {
+      i++;
+      if ((sw->n_max_read_request = string2list(argv[i], sw->max_read_request, MAX_SWEEP_VALUES)) <= 0) {
         return -1;
       }
     } else if (!strcmp (argv[i], "-p")) {
       i++;
+      if (sw->n_pat == MAX_SWEEP_VALUES) {
+        return -1;
+      }
+      ps = &sw->pat[sw->n_pat++];
       if (strcmp(argv[i], "SEQ") == 0) {
-        arg->pat = SEQ;
-      } else if (strcmp(argv[i], "FIX") == 0) {
-        arg->pat = FIX;
+        ps->pat = SEQ;
+      } else if (strcmp(argv[i], "FIX") == 0 && i < argc - 1) {
+        ps->pat = FIX;
         i++;
-        arg->prop.pfix.initial_offset = string2bytes(argv[i]);;
-      } else if (strcmp(argv[i], "RAN") == 0) {
-        arg->pat = RAN;
+        ps->prop.pfix.initial_offset = string2bytes(argv[i]);;
+      } else if (strcmp(argv[i], "RAN") == 0 && i < argc - 1) {
+        i++;
+        if (setRandomWindow(ps, string2bytes(argv[i]))) {
+          return -1;
+        }
+      } else if (strcmp(argv[i], "SG") == 0 && i < argc - 1) {
+        ps->pat = SG;
         i++;
-        arg->prop.pran.nsystempages = (string2bytes(argv[i]) + PAGE_SIZE - 1) / PAGE_SIZE;
-        arg->prop.pran.cachelines = string2bytes(argv[i]) / 64;
-        arg->prop.pran.windowsize = string2bytes(argv[i]);
-        if (arg->prop.pran.nsystempages == 0) {
+        ps->prop.psg.count = string2bytes(argv[i]);
+        if (ps->prop.psg.count == 0 || ps->prop.psg.count > UINT32_MAX) {
           return -1;
         }
-        srand(time(NULL));
       } else {
         return -1;
       }
@@ -267,221 +795,1524 @@ static int readArguments (int argc, char **argv, struct arguments *arg)
       return -1;
     }
   }
-  if (arg->wsize > MAX_WINDOW_SIZE || arg->wsize < 1)  {
-    fprintf(stderr, "niter is greater or equal than the total number of descriptors\n");
+
+  if (arg->nengines && sw->n_dir) {
+    fprintf(stderr, "-d and -e cannot be combined\n");
     return -1;
   }
-
-  if (arg->nbytes % 4)  {
-    fprintf(stderr, "nbytes is not a multiple of 4\n");
+  if (arg->access == MMAP && arg->queue) {
+    fprintf(stderr, "-x mmap and -q cannot be combined\n");
     return -1;
   }
-  if (arg->niters >= MAX_DMA_DESCRIPTORS || arg->niters <= 0 )  {
-    fprintf(stderr, "niter is greater or equal than the total number of descriptors\n");
+  if (arg->verify_data && arg->nengines > 1) {
+    fprintf(stderr, "-V and -e cannot be combined: the engines share the buffer\n");
     return -1;
   }
-  return 0;
-}
-
-/*
- * Before starting a test we aim thrash the cache by randomly
- * writing to elements in a 64MB large array.
- */
-static void thrash_cache(void)
-{
-  uint64_t i, r;
-  for (i = 0; i < 4 * ARRAY_SIZE(large_array); i++) {
-    r = rand();
-    large_array[r % ARRAY_SIZE(large_array)] = (uint64_t)i * r;
+  if ((arg->budget_ns || arg->budget_bytes) && (arg->nengines || arg->precision > 0 || arg->access == MMAP || arg->verify_data || arg->tlp_file_name)) {
+    fprintf(stderr, "-T cannot be combined with -e, -a, -x mmap, -V or -L\n");
+    return -1;
   }
-}
 
-/* Warm the host buffers for a given window size. The window size is
- * rounded up to the nearest full page. */
-static void warm_cache(uint64_t *pmem, uint64_t total_size)
-{
-  uint64_t i;
-  for (i = 0; i < 4 * total_size; i++) {
-    pmem[i % (total_size / sizeof(uint64_t))] = (uint64_t)i;
+  // The axes of a suite that were not specified
+  if (arg->suite == IOTLB) {
+    if (sw->n_pat == 0) {
+      for (window = MIN_SUITE_WINDOW; window <= MAX_SUITE_WINDOW; window *= 2) {
+        setRandomWindow(&sw->pat[sw->n_pat++], window);
+      }
+    }
+    if (sw->n_backing == 0) {
+      sw->backing[sw->n_backing++] = BACKING_KERNEL_PAGES;
+      sw->backing[sw->n_backing++] = HUGEPAGE_2M;
+      sw->backing[sw->n_backing++] = HUGEPAGE_1G;
+    }
+    arg->summary = STATS;
   }
-}
 
-struct dma_descriptor_sw dlist [MAX_DMA_DESCRIPTORS];
-int main(int argc, char **argv)
-{
-  void *pmem;
-  struct arguments args;
-  int i, j;
-  char success;
-  uint64_t total_size;
-  uint64_t total_bytes;
-  int maximum_size_per_tlp;
-  int n_total_tlps;
-  int n_complete_tlps;
-  int n_incomplete_tlps;
-  FILE* fname;
+  // Default values of the axes that were not specified
+  if (sw->n_wsize == 0) {
+    sw->wsize[sw->n_wsize++] = MAX_WINDOW_SIZE;
+  }
+  if (sw->n_nbytes == 0) {
+    sw->nbytes[sw->n_nbytes++] = 0;
+  }
+  if (sw->n_dir == 0) {
+    sw->dir[sw->n_dir++] = D2H;
+  }
+  if (sw->n_cache == 0) {
+    sw->cache[sw->n_cache++] = IGNORE;
+  }
+  if (sw->n_pat == 0) {
+    sw->pat[sw->n_pat++].pat = FIX;
+  }
+  if (sw->n_mem_node == 0) {
+    sw->mem_node[sw->n_mem_node++] = NODE_AUTO;
+  }
+  if (arg->knee_file_name == NULL) {
+    arg->knee_file_name = default_knee_file;
+  }
+  if (sw->n_backing == 0) {
+    sw->backing[sw->n_backing++] = HUGEPAGE_DEFAULT;
+  }
+  if (sw->n_max_payload == 0) {
+    sw->max_payload[sw->n_max_payload++] = 0;
+  }
+  if (sw->n_max_read_request == 0) {
+    sw->max_read_request[sw->n_max_read_request++] = 0;
+  }
+  if (!npages_set) {
+    arg->npages = DEFAULT_NUMBER_PAGES;
+  }
+  if (arg->eviction == 0) {
+    arg->eviction = CACHE_FLUSH;
+  }
+  if (arg->warm_fraction == 0) {
+    arg->warm_fraction = DEFAULT_WARM_FRACTION;
+  }
 
-  if (readArguments (argc, argv, &args)) {
-    printUsage();
-    return 0;
+  for (i = 0; i < sw->n_wsize; i++) {
+    if (sw->wsize[i] > MAX_WINDOW_SIZE || sw->wsize[i] < 1)  {
+      fprintf(stderr, "The window size must be a value between 1 and %d\n", MAX_WINDOW_SIZE);
+      return -1;
+    }
   }
 
-  /* Initialize the driver */
-  if (fpgaInit (argc, argv) < 0) {
-    fpgaExit (-1, "There was an error");
+  for (i = 0; i < sw->n_nbytes; i++) {
+    if (sw->nbytes[i] % 4)  {
+      fprintf(stderr, "nbytes is not a multiple of 4\n");
+      return -1;
+    }
+  }
+  if ((arg->niters >= MAX_DMA_DESCRIPTORS && arg->budget_ns == 0 && arg->budget_bytes == 0) || arg->niters <= 0 )  {
+    fprintf(stderr, "niter is greater or equal than the total number of descriptors\n");
+    return -1;
+  }
+  if ((arg->budget_ns || arg->budget_bytes) && arg->queue == 0) {
+    arg->queue = MAX_DMA_DESCRIPTORS - 1;
   }
+  if (arg->batch == 0) {
+    arg->batch = 1;
+  }
+  if (arg->batch > arg->niters) {
+    fprintf(stderr, "The batch is greater than the number of iterations\n");
+    return -1;
+  }
+  if (arg->max_samples == 0) {
+    arg->max_samples = DEFAULT_MAX_SAMPLES;
+  }
+  if (arg->max_samples < arg->niters && arg->budget_ns == 0 && arg->budget_bytes == 0) {
+    fprintf(stderr, "The maximum number of samples is lower than the number of iterations\n");
+    return -1;
+  }
+  return 0;
+}
 
+/**
+* @brief Number of points of the test matrix.
+*/
+static int sweepPoints (struct sweep *sw)
+{
+  return sw->n_nbytes * sw->n_wsize * sw->n_dir * sw->n_cache * sw->n_pat * sw->n_mem_node * sw->n_backing *
+         sw->n_max_payload * sw->n_max_read_request;
+}
 
-#ifdef USE_HUGE_PAGES
-  pmem = getFreeHugePages(NUMBER_PAGES);
-  total_size = NUMBER_PAGES ? NUMBER_PAGES * hugepage_size() : hugepage_number() * hugepage_size();
-#else
-  pmem = getFreePages(NUMBER_PAGES); // Get a buffer in kernel space (NPAGES*PAGE_SIZE = NPAGES*1GB)
-  total_size = NUMBER_PAGES * KERNEL_PAGE_SIZE;
-#endif
-  if (pmem == NULL) {
-    printf(  "[MEMORY]     No free pages\n");
-    fpgaExit (-1, "Error mapping kernel memory\n");
-  }
+/**
+* @brief Measurement of a DMA engine. Each engine advances through its own descriptor table and,
+* in the concurrent mode, it is driven by its own thread.
+*/
+struct engine_run {
+  uint8_t                  engine;
+  struct arguments         args;            /**< The point. args.dir is the direction of this engine */
+  struct dma_descriptor_sw model;           /**< The descriptor that is replicated */
+  void                    *pmem;            /**< The registered buffer */
+  int                      next_descriptor; /**< The driver and the core advance through the descriptor table across the points of a sweep */
+  struct dma_descriptor_sw dlist[MAX_DMA_DESCRIPTORS];
+  struct dma_descriptor_sw rlist[MAX_DMA_DESCRIPTORS]; /**< Descriptors reaped in the asynchronous mode */
+  int                      indexes[MAX_DMA_DESCRIPTORS]; /**< Position in the ring of each descriptor of the round */
+  double                   values[MAX_DMA_DESCRIPTORS];  /**< Metric of each descriptor of the round */
+  struct dma_descriptor_sw status[MAX_DMA_DESCRIPTORS];  /**< [STATUS] fields of each descriptor of the round */
+  struct statistics        st;              /**< Samples of the point */
+  int                      error;
+  struct statistics        verify_st;       /**< -V: time to fill and check the buffer of each set of descriptors */
+  struct statistics        verify_errors;   /**< -V: wrong units of each set of descriptors */
+  uint64_t                 verify_sets;     /**< -V: sets of descriptors checked since the start. It selects the pattern */
+  uint64_t                 verify_units;    /**< -V: units checked in the point */
+  uint64_t                 first_error;     /**< -V: offset of the first wrong unit of the point. Valid if verify_errors has a non-zero sample */
+  uint8_t                  tlp_log;         /**< -L: the log of the engine is enabled for the point */
+  uint32_t                 tlp_shift;       /**< -L: one of every 2^tlp_shift memory read requests is recorded */
+  uint64_t                 tlp_tail;        /**< -L: entries of the log already read */
+  uint64_t                 tlp_lost;        /**< -L: entries of the point overwritten by the device before they were read */
+  struct histogram         tlp_hist;        /**< -L: latency of the memory read requests of the point, in cycles */
+  uint32_t                 tlp_entries[DMA_TLP_LOG_ENTRIES];
+  uint64_t                 run_descriptors; /**< -T: descriptors completed in the point */
+  uint64_t                 run_ns;          /**< -T: time since the first submission until the last completion */
+  uint64_t                 run_dry;         /**< -T: reaps that found every submitted descriptor completed (the engine waited for the host) */
+  struct sg_list           sg;              /**< -p SG: the buffers walked by the descriptors */
+  uint64_t                 sg_next;         /**< -p SG: entry of the next descriptor */
+  uint64_t                 sg_set;          /**< -p SG: entry of the first descriptor of the set in process */
+};
 
+/**
+* @brief IOTLB suite: median of a point measured with the buffer in use.
+*/
+struct suite_point {
+  uint8_t  dir;
+  uint8_t  cache;
+  uint64_t wsize;
+  uint64_t nbytes;
+  uint64_t window;
+  double   value;
+};
 
-  fname = fopen(args.file_name, "a+");
+static struct engine_run engines[MAX_NUM_DMA_ENGINES];
+static struct suite_point *suite_points; /**< IOTLB suite: the points measured with the buffer in use */
+static int                 suite_n;
+static struct statistics aggregate;   /**< Concurrent bandwidth test: sum of the engines */
+static struct cache_control cache_ctrl; /**< -c discard */
+static struct result_writer tlp_out;    /**< -L */
+static pthread_barrier_t start_batch; /**< Concurrent mode: the engines start each batch together */
+static int               failed_points; /**< Points of the matrix that could not be measured: the exit status is not 0 */
 
-  setWindowSize(args.wsize);
-  dlist[0].address = 0;
+/**
+* @brief Largest TLP of the descriptors of a point with its link sizes: the writes (C2S)
+* are split by MPS and the read requests (S2C) by MRRS. It only depends on the direction
+* because a reaped descriptor does not carry is_c2s_op.
+*/
+static uint64_t tlpSize(struct arguments *args)
+{
+  return args->dir == D2H || args->dir == BOTH ? args->max_payload : args->max_read_request;
+}
 
-  if (args.test == BANDWIDTH) {
-    fprintf(stderr, "pattern,descriptor,size,bandwidth_gbps\n");
-  } else {
-    fprintf(stderr, "pattern,descriptor,size,latency_ns\n");
-  }
-
-  /* Main loop. Initialize the descriptors, configure the FPGA and gather the information from the descriptors */
-  for (i = 0, j = 0; j < args.niters; i++, j++) {
-    dlist[i].length        = args.nbytes;
-    dlist[i].is_c2s_op     = args.dir == D2H || args.dir == BOTH;
-    dlist[i].is_s2c_op     = args.dir == H2D || args.dir == BOTH;
-    dlist[i].index         = i;
-    dlist[i].enable        = 1;
-    dlist[i].address       = 0; // The addresses are managed by the hardware
-    dlist[i].buffer_size   = total_size;
-    dlist[i].address_offset    = 0;
-    dlist[i].address_inc       = 0;
-
-    if (args.test == BANDWIDTH)
-      dlist[i].number_of_tlps = DEFAULT_NUMBER_TLPS;
-    else {
-      if (args.dir == H2D)
-        dlist[i].number_of_tlps = ceil(dlist[i].length / MAX_READ_REQUEST_SIZE);
-      else if (args.dir == BOTH)
-        dlist[i].number_of_tlps = ceil(dlist[i].length / MAX_PAYLOAD);
-      else {
-        fprintf(stderr, "[ERROR] No Latency test available\n");
-        return -1;
-      }
-    }
-    success = 1;
+/**
+* @brief Fill the fields of a descriptor that are common to every iteration of a point and
+* check that the point can be measured.
+*
+* @param args The configuration of the point.
+* @param total_size The size of the registered buffer.
+* @param d The descriptor. Everything but the index is written.
+*
+* @return A negative value if the configuration is not valid.
+*/
+static int prepareDescriptor(struct arguments *args, uint64_t total_size, struct dma_descriptor_sw *d)
+{
+  char success = 1;
+  uint64_t check_limit = 1;
+  uint64_t maximum_size_per_tlp;
 
-    /*
-      Given the number of total TLPs compute the number of complete and incomplete TLPs in a concrete transference.
-      Useful for the bandwidth computation
-    */
-    maximum_size_per_tlp = args.dir == D2H || args.dir == BOTH ? MAX_PAYLOAD : MAX_READ_REQUEST_SIZE;
-    n_total_tlps      = dlist[i].number_of_tlps;
-    n_complete_tlps   = args.nbytes / maximum_size_per_tlp;
-    n_incomplete_tlps = args.nbytes != maximum_size_per_tlp * n_complete_tlps ? 1 : 0;
+  d->length         = args->nbytes;
+  d->is_c2s_op      = args->dir == D2H || args->dir == BOTH;
+  d->is_s2c_op      = args->dir == H2D || args->dir == BOTH;
+  d->enable         = 1;
+  d->address        = 0; // The addresses are managed by the hardware
+  d->buffer_size    = total_size;
+  d->address_offset = 0;
+  d->address_inc    = 0;
 
+  if (args->test == BANDWIDTH)
+    d->number_of_tlps = DEFAULT_NUMBER_TLPS;
+  else {
+    // Integer division: a request shorter than MPS/MRRS still takes one TLP
+    if (args->dir == H2D || args->dir == BOTH || args->test == HOST) {
+      maximum_size_per_tlp = tlpSize(args);
+      d->number_of_tlps    = (d->length + maximum_size_per_tlp - 1) / maximum_size_per_tlp;
+    } else {
+      fprintf(stderr, "[ERROR] No Latency test available\n");
+      return -1;
+    }
+  }
 
-    if (dlist[i].length >= dlist[i].buffer_size) {
-      fprintf(fname, "[ERROR] The request size is greater than the buffer size\n");
+  if (d->length >= d->buffer_size) {
+    fprintf(stderr, "[ERROR] The request size is greater than the buffer size\n");
+    success = 0;
+  }
+  switch (args->pat) {
+  case FIX:
+    d->address_mode   = 0;
+    d->address_offset = args->prop.pfix.initial_offset;
+    if (args->prop.pfix.initial_offset / PAGE_SIZE != (args->prop.pfix.initial_offset + d->length) / 4096 && args->prop.pfix.initial_offset != 0) {
+      fprintf(stderr, "[ERROR] The request is not contained in one system page. This violates the specification\n"); // The condition is too restrictive.
       success = 0;
     }
-    switch (args.pat) {
-    case FIX:
-      dlist[i].address_mode   = 0;
-      dlist[i].address_offset = args.prop.pfix.initial_offset;
-      if (args.prop.pfix.initial_offset / PAGE_SIZE != (args.prop.pfix.initial_offset + dlist[i].length) / 4096 && args.prop.pfix.initial_offset != 0) {
-        fprintf(fname, "[ERROR] The request is not contained in one system page. This violates the specification\n"); // The condition is too restrictive.
-        success = 0;
-      } else {
-        fprintf(fname, "FIX,");
-      }
-      break;
-    case SEQ:
-      dlist[i].address_mode   = 1;
-      dlist[i].address_offset = 0;
+    break;
+  case SEQ:
+    d->address_mode   = 1;
+    d->address_offset = 0;
 
-      if (dlist[i].length * dlist[i].number_of_tlps >= dlist[i].buffer_size) {
-        fprintf(fname, "[ERROR] The number of requested TLPs will exceed the buffer size\n");
-        success = 0;
-      } else {
-        fprintf(fname, "SEQ,");
-      }
-      break;
-    case RAN:
-      dlist[i].address_mode   = 3;
-      dlist[i].address_offset = 0;
-      dlist[i].address_inc    = args.prop.pran.cachelines;
-      dlist[i].buffer_size    = args.prop.pran.windowsize;
-      fprintf(fname, "RAN,");
-      break;
-    default:
-      fprintf(fname, "Pattern not implemented\n");
+    if (d->length * d->number_of_tlps >= d->buffer_size) {
+      fprintf(stderr, "[ERROR] The number of requested TLPs will exceed the buffer size\n");
+      success = 0;
+    }
+    break;
+  case RAN:
+    d->address_mode   = 3;
+    d->address_offset = 0;
+    d->address_inc    = args->prop.pran.cachelines;
+    d->buffer_size    = args->prop.pran.windowsize;
+    break;
+  case SG:
+    // One block per descriptor at the address of its buffer: the fixed generator without offset.
+    // The size is the alignment of the buffers (see sg_list_strided), so the mapping of the huge
+    // page that holds a buffer is reused
+    d->address_mode   = 0;
+    d->address_offset = 0;
+    maximum_size_per_tlp = tlpSize(args);
+    d->number_of_tlps = (d->length + maximum_size_per_tlp - 1) / maximum_size_per_tlp;
+    for (d->buffer_size = SG_LIST_MIN_ALIGN; d->buffer_size < d->length; d->buffer_size *= 2);
+    if (d->buffer_size * args->prop.psg.count > total_size) {
+      fprintf(stderr, "[ERROR] %lu buffers of %lu bytes do not fit in the buffer\n", args->prop.psg.count, args->nbytes);
       success = 0;
-      break;
     }
+    break;
+  default:
+    fprintf(stderr, "Pattern not implemented\n");
+    success = 0;
+    break;
+  }
+
+  while (check_limit < d->buffer_size) {
+    check_limit *= 2;
+  }
+  if (check_limit != d->buffer_size) {
+    fprintf(stderr, "[ERROR] The buffer size must be a power of 2\n");
+    success = 0;
+  }
+  return success ? 0 : -1;
+}
+
+/**
+* @brief Print in stderr the time that the driver needed to pin and to release the buffer of
+* huge pages, which is paid at the start and at the end of every run.
+*/
+static void reportRegistration(void)
+{
+  struct buffer_registration br;
+
+  getBufferRegistration(&br);
+  fprintf(stderr, "[MEMORY] %lu bytes in %u huge pages: registered in %.3f ms, unregistered in %.3f ms\n",
+          br.bytes, br.hugepages, br.register_ns / 1e6, br.unregister_ns / 1e6);
+}
+
+/**
+* @brief Monotonic time of the host in ns.
+*/
+static uint64_t getTimeNs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/**
+* @brief Lines of the buffer that the core accesses with a descriptor, given by the copy of its
+* address generators (middleware/address_gen.h). With RAN, every block of the window that the
+* generator can choose: its LFSR advances every clock cycle, so the blocks of a descriptor
+* cannot be predicted from the host.
+*
+* With SG, the buffers of the list walked by the n descriptors of the set.
+*
+* @param n Descriptors of the set.
+* @param e At least ADDRESS_GEN_MAX_FOOTPRINT extents.
+*
+* @return The number of extents.
+*/
+static int deviceExtents(struct engine_run *er, struct dma_descriptor_sw *d, uint64_t n, struct cache_extent *e)
+{
+  struct arguments *args = &er->args;
+  struct address_gen_params p;
+  struct address_gen_range r[ADDRESS_GEN_MAX_FOOTPRINT];
+  uint64_t first;
+  int i;
 
-    uint64_t check_limit = 1;
-    while (check_limit < dlist[i].buffer_size) {
-      check_limit *= 2;
+  if (args->pat == SG) {
+    // The list wraps around at most once: the rest of the descriptors repeat its buffers
+    first = er->sg_set % er->sg.count;
+    n     = n < er->sg.count ? n : er->sg.count;
+    e[0].offset = er->sg.entry[first].offset;
+    e[0].length = er->sg.length;
+    e[0].stride = er->sg.stride;
+    e[0].count  = first + n <= er->sg.count ? n : er->sg.count - first;
+    if (e[0].count == n) {
+      return 1;
     }
-    if (check_limit != dlist[i].buffer_size) {
-      fprintf(fname, "[ERROR] The buffer size must be a power of 2\n");
-      success = 0;
+    e[1].offset = er->sg.entry[0].offset;
+    e[1].length = er->sg.length;
+    e[1].stride = er->sg.stride;
+    e[1].count  = n - e[0].count;
+    return 2;
+  }
+
+  p.base           = d->address;
+  p.size           = d->length;
+  p.host_size      = d->buffer_size;
+  p.offset         = d->address_offset;
+  p.number_of_tlps = d->number_of_tlps;
+  p.max_tlp        = tlpSize(args);
+  p.mode           = d->address_mode;
+  n = address_gen_footprint(&p, r);
+  for (i = 0; i < (int)n; i++) {
+    e[i].offset = d->address + r[i].offset;
+    e[i].length = r[i].length;
+    e[i].stride = r[i].stride;
+    e[i].count  = r[i].count;
+    if (e[i].offset + e[i].length > d->buffer_size) {
+      e[i].length = e[i].offset < d->buffer_size ? d->buffer_size - e[i].offset : 0;
     }
+  }
+  return n;
+}
 
-    if (!success) {
-      fprintf(stderr, "An error was detected\n");
-      break;
-    } else {
-      fprintf(fname, "%d,%ld", i, args.nbytes);
-      switch (args.cache) {
-      case WARM:
-        if (args.pat != RAN) {
-          warm_cache((uint64_t *)((uint8_t *)pmem + (uint64_t)((dlist[i].address >> 2) << 2)), args.nbytes);
-        } else {
-          warm_cache((uint64_t *)((uint8_t *)pmem), args.prop.pran.windowsize);
-        }
-        break;
-      case DISCARD:
-        thrash_cache();
+/**
+* @brief Prepare the cache as requested by the user before a set of descriptors.
+*/
+static void prepareCache(struct engine_run *er, struct dma_descriptor_sw *d, uint64_t n)
+{
+  struct arguments *args = &er->args;
+  struct cache_extent e[ADDRESS_GEN_MAX_FOOTPRINT];
+  double fraction, verified;
+  int ne;
+
+  if (args->cache == IGNORE) {
+    return;
+  }
+  ne       = deviceExtents(er, d, n, e);
+  fraction = args->cache == WARM ? 1 : args->cache == DISCARD ? 0 : args->warm_fraction;
+  cachePrepare(&cache_ctrl, er->pmem, e, ne, fraction);
+  if (args->verify_cache && (verified = cacheVerify(&cache_ctrl, er->pmem, e, ne, fraction)) < MIN_VERIFIED_LINES) {
+    fprintf(stderr, "[WARNING] Only %.0f%% of the sampled lines of the buffer are in the requested state (%s)\n",
+            verified * 100, cache_names[args->cache]);
+  }
+}
+
+/**
+* @brief -V: fill the lines that the core will access with the pattern of the next set of
+* descriptors. It is done before the cache is prepared, so it does not change its state.
+*
+* @return The time spent in ns.
+*/
+static uint64_t fillData(struct engine_run *er, struct dma_descriptor_sw *d, uint64_t n)
+{
+  struct cache_extent e[ADDRESS_GEN_MAX_FOOTPRINT];
+  uint64_t ns = getTimeNs();
+
+  verifyFill(er->pmem, e, deviceExtents(er, d, n, e), er->args.verify_seed + er->verify_sets);
+  return getTimeNs() - ns;
+}
+
+/**
+* @brief -V: check the data of the lines accessed by a set of descriptors, once all of them have
+* been completed. The core only reads the buffer with W, so the pattern must be intact. With R and
+* RW the application stamps every unit that the core writes: all the lines of FIX and SEQ, and
+* some blocks of the window of RAN (at least one).
+*
+* @param fill_ns Time spent by fillData. The time of the set is added to er->verify_st.
+*/
+static void checkData(struct engine_run *er, struct dma_descriptor_sw *d, uint64_t n, uint64_t fill_ns)
+{
+  struct cache_extent e[ADDRESS_GEN_MAX_FOOTPRINT];
+  struct verify_result r;
+  uint64_t ns = getTimeNs();
+  int expect = !d->is_c2s_op ? VERIFY_PATTERN : er->args.pat == RAN ? VERIFY_PATTERN_OR_STAMP : VERIFY_STAMP;
+
+  verifyCheck(er->pmem, e, deviceExtents(er, d, n, e), er->args.verify_seed + er->verify_sets, expect, &r);
+  ns = getTimeNs() - ns;
+
+  if (expect == VERIFY_PATTERN_OR_STAMP && r.stamps == 0) { // The core did not write any of the blocks
+    r.errors      = r.units;
+    r.first_error = e[0].offset;
+  }
+  if (r.errors && er->verify_errors.sum == 0) {
+    er->first_error = r.first_error;
+  }
+  statsAdd(&er->verify_st, fill_ns + ns);
+  statsAdd(&er->verify_errors, r.errors);
+  er->verify_units += r.units;
+  er->verify_sets++;
+}
+
+/**
+* @brief Write n descriptors of the point in er->dlist: copies of er->model or, with SG, the
+* buffers of the list from the descriptor first of the set in process.
+*/
+static void fillDescriptors(struct engine_run *er, uint64_t first, int n)
+{
+  int k;
+
+  if (er->args.pat == SG) {
+    sg_list_descriptors(&er->sg, er->sg_set + first, &er->model, er->dlist, n);
+    return;
+  }
+  for (k = 0; k < n; k++) {
+    er->dlist[k] = er->model;
+  }
+}
+
+/**
+* @brief -L: start the per-TLP latency log of an engine for a point. The memory read requests of
+* a set of descriptors are sampled so that they fit in the log: the entries are only read after
+* the set, out of the timed region.
+*/
+static void startTlpLog(struct engine_run *er)
+{
+  uint64_t requests = er->model.number_of_tlps * (er->args.queue ? er->args.niters : er->args.batch);
+
+  histogramReset(&er->tlp_hist);
+  er->tlp_tail = 0;
+  er->tlp_lost = 0;
+  for (er->tlp_shift = 0; er->tlp_shift < 31 && ((requests + (1UL << er->tlp_shift) - 1) >> er->tlp_shift) > DMA_TLP_LOG_ENTRIES; er->tlp_shift++);
+  if (setTlpLog(er->engine, 1, er->tlp_shift)) {
+    fprintf(stderr, "[WARNING] The per-TLP latency log of the engine %d is not available\n", er->engine);
+    er->tlp_log = 0;
+  }
+}
+
+/**
+* @brief -L: add the entries of the log recorded since the last call to the histogram.
+*/
+static void drainTlpLog(struct engine_run *er)
+{
+  uint64_t lost;
+  uint32_t k, n;
+
+  do {
+    n = readTlpLog(er->engine, er->tlp_entries, DMA_TLP_LOG_ENTRIES, &er->tlp_tail, &lost);
+    er->tlp_lost += lost;
+    for (k = 0; k < n; k++) {
+      histogramAdd(&er->tlp_hist, er->tlp_entries[k]);
+    }
+  } while (n == DMA_TLP_LOG_ENTRIES);
+}
+
+/**
+* @brief Bytes moved by a descriptor of the point.
+*/
+static uint64_t descriptorBytes(struct arguments *args, struct dma_descriptor_sw *d)
+{
+  uint64_t maximum_size_per_tlp;
+  uint64_t n_total_tlps;
+  uint64_t n_complete_tlps;
+  uint64_t n_incomplete_tlps;
+
+  /*
+    Given the number of total TLPs compute the number of complete and incomplete TLPs in a concrete transference.
+    Useful for the bandwidth computation
+  */
+  maximum_size_per_tlp = tlpSize(args);
+  n_total_tlps      = d->number_of_tlps;
+  n_complete_tlps   = args->nbytes / maximum_size_per_tlp;
+  n_incomplete_tlps = args->nbytes != maximum_size_per_tlp * n_complete_tlps ? 1 : 0;
+
+  return n_total_tlps / (n_complete_tlps + n_incomplete_tlps) * args->nbytes + (n_total_tlps % (n_complete_tlps + n_incomplete_tlps)) * maximum_size_per_tlp;
+}
+
+/**
+* @brief Compute the metric of the test from the [STATUS] fields of a descriptor.
+*
+* @param host_ns Time seen by the host for the descriptor (host test).
+*
+* @return The bandwidth in Gbps or the latency in ns.
+*/
+static double descriptorMetric(struct arguments *args, struct dma_descriptor_sw *d, double host_ns)
+{
+  uint64_t total_bytes = descriptorBytes(args, d);
+
+  if (args->test == BANDWIDTH) {
+    return (total_bytes) * 8.0 / (d->latency * 4);
+  } else if (args->test == HOST) {
+    return host_ns;
+  } else {
+    return d->time_at_comp * 4;
+  }
+}
+
+/**
+* @brief Prepare the cache, process n consecutive descriptors and compute the metric of the
+* test for each of them. A single descriptor uses the per-descriptor IOCTLs and a batch the
+* vectored ones, so the engine processes the batch back to back.
+*
+* @param er The engine. The descriptors are in er->dlist and only the last one should have enable set.
+* @param n Number of descriptors.
+* @param values Where the bandwidth in Gbps or the latency in ns of each descriptor is stored.
+* For the host test every descriptor of a batch gets the time of the batch divided by n.
+* @param status Where the descriptors are copied once their [STATUS] fields have been read.
+*/
+static void measureDescriptors(struct engine_run *er, int n, double *values, struct dma_descriptor_sw *status)
+{
+  struct dma_descriptor_sw *d = er->dlist;
+  int k;
+  uint64_t host_ns, fill_ns = 0;
+
+  if (er->args.verify_data) {
+    fill_ns = fillData(er, d, n);
+  }
+  prepareCache(er, d, n);
+
+  host_ns = getTimeNs();
+  if (er->args.access == MMAP) {
+    for (k = 0; k < n; k++) {
+      directWriteDescriptor(&d[k]);
+    }
+  } else if (n == 1) {
+    writeDescriptor(d);
+  } else {
+    writeDescriptors(d, n, er->engine);
+  }
+  host_ns = getTimeNs() - host_ns;
+  // A descriptor that the driver split takes d->slots positions of the ring
+  er->next_descriptor = (d[n - 1].index + (n == 1 && d->slots > 1 ? d->slots : 1)) % MAX_DMA_DESCRIPTORS;
+  for (k = 0; k < n; k++) {
+    d[k].index = (d[k].index + 1) % MAX_DMA_DESCRIPTORS;
+  }
+  if (er->args.access == MMAP) {
+    for (k = 0; k < n; k++) {
+      directReadDescriptor(&d[k]);
+    }
+  } else if (n == 1) {
+    readDescriptor(d);
+  } else {
+    readDescriptors(d, n, er->engine);
+  }
+  if (er->args.verify_data) {
+    checkData(er, d, n, fill_ns);
+  }
+  if (er->tlp_log) {
+    drainTlpLog(er);
+  }
+
+  for (k = 0; k < n; k++) {
+    values[k] = descriptorMetric(&er->args, &d[k], (double)host_ns / n);
+    status[k] = d[k];
+  }
+}
+
+/**
+* @brief Process n descriptors with the asynchronous interface, keeping up to args.queue of
+* them in flight: new descriptors are submitted while the engine processes the previous ones.
+* The cache is prepared once.
+*
+* @param er The engine. er->model is replicated.
+* @param n Number of descriptors.
+* @param values Where the metric of each descriptor is stored. For the host test every
+* descriptor gets the total time divided by n.
+* @param indexes Where the position of each descriptor in the ring is stored.
+*
+* @return 0 if ok, a negative value if the engine made no progress in ASYNC_TIMEOUT_NS.
+*/
+static int measureAsync(struct engine_run *er, int n, double *values, int *indexes)
+{
+  struct arguments *args = &er->args;
+  int submitted = 0, reaped = 0, k, r;
+  uint64_t host_ns, last_progress, fill_ns = 0;
+
+  er->sg_set = er->sg_next;
+  if (args->verify_data) {
+    fill_ns = fillData(er, &er->model, n);
+  }
+  prepareCache(er, &er->model, n);
+
+  host_ns = last_progress = getTimeNs();
+  while (reaped < n) {
+    k = n - submitted;
+    if (k > args->queue - (submitted - reaped)) {
+      k = args->queue - (submitted - reaped);
+    }
+    fillDescriptors(er, submitted, k);
+    if (k > 0) {
+      submitted += submitDescriptors(er->dlist, k, er->engine);
+    }
+
+    if (args->completion != NFP_COMPLETION_POLL) {
+      waitDescriptors(ASYNC_TIMEOUT_NS / 1000000);
+    }
+    r = reapDescriptors(&er->rlist[reaped], submitted - reaped, er->engine);
+    reaped += r;
+
+    if (r > 0) {
+      last_progress = getTimeNs();
+    } else if (getTimeNs() - last_progress > ASYNC_TIMEOUT_NS) {
+      fprintf(stderr, "[ERROR] %d descriptors were not completed by the engine %d\n", submitted - reaped, er->engine);
+      return -1;
+    }
+  }
+  host_ns = getTimeNs() - host_ns;
+  er->next_descriptor = (er->rlist[n - 1].index + 1) % MAX_DMA_DESCRIPTORS;
+  er->sg_next += n;
+  if (args->verify_data) {
+    checkData(er, &er->model, n, fill_ns);
+  }
+  if (er->tlp_log) {
+    drainTlpLog(er);
+  }
+
+  for (k = 0; k < n; k++) {
+    er->rlist[k].number_of_tlps = er->model.number_of_tlps; // A reaped descriptor only carries its [STATUS] fields
+    indexes[k] = er->rlist[k].index;
+    values[k]  = descriptorMetric(args, &er->rlist[k], (double)host_ns / n);
+    er->status[k] = er->rlist[k];
+  }
+  return 0;
+}
+
+/**
+* @brief Measure a round of args.niters descriptors of an engine. The metric and the position
+* of each descriptor are stored in er->values and er->indexes, and its [STATUS] fields in er->status. In the concurrent mode it runs in
+* its own thread and waits for the rest of the engines before each batch.
+*
+* @param arg The struct engine_run of the engine.
+*
+* @return NULL. er->error is set if the round could not be measured.
+*/
+static void *measureRound(void *arg)
+{
+  struct engine_run *er = (struct engine_run *) arg;
+  struct arguments *args = &er->args;
+  int j, k, n;
+
+  er->error = 0;
+  for (j = 0; j < args->niters; j += n) {
+    if (args->nengines) {
+      pthread_barrier_wait(&start_batch);
+    }
+    if (args->queue) {
+      n = args->niters;
+      if ((er->error = measureAsync(er, n, er->values, er->indexes))) {
         break;
       }
+    } else {
+      n = args->niters - j < args->batch ? args->niters - j : args->batch;
+      er->sg_set   = er->sg_next;
+      er->sg_next += n;
+      fillDescriptors(er, 0, n);
+      for (k = 0; k < n; k++) {
+        er->dlist[k].index  = er->indexes[j + k] = (er->next_descriptor + k) % MAX_DMA_DESCRIPTORS;
+        er->dlist[k].enable = k == n - 1;
+      }
+      measureDescriptors(er, n, &er->values[j], &er->status[j]);
+    }
+  }
+  return NULL;
+}
 
+/**
+* @brief Check if the adaptive mode has to measure another round.
+*/
+static int needsMoreSamples(struct arguments *args, struct statistics *st)
+{
+  return st->n < MIN_ADAPTIVE_SAMPLES || statsCI95(st) > args->precision * fabs(statsMean(st));
+}
 
-      writeDescriptor(&(dlist[i]));
-      dlist[i].index = (dlist[i].index + 1) % MAX_DMA_DESCRIPTORS;
-      readDescriptor(&(dlist[i]));
+/**
+* @brief Fill the columns of a row that identify the point (POINT_COLUMNS).
+*
+* @param engine The engine. -1 for the sum of the engines in the concurrent mode.
+* @param direction The direction of the engine (or of every engine, for the sum).
+* @param metric The metric of the row. NULL for the one of the test.
+*
+* @return The number of columns written.
+*/
+static int fillPoint(struct arguments *args, int engine, const char *direction, const char *metric, union result_value *row)
+{
+  row[0].i  = engine;
+  row[1].s  = direction;
+  row[2].s  = test_names[args->test];
+  row[3].s  = pattern_names[args->pat];
+  row[4].u  = args->pat == FIX ? args->prop.pfix.initial_offset : args->pat == RAN ? args->prop.pran.windowsize :
+              args->pat == SG ? args->prop.psg.count : 0;
+  row[5].s  = cache_names[args->cache];
+  row[6].u  = args->wsize;
+  row[7].u  = args->nbytes;
+  row[8].u  = args->max_payload;
+  row[9].u  = args->max_read_request;
+  row[10].u = args->page_size;
+  row[11].s = completion_names[args->completion];
+  row[12].s = access_names[args->access];
+  row[13].u = args->batch;
+  row[14].u = args->queue;
+  row[15].i = args->cpu_node;
+  row[16].i = args->mem_node;
+  row[17].s = metric ? metric : metric_names[args->test];
+  return NUM_POINT_COLUMNS;
+}
 
+/**
+* @brief Write a row for every descriptor of the round (raw summary).
+*
+* @param n The descriptors of the round (in the continuous mode, the windows).
+* @param status The descriptors of the round. NULL for the sum of the engines, whose
+* [STATUS] columns are 0.
+*/
+static void writeRound(struct arguments *args, struct result_writer *out, int engine, const char *direction,
+                       int n, int *indexes, double *values, struct dma_descriptor_sw *status)
+{
+  union result_value row[ARRAY_SIZE(raw_schema)];
+  struct dma_descriptor_sw none;
+  struct dma_descriptor_sw *d = &none;
+  int k, c;
 
+  memset(&none, 0, sizeof(none));
+  for (k = 0; k < n; k++) {
+    if (status) {
+      d = &status[k];
+    }
+    c = fillPoint(args, engine, direction, NULL, row);
+    row[c++].u = indexes[k];
+    row[c++].f = values[k];
+    row[c++].u = d->latency;
+    row[c++].u = d->time_at_req;
+    row[c++].u = d->time_at_comp;
+    row[c++].u = d->bytes_at_req;
+    row[c++].u = d->bytes_at_comp;
+    resultWrite(out, row);
+  }
+}
 
-      total_bytes = n_total_tlps / (n_complete_tlps + n_incomplete_tlps) * args.nbytes + (n_total_tlps % (n_complete_tlps + n_incomplete_tlps)) * maximum_size_per_tlp;
+/**
+* @brief Write the row of a point (stats summary).
+*
+* @param metric The metric of the samples. NULL for the one of the test.
+*/
+static void writeStats(struct arguments *args, struct result_writer *out, int engine, const char *direction,
+                       const char *metric, struct statistics *st)
+{
+  union result_value row[ARRAY_SIZE(stats_schema)];
+  double ci = statsCI95(st);
+  int c;
+
+  c = fillPoint(args, engine, direction, metric, row);
+  row[c++].u = st->n;
+  row[c++].f = statsPercentile(st, 0);
+  row[c++].f = statsPercentile(st, 50);
+  row[c++].f = statsPercentile(st, 99);
+  row[c++].f = statsPercentile(st, 99.9);
+  row[c++].f = statsPercentile(st, 100);
+  row[c++].f = statsMean(st);
+  row[c++].f = statsStddev(st);
+  row[c++].f = statsMean(st) - ci;
+  row[c++].f = statsMean(st) + ci;
+  resultWrite(out, row);
+}
+
+/**
+* @brief -L: write the row of the latency of the memory read requests of a point (stats summary).
+* The order statistics have the resolution of the buckets of the histogram.
+*/
+static void writeTlpStats(struct engine_run *er, struct result_writer *out)
+{
+  union result_value row[ARRAY_SIZE(stats_schema)];
+  struct histogram *h = &er->tlp_hist;
+  double ci = h->n < STATS_MIN_SAMPLES_CI ? 0 : 1.96 * histogramStddev(h) / sqrt(h->n); // The log has thousands of samples
+  int c;
+
+  c = fillPoint(&er->args, er->engine, dir_names[er->args.dir], tlp_metric, row);
+  row[c++].u = h->n;
+  row[c++].f = histogramPercentile(h, 0) * CYCLE_NS;
+  row[c++].f = histogramPercentile(h, 50) * CYCLE_NS;
+  row[c++].f = histogramPercentile(h, 99) * CYCLE_NS;
+  row[c++].f = histogramPercentile(h, 99.9) * CYCLE_NS;
+  row[c++].f = histogramPercentile(h, 100) * CYCLE_NS;
+  row[c++].f = histogramMean(h) * CYCLE_NS;
+  row[c++].f = histogramStddev(h) * CYCLE_NS;
+  row[c++].f = (histogramMean(h) - ci) * CYCLE_NS;
+  row[c++].f = (histogramMean(h) + ci) * CYCLE_NS;
+  resultWrite(out, row);
+}
+
+/**
+* @brief -L: stop the log of an engine and write the non-empty buckets of the histogram of the
+* point in the -L file.
+*/
+static void writeTlpHistogram(struct engine_run *er)
+{
+  union result_value row[ARRAY_SIZE(tlp_schema)];
+  int b, c;
 
-      if (args.test == BANDWIDTH) {
-        fprintf(fname, ",%lf\n", (total_bytes) * 8.0 / (dlist[i].latency * 4));
+  setTlpLog(er->engine, 0, 0);
+  if (er->tlp_lost) {
+    fprintf(stderr, "[WARNING] %lu entries of the per-TLP latency log of the engine %d were overwritten before they were read\n",
+            er->tlp_lost, er->engine);
+  }
+  if (er->tlp_hist.n == 0) {
+    fprintf(stderr, "[WARNING] The per-TLP latency log of the engine %d is empty: the device may not implement it\n", er->engine);
+  }
+  for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    if (er->tlp_hist.counts[b] == 0) {
+      continue;
+    }
+    c = fillPoint(&er->args, er->engine, dir_names[er->args.dir], tlp_metric, row);
+    row[c++].u = er->tlp_shift;
+    row[c++].u = er->tlp_lost;
+    row[c++].u = histogramLowest(b) * CYCLE_NS;
+    row[c++].u = histogramHighest(b) * CYCLE_NS + CYCLE_NS - 1;
+    row[c++].u = er->tlp_hist.counts[b];
+    resultWrite(&tlp_out, row);
+  }
+}
+
+/**
+* @brief -V: report the verification of the data of an engine in stderr. Its cost is not part of
+* the metric of the point.
+*/
+static void reportVerification(struct engine_run *er)
+{
+  fprintf(stderr, "[VERIFY] Engine %d (%s): %lu units of %d bytes checked in %lu sets of descriptors, %.0f wrong. "
+          "Fill and check: %.0f ns per set (median)\n", er->engine, dir_names[er->args.dir], er->verify_units,
+          VERIFY_UNIT_SIZE, er->verify_st.n, er->verify_errors.sum, statsPercentile(&er->verify_st, 50));
+  if (er->verify_errors.sum > 0) {
+    fprintf(stderr, "[ERROR] The data moved by the engine %d is wrong. The first wrong unit is at the offset 0x%lx of the buffer\n",
+            er->engine, er->first_error);
+  }
+}
+
+/**
+* @brief -T: measure an engine in the continuous mode. The ring is kept with args.queue
+* descriptors in flight until the budget ends, and each window of args.niters completed
+* descriptors is a sample (a row in the raw summary). The host only sees the completions when it
+* reaps them, so the time between two reaps is shared by the descriptors of the second one.
+*
+* @return 0 if ok, a negative value if the engine stopped completing descriptors.
+*/
+static int measureContinuous(struct engine_run *er, struct result_writer *out)
+{
+  struct arguments *args = &er->args;
+  uint64_t submitted = 0, reaped = 0, window_n = 0, windows = 0, window_bytes = 0;
+  uint64_t bytes = descriptorBytes(args, &er->model);
+  uint64_t start, now, last_reap, last_progress;
+  double window_sum = 0, window_ns = 0, share, value;
+  int k, r, done = 0;
+
+  er->run_dry = 0;
+  er->sg_set  = er->sg_next;
+  prepareCache(er, &er->model, args->pat == SG ? er->sg.count : 1);
+
+  start = now = last_reap = last_progress = getTimeNs();
+  while (!done || submitted > reaped) {
+    if (!done) {
+      done = args->budget_ns ? now - start >= args->budget_ns : submitted * bytes >= args->budget_bytes;
+      if (er->st.n == er->st.capacity) {
+        fprintf(stderr, "[WARNING] The continuous mode of the engine %d stopped after %lu samples (-m)\n", er->engine, er->st.n);
+        done = 1;
+      }
+    }
+    if (!done) {
+      k = args->queue - (submitted - reaped);
+      fillDescriptors(er, submitted, k);
+      if (k > 0) {
+        submitted += submitDescriptors(er->dlist, k, er->engine);
+      }
+    }
+
+    if (args->completion != NFP_COMPLETION_POLL) {
+      waitDescriptors(ASYNC_TIMEOUT_NS / 1000000);
+    }
+    r = reapDescriptors(er->rlist, submitted - reaped, er->engine);
+    now = getTimeNs();
+    if (r == 0) {
+      if (now - last_progress > ASYNC_TIMEOUT_NS) {
+        fprintf(stderr, "[ERROR] %lu descriptors were not completed by the engine %d\n", submitted - reaped, er->engine);
+        return -1;
+      }
+      continue;
+    }
+    last_progress = now;
+    share     = (double)(now - last_reap) / r;
+    last_reap = now;
+    reaped   += r;
+    if (reaped == submitted && !done) {
+      er->run_dry++;
+    }
+
+    for (k = 0; k < r; k++) {
+      er->rlist[k].number_of_tlps = er->model.number_of_tlps; // A reaped descriptor only carries its [STATUS] fields
+      window_sum   += descriptorMetric(args, &er->rlist[k], 0);
+      window_bytes += bytes;
+      window_ns    += share;
+      if (++window_n < args->niters) {
+        continue;
+      }
+      if (args->test == BANDWIDTH) {
+        value = window_bytes * 8.0 / window_ns;
+      } else if (args->test == HOST) {
+        value = window_ns / window_n;
       } else {
-        fprintf(fname, ",%ld\n", dlist[i].time_at_comp * 4);
+        value = window_sum / window_n;
+      }
+      statsAdd(&er->st, value);
+      if (args->summary == RAW) {
+        er->indexes[0] = windows;
+        er->status[0]  = er->rlist[k];
+        writeRound(args, out, er->engine, dir_names[args->dir], 1, er->indexes, &value, er->status);
+      }
+      windows++;
+      window_n = window_bytes = 0;
+      window_sum = window_ns = 0;
+    }
+  }
+  if (reaped) {
+    er->next_descriptor = (er->rlist[r - 1].index + 1) % MAX_DMA_DESCRIPTORS;
+  }
+  er->sg_next        += submitted;
+  er->run_descriptors = reaped;
+  er->run_ns          = now - start;
+  return 0;
+}
+
+/**
+* @brief -T: report the totals of the continuous mode of an engine in stderr.
+*/
+static void reportContinuous(struct engine_run *er)
+{
+  uint64_t bytes = er->run_descriptors * descriptorBytes(&er->args, &er->model);
+
+  fprintf(stderr, "[CONTINUOUS] Engine %d (%s): %lu descriptors, %lu bytes in %.3f s: %.3f Gbps. The ring ran dry %lu times\n",
+          er->engine, dir_names[er->args.dir], er->run_descriptors, bytes, er->run_ns / 1e9,
+          er->run_ns ? bytes * 8.0 / er->run_ns : 0, er->run_dry);
+}
+
+/**
+* @brief IOTLB suite: keep the median of the point in execution.
+*/
+static void recordSuitePoint(struct arguments *args, double value)
+{
+  struct suite_point *p = &suite_points[suite_n++];
+
+  p->dir    = args->dir;
+  p->cache  = args->cache;
+  p->wsize  = args->wsize;
+  p->nbytes = args->nbytes;
+  p->window = args->prop.pran.windowsize;
+  p->value  = value;
+}
+
+/**
+* @brief Order the points by series and, inside a series, by window.
+*/
+static int compareSuitePoints(const void *a, const void *b)
+{
+  const struct suite_point *x = a, *y = b;
+
+  if (x->dir != y->dir) {
+    return x->dir < y->dir ? -1 : 1;
+  }
+  if (x->cache != y->cache) {
+    return x->cache < y->cache ? -1 : 1;
+  }
+  if (x->wsize != y->wsize) {
+    return x->wsize < y->wsize ? -1 : 1;
+  }
+  if (x->nbytes != y->nbytes) {
+    return x->nbytes < y->nbytes ? -1 : 1;
+  }
+  if (x->window != y->window) {
+    return x->window < y->window ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+* @brief IOTLB suite: write a row per series of the buffer in use with its knee, the first window
+* whose median is KNEE_THRESHOLD worse than the one of the smallest window (lower bandwidth or
+* higher latency). knee_window is 0 if the metric does not change.
+*/
+static void writeKnees(struct arguments *args, struct result_writer *out)
+{
+  union result_value row[ARRAY_SIZE(knee_schema)];
+  struct suite_point *first, *knee, *p;
+  int c;
+
+  qsort(suite_points, suite_n, sizeof(struct suite_point), compareSuitePoints);
+  for (first = suite_points; first < suite_points + suite_n; first = p) {
+    knee = NULL;
+    for (p = first + 1; p < suite_points + suite_n && p->dir == first->dir && p->cache == first->cache && p->wsize == first->wsize && p->nbytes == first->nbytes; p++) {
+      if (knee == NULL && (args->test == BANDWIDTH ? p->value < first->value * (1 - KNEE_THRESHOLD)
+                           : p->value > first->value * (1 + KNEE_THRESHOLD))) {
+        knee = p;
+      }
+    }
+
+    c = 0;
+    row[c++].s = backing_names[args->backing];
+    row[c++].u = args->page_size;
+    row[c++].i = args->mem_node;
+    row[c++].s = dir_names[first->dir];
+    row[c++].s = test_names[args->test];
+    row[c++].s = cache_names[first->cache];
+    row[c++].u = first->wsize;
+    row[c++].u = first->nbytes;
+    row[c++].s = metric_names[args->test];
+    row[c++].u = first->window;
+    row[c++].f = first->value;
+    row[c++].u = knee ? knee->window : 0;
+    row[c++].f = knee ? knee->value : 0;
+    row[c++].u = p[-1].window;
+    row[c++].f = p[-1].value;
+    row[c++].f = KNEE_THRESHOLD;
+    resultWrite(out, row);
+  }
+  suite_n = 0;
+}
+
+/**
+* @brief Close a results file and report in stderr how much went through its ring (-B) and whether
+* the measurements had to wait for the background writer.
+*/
+static void closeResults(const char *path, struct result_writer *out)
+{
+  struct result_ring_stats rs;
+
+  resultFlush(out);
+  if (resultRingStats(out, &rs) == 0) {
+    fprintf(stderr, "[RESULTS] %s: %lu bytes buffered in a ring of %lu bytes (peak %lu). ", path, rs.bytes, rs.size, rs.peak);
+    if (rs.blocked) {
+      fprintf(stderr, "The measurements waited %lu times (%.3f ms) for free space: increase -B\n", rs.blocked, rs.blocked_ns / 1e6);
+    } else {
+      fprintf(stderr, "The measurements never waited for the writer\n");
+    }
+  }
+  resultClose(out);
+}
+
+/**
+* @brief Measure one point of the test matrix: the values in args->nbytes...args->prop.
+* The device has already been opened and the buffer registered. In the concurrent mode every
+* engine of args->engine_dir is measured at the same time.
+*
+* @param args The configuration of the point.
+* @param pmem The registered buffer.
+* @param total_size The size of the registered buffer.
+* @param out The results file.
+*
+* @return A negative value if the point could not be measured.
+*/
+static int runTest(struct arguments *args, void *pmem, uint64_t total_size, struct result_writer *out)
+{
+  int e, k, more, ret = 0;
+  uint32_t regions;
+  int nengines = args->nengines ? args->nengines : 1;
+  int sum_engines = args->nengines > 1 && args->test == BANDWIDTH;
+  int indexes[MAX_DMA_DESCRIPTORS];
+  double values[MAX_DMA_DESCRIPTORS];
+  struct engine_run *er;
+  pthread_t threads[MAX_NUM_DMA_ENGINES];
+  char all_dirs[16] = "";
+
+  for (e = 0; e < nengines; e++) {
+    er = &engines[e];
+    er->engine = e;
+    er->args   = *args;
+    er->pmem   = pmem;
+    if (args->nengines) {
+      er->args.dir = args->engine_dir[e];
+    }
+    if (leaseEngine(e)) {
+      fprintf(stderr, "The engine %d cannot be leased (%s): it is in use by another process or the bitstream does not have it\n", e, strerror(errno));
+      return -1;
+    }
+    setEngineWindowSize(e, args->wsize);
+    if (prepareDescriptor(&er->args, total_size, &er->model)) {
+      fprintf(stderr, "An error was detected\n");
+      return -1;
+    }
+    er->model.engine = e;
+    if (args->pat == SG) {
+      sg_list_free(&er->sg);
+      if (sg_list_strided(&er->sg, 0, total_size, args->contiguous, args->prop.psg.count, args->nbytes)) {
+        fprintf(stderr, "[ERROR] The buffer cannot hold %lu buffers of %lu bytes\n", args->prop.psg.count, args->nbytes);
+        return -1;
+      }
+      er->sg_next = 0;
+      // The kernel pages are a single contiguous buffer: its mapping is already reused
+      if (args->backing != BACKING_KERNEL_PAGES && sg_list_register(&er->sg, args->contiguous, &regions) < regions) {
+        fprintf(stderr, "[WARNING] Only some of the %u regions of the list of the engine %d are mapped once\n", regions, e);
+      }
+    }
+    statsReset(&er->st);
+    statsReset(&er->verify_st);
+    statsReset(&er->verify_errors);
+    er->verify_units = 0;
+    er->tlp_log = args->tlp_file_name != NULL && er->model.is_s2c_op;
+    if (er->tlp_log) {
+      startTlpLog(er);
+    }
+    if (er->args.verify_data && er->model.is_c2s_op &&
+        (er->args.nbytes % VERIFY_UNIT_SIZE || (er->args.pat == FIX && er->args.prop.pfix.initial_offset % VERIFY_UNIT_SIZE))) {
+      fprintf(stderr, "[WARNING] The data written by the core is only verified with sizes and offsets multiple of %d bytes\n", VERIFY_UNIT_SIZE);
+      er->args.verify_data = 0;
+    }
+    snprintf(all_dirs + strlen(all_dirs), sizeof(all_dirs) - strlen(all_dirs), "%s%s", e ? "+" : "", dir_names[er->args.dir]);
+  }
+  statsReset(&aggregate);
+  if (args->nengines) {
+    pthread_barrier_init(&start_batch, NULL, nengines);
+  }
+
+  /* Main loop. Configure the FPGA and gather the information from the descriptors. The adaptive
+     mode repeats the loop until the confidence interval of every row is narrow enough. The
+     continuous mode measures the single engine until its budget ends */
+  if (args->budget_ns || args->budget_bytes) {
+    if (measureContinuous(&engines[0], out)) {
+      ret = -1;
+      goto end_of_point;
+    }
+    reportContinuous(&engines[0]);
+  } else {
+    do {
+      if (args->nengines) {
+        for (e = 0; e < nengines; e++) {
+          pthread_create(&threads[e], NULL, measureRound, &engines[e]);
+        }
+        for (e = 0; e < nengines; e++) {
+          pthread_join(threads[e], NULL);
+        }
+      } else {
+        measureRound(&engines[0]);
+      }
+
+      more = 0;
+      for (e = 0; e < nengines; e++) {
+        er = &engines[e];
+        if (er->error) {
+          ret = -1;
+          goto end_of_point;
+        }
+        for (k = 0; k < args->niters; k++) {
+          statsAdd(&er->st, er->values[k]);
+        }
+        if (args->summary == RAW) {
+          writeRound(&er->args, out, e, dir_names[er->args.dir], args->niters, er->indexes, er->values, er->status);
+        }
+        more |= needsMoreSamples(args, &er->st);
+      }
+      if (sum_engines) {
+        for (k = 0; k < args->niters; k++) {
+          indexes[k] = aggregate.n;
+          values[k]  = 0;
+          for (e = 0; e < nengines; e++) {
+            values[k] += engines[e].values[k];
+          }
+          statsAdd(&aggregate, values[k]);
+        }
+        if (args->summary == RAW) {
+          writeRound(args, out, -1, all_dirs, args->niters, indexes, values, NULL);
+        }
+        more |= needsMoreSamples(args, &aggregate);
+      }
+    } while (args->precision > 0 && engines[0].st.n + args->niters <= args->max_samples && more);
+  }
+
+  for (e = 0; e < nengines; e++) {
+    if (engines[e].args.verify_data) {
+      reportVerification(&engines[e]);
+    }
+    if (engines[e].tlp_log) {
+      writeTlpHistogram(&engines[e]);
+    }
+  }
+
+  if (args->summary == STATS) {
+    for (e = 0; e < nengines; e++) {
+      writeStats(&engines[e].args, out, e, dir_names[engines[e].args.dir], NULL, &engines[e].st);
+      if (engines[e].args.verify_data) {
+        writeStats(&engines[e].args, out, e, dir_names[engines[e].args.dir], verify_ns_metric, &engines[e].verify_st);
+        writeStats(&engines[e].args, out, e, dir_names[engines[e].args.dir], verify_errors_metric, &engines[e].verify_errors);
+      }
+      if (engines[e].tlp_log) {
+        writeTlpStats(&engines[e], out);
+      }
+    }
+    if (sum_engines) {
+      writeStats(args, out, -1, all_dirs, NULL, &aggregate);
+    }
+    if (args->suite == IOTLB && args->pat == RAN) {
+      recordSuitePoint(args, statsPercentile(sum_engines ? &aggregate : &engines[0].st, 50));
+    }
+  }
+end_of_point:
+  for (e = 0; e < nengines; e++) {
+    if (engines[e].tlp_log) {
+      setTlpLog(e, 0, 0);
+    }
+    sg_list_free(&engines[e].sg);
+  }
+  if (args->nengines) {
+    pthread_barrier_destroy(&start_batch);
+  }
+  return ret;
+}
+
+/**
+* @brief -M/-R: program the MPS and the MRRS of the link (0 keeps them) and read the sizes of the
+* TLPs that the DMA core uses afterwards.
+*
+* @return 0 if ok, -1 if the link or the DMA core do not accept the values.
+*/
+static int setLinkSizes(struct arguments *args, uint64_t max_payload, uint64_t max_read_request)
+{
+  struct pcie_config pc;
+  uint32_t common_block;
+
+  if ((max_payload || max_read_request) && configurePcie(max_payload, max_read_request, &pc)) {
+    fprintf(stderr, "[WARNING] The link does not accept MPS %lu and MRRS %lu (0 keeps the value): skipped\n", max_payload, max_read_request);
+    return -1;
+  }
+  common_block = readWord(0, DMA_OFFSET * 8 + offsetof(struct dma_core, dma_common_block));
+  args->max_payload      = 128 << (common_block & 0x7);
+  args->max_read_request = 128 << ((common_block >> 3) & 0x7);
+  return 0;
+}
+
+/**
+* @brief Measure every point of the matrix with the sizes of the link in effect. In a sweep, a
+* point that cannot be measured (e.g. its configuration is not valid) is reported and skipped.
+*
+* @return A negative value if a point failed and the remaining ones must not be measured.
+*/
+static int runPoints(struct arguments *args, void *pmem, uint64_t total_size, struct result_writer *out, int is_sweep)
+{
+  struct sweep *sw = &args->sweep;
+  int d, c, p, w, n;
+
+  for (d = 0; d < sw->n_dir; d++) {
+    for (c = 0; c < sw->n_cache; c++) {
+      for (p = 0; p < sw->n_pat; p++) {
+        for (w = 0; w < sw->n_wsize; w++) {
+          for (n = 0; n < sw->n_nbytes; n++) {
+            args->dir    = sw->dir[d];
+            args->cache  = sw->cache[c];
+            args->pat    = sw->pat[p].pat;
+            args->prop   = sw->pat[p].prop;
+            args->wsize  = sw->wsize[w];
+            args->nbytes = sw->nbytes[n];
+            if (args->suite == IOTLB && args->pat == RAN && args->prop.pran.windowsize > args->contiguous) {
+              continue; // The generator would leave the contiguous region
+            }
+            if (runTest(args, pmem, total_size, out)) {
+              failed_points++;
+              if (!is_sweep) {
+                return -1;
+              }
+              fprintf(stderr, "[WARNING] The point -d %s -p %s -n %lu -w %lu could not be measured: skipped\n",
+                      dir_names[args->dir], pattern_names[args->pat], args->nbytes, args->wsize);
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+* @brief Lease the engines of the test. runTest leases them again, which is a no-op, but BAR0
+* (-x mmap) can only be mapped by a file that already holds them.
+*
+* @return A negative value if another process holds one of them.
+*/
+static int leaseEngines(struct arguments *args)
+{
+  int e;
+
+  for (e = 0; e < (args->nengines ? args->nengines : 1); e++) {
+    if (leaseEngine(e)) {
+      fprintf(stderr, "The engine %d cannot be leased (%s): it is in use by another process or the bitstream does not have it\n", e, strerror(errno));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+* @brief Measure every point of the matrix but the NUMA node and the backing of the buffer, that
+* are fixed. The sizes of the link are the outer axes: they are programmed once for the points
+* measured with them.
+*
+* @return A negative value if a point failed and the remaining ones must not be measured.
+*/
+static int runMatrix(struct arguments *args, void *pmem, uint64_t total_size, struct result_writer *out, int is_sweep)
+{
+  struct sweep *sw = &args->sweep;
+  int mps, mrrs;
+
+  for (mps = 0; mps < sw->n_max_payload; mps++) {
+    for (mrrs = 0; mrrs < sw->n_max_read_request; mrrs++) {
+      if (setLinkSizes(args, sw->max_payload[mps], sw->max_read_request[mrrs])) {
+        if (!is_sweep) {
+          return -1;
+        }
+        continue;
+      }
+      if (runPoints(args, pmem, total_size, out, is_sweep)) {
+        return -1;
       }
     }
   }
-  fclose(fname);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  void *pmem;
+  struct arguments args;
+  struct sweep *sw = &args.sweep;
+  int m, h, e, ret = 0;
+  int is_sweep, local_node;
+  uint64_t total_size, capacity;
+  struct pcie_config link; // -M, -R: the sizes of the driver, restored at the end
+  int link_changed;
+  struct result_writer out, knees;
+  cpu_set_t cpus;
+
+  if (readArguments (argc, argv, &args)) {
+    printUsage();
+    return 0;
+  }
+  is_sweep = sweepPoints(sw) > 1;
+  capacity = args.precision > 0 || args.budget_ns || args.budget_bytes ? args.max_samples : args.niters;
+  for (e = 0; e < MAX_NUM_DMA_ENGINES; e++) {
+    if (statsInit(&engines[e].st, capacity) || statsInit(&engines[e].verify_st, capacity) ||
+        statsInit(&engines[e].verify_errors, capacity)) {
+      fprintf(stderr, "Not enough memory for the samples\n");
+      return -1;
+    }
+  }
+  if (statsInit(&aggregate, capacity)) {
+    fprintf(stderr, "Not enough memory for the samples\n");
+    return -1;
+  }
+
+  if (sw->backing[0] != BACKING_KERNEL_PAGES) {
+    hugepage_set_backing(sw->backing[0]); // Before the device is opened: it decides whether huge pages are available
+  }
+
+  /* Initialize the driver */
+  if (fpgaInit (argc, argv) < 0) {
+    fpgaExit (-1, "There was an error");
+  }
+  setLinkSizes(&args, 0, 0);
+  link_changed = sw->max_payload[0] || sw->max_read_request[0] || sw->n_max_payload > 1 || sw->n_max_read_request > 1;
+  if (link_changed && configurePcie(0, 0, &link)) {
+    fpgaExit (-1, "The sizes of the link cannot be changed (-M, -R)\n");
+  }
+
+  /* Resolve the NUMA nodes once, so an invalid one is reported before measuring anything */
+  local_node    = getDeviceNumaNode();
+  args.cpu_node = resolveNode(args.cpu_node, local_node);
+  for (m = 0; m < sw->n_mem_node; m++) {
+    sw->mem_node[m] = resolveNode(sw->mem_node[m], local_node);
+    if (sw->mem_node[m] < NODE_ANY) {
+      fpgaExit (-1, "Invalid NUMA node for the buffer\n");
+    }
+  }
+  if (args.cpu_node < NODE_ANY || setNumaAffinity(args.cpu_node)) {
+    fpgaExit (-1, "The benchmark cannot run in the requested NUMA node\n");
+  }
+
+  /* The eviction set is written by the CPUs where the benchmark runs */
+  for (e = 0; e < sw->n_cache && sw->cache[e] == IGNORE; e++);
+  if (e < sw->n_cache) {
+    sched_getaffinity(0, sizeof(cpu_set_t), &cpus);
+    if (cacheInit(&cache_ctrl, args.eviction, CPU_COUNT(&cpus))) {
+      fpgaExit (-1, "Not enough memory for the eviction set\n");
+    }
+  }
+
+  if (args.summary == RAW) {
+    e = resultOpen(&out, args.file_name, args.format, raw_schema, ARRAY_SIZE(raw_schema), args.result_ring);
+  } else {
+    e = resultOpen(&out, args.file_name, args.format, stats_schema, ARRAY_SIZE(stats_schema), args.result_ring);
+  }
+  if (e) {
+    fpgaExit (-1, "The results file cannot be opened\n");
+  }
+  if (args.tlp_file_name && resultOpen(&tlp_out, args.tlp_file_name, args.format, tlp_schema, ARRAY_SIZE(tlp_schema), args.result_ring)) {
+    fpgaExit (-1, "The per-TLP latency file cannot be opened\n");
+  }
+  if (args.suite == IOTLB) {
+    suite_points = malloc(sweepPoints(sw) * sizeof(struct suite_point));
+    if (suite_points == NULL || resultOpen(&knees, args.knee_file_name, args.format, knee_schema, ARRAY_SIZE(knee_schema), args.result_ring)) {
+      fpgaExit (-1, "The knee file cannot be opened\n");
+    }
+  }
+
+  if (args.completion != NFP_COMPLETION_POLL && setCompletionMode(args.completion)) {
+    fprintf(stderr, "The completion mode %s is not available\n", completion_names[args.completion]);
+    args.completion = NFP_COMPLETION_POLL;
+  }
+
+  /* The device stays open for the whole matrix. The buffer is registered once per NUMA node and backing */
+  for (m = 0; m < sw->n_mem_node && ret == 0; m++) {
+    for (h = 0; h < sw->n_backing && ret == 0; h++) {
+      args.backing = sw->backing[h];
+      if (args.backing == BACKING_KERNEL_PAGES) {
+        if (sw->mem_node[m] != NODE_ANY) {
+          fprintf(stderr, "The kernel pages are allocated by the driver: the NUMA node cannot be selected\n");
+        }
+        pmem = getFreePages(MAX_PAGES); // Get a buffer in kernel space (physically contiguous)
+        total_size = MAX_PAGES * KERNEL_PAGE_SIZE;
+        args.page_size  = KERNEL_PAGE_SIZE;
+        args.contiguous = total_size;
+      } else {
+        hugepage_set_backing(args.backing);
+        hugepage_set_node(sw->mem_node[m]);
+        if (sw->n_backing > 1 && hugepage_number() < (args.npages ? args.npages : 1)) {
+          fprintf(stderr, "There are no free huge pages for -H %s: skipped\n", backing_names[args.backing]);
+          continue;
+        }
+        total_size = args.npages ? args.npages * hugepage_size() : hugepage_number() * hugepage_size();
+        pmem = getFreeHugePages(args.npages);
+        args.page_size  = hugepage_size();
+        args.contiguous = args.page_size;
+      }
+      if (pmem == NULL) {
+        printf(  "[MEMORY]     No free pages\n");
+        fpgaExit (-1, "Error mapping kernel memory\n");
+      }
+      args.mem_node = hugepage_get_node(pmem);
+
+      if (args.access == MMAP && (leaseEngines(&args) || directOpen(total_size, args.contiguous))) {
+        fpgaExit (-1, "Error mapping BAR0\n");
+      }
+
+      ret = runMatrix(&args, pmem, total_size, &out, is_sweep);
+      if (args.suite == IOTLB) {
+        writeKnees(&args, &knees);
+      }
+
+      if (args.access == MMAP) {
+        directClose();
+      }
 // Free the memory
-#ifdef USE_HUGE_PAGES
-  unsetHugeFreePages(pmem, NUMBER_PAGES );
-#else
-  unsetFreePages(pmem, NUMBER_PAGES );
-#endif
+      if (args.backing == BACKING_KERNEL_PAGES) {
+        unsetFreePages(pmem, MAX_PAGES);
+      } else {
+        unsetHugeFreePages(pmem, args.npages);
+        reportRegistration();
+      }
+    }
+  }
+
+  closeResults(args.file_name, &out);
+  if (args.tlp_file_name) {
+    closeResults(args.tlp_file_name, &tlp_out);
+  }
+  if (args.suite == IOTLB) {
+    closeResults(args.knee_file_name, &knees);
+    free(suite_points);
+  }
+  for (e = 0; e < MAX_NUM_DMA_ENGINES; e++) {
+    statsFree(&engines[e].st);
+    statsFree(&engines[e].verify_st);
+    statsFree(&engines[e].verify_errors);
+  }
+  statsFree(&aggregate);
+  cacheFree(&cache_ctrl);
+  if (args.completion != NFP_COMPLETION_POLL) { // The mode is kept by the driver
+    setCompletionMode(NFP_COMPLETION_POLL);
+  }
+  if (link_changed && configurePcie(link.max_payload, link.max_read_request, &link)) { // The sizes are kept by the device
+    fprintf(stderr, "[WARNING] The MPS and the MRRS of the link could not be restored\n");
+  }
+  if (failed_points) {
+    fprintf(stderr, "[ERROR] %d points could not be measured\n", failed_points);
+  }
 // Free FPGA resources
-  fpgaExit (0, "");
+  fpgaExit (ret < 0 || failed_points ? -1 : 0, "");
   return 0;
 }
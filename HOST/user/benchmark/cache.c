@@ -0,0 +1,362 @@
+/**
+* @file cache.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Control of the state of the host caches before a measurement.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "cache.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define CACHE_X86
+#endif
+
+#define CACHE_SYSFS "/sys/devices/system/cpu/cpu%d/cache/index%d/%s"
+#define CACHE_PAGE_SIZE     4096
+
+/**
+* @brief Slice of the eviction set written by a thread.
+*/
+struct eviction_slice {
+  struct cache_control *cc;
+  uint64_t              start;
+  uint64_t              end;
+};
+
+typedef uint64_t cache_line_t __attribute__ ((vector_size (CACHE_LINE_SIZE))); /**< A line in vector registers */
+
+static cache_line_t sink; /**< The loads of warmRange are not optimized out */
+static int clflushopt_available = -1; /**< Detected on the first call to cacheCanFlush */
+static int clflush_available;
+
+uint64_t cacheLLCSize (void)
+{
+  char path[128], unit;
+  uint64_t size, llc = 0;
+  int index, level, max_level = 0, cpu = sched_getcpu ();
+  FILE *f;
+
+  if (cpu < 0) {
+    cpu = 0;
+  }
+  for (index = 0; ; index++) {
+    snprintf (path, sizeof (path), CACHE_SYSFS, cpu, index, "level");
+    f = fopen (path, "r");
+    if (f == NULL) {
+      break;
+    }
+    if (fscanf (f, "%d", &level) != 1) {
+      level = 0;
+    }
+    fclose (f);
+
+    snprintf (path, sizeof (path), CACHE_SYSFS, cpu, index, "size");
+    f = fopen (path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    unit = 0;
+    if (fscanf (f, "%lu%c", &size, &unit) >= 1 && level >= max_level) {
+      max_level = level;
+      llc = unit == 'M' ? size * 1024 * 1024 : unit == 'K' ? size * 1024 : size;
+    }
+    fclose (f);
+  }
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  if (llc == 0 && sysconf (_SC_LEVEL3_CACHE_SIZE) > 0) {
+    llc = sysconf (_SC_LEVEL3_CACHE_SIZE);
+  }
+#endif
+  return llc;
+}
+
+int cacheCanFlush (void)
+{
+#ifdef CACHE_X86
+  unsigned int eax, ebx, ecx, edx;
+
+  if (clflushopt_available < 0) {
+    clflushopt_available = 0;
+    if (__get_cpuid (1, &eax, &ebx, &ecx, &edx)) {
+      clflush_available = (edx >> 19) & 1;
+    }
+    if (__get_cpuid_count (7, 0, &eax, &ebx, &ecx, &edx)) {
+      clflushopt_available = (ebx >> 23) & 1;
+    }
+  }
+#else
+  clflushopt_available = 0;
+#endif
+  return clflush_available || clflushopt_available;
+}
+
+/* Flush the lines of a range. clflushopt is not ordered with the other flushes: flushFence
+   waits for all of them */
+static void flushRange (void *target, uint64_t length)
+{
+#ifdef CACHE_X86
+  uint8_t *p   = (uint8_t *)((uint64_t)target & ~(CACHE_LINE_SIZE - 1UL));
+  uint8_t *end = (uint8_t *)target + length;
+
+  if (clflushopt_available) {
+    for (; p < end; p += CACHE_LINE_SIZE) {
+      asm volatile (".byte 0x66; clflush %0" : "+m" (*(volatile uint8_t *)p)); // clflushopt
+    }
+  } else {
+    for (; p < end; p += CACHE_LINE_SIZE) {
+      asm volatile ("clflush %0" : "+m" (*(volatile uint8_t *)p));
+    }
+  }
+#endif
+}
+
+static inline void flushFence (void)
+{
+#ifdef CACHE_X86
+  asm volatile ("mfence" ::: "memory");
+#endif
+}
+
+static void *evictSlice (void *arg)
+{
+  struct eviction_slice *s = (struct eviction_slice *) arg;
+  uint64_t i;
+
+  for (i = s->start; i < s->end; i += CACHE_LINE_SIZE) {
+    *(volatile uint64_t *)(s->cc->eviction_set + i) = s->cc->round;
+  }
+  return NULL;
+}
+
+int cacheInit (struct cache_control *cc, int method, int nthreads)
+{
+  memset (cc, 0, sizeof (struct cache_control));
+  cc->method   = method;
+  cc->nthreads = nthreads < 1 ? 1 : nthreads > CACHE_MAX_THREADS ? CACHE_MAX_THREADS : nthreads;
+  cc->llc_size = cacheLLCSize ();
+  if (cc->llc_size == 0) {
+    cc->llc_size = CACHE_DEFAULT_LLC;
+  }
+  if ((cc->method & CACHE_FLUSH) && !cacheCanFlush ()) {
+    cc->method = CACHE_EVICT;
+  }
+  if (cc->method & CACHE_EVICT) {
+    cc->eviction_size = CACHE_EVICTION_RATIO * cc->llc_size;
+    cc->eviction_set  = malloc (cc->eviction_size);
+    if (cc->eviction_set == NULL) {
+      return -1;
+    }
+    memset (cc->eviction_set, 0, cc->eviction_size); // Fault in the pages now
+  }
+  return 0;
+}
+
+void cacheFree (struct cache_control *cc)
+{
+  free (cc->eviction_set);
+  memset (cc, 0, sizeof (struct cache_control));
+}
+
+/* Load the lines of a range, a full line per iteration */
+static void warmRange (uint8_t *start, uint64_t length)
+{
+  uint8_t *p   = (uint8_t *)((uint64_t)start & ~(CACHE_LINE_SIZE - 1UL));
+  uint8_t *end = start + length;
+  cache_line_t acc = {0};
+
+  for (; p < end; p += CACHE_LINE_SIZE) {
+    acc ^= *(volatile cache_line_t *)p;
+  }
+  sink ^= acc;
+}
+
+int cacheIsWarmed (uint64_t offset, double fraction)
+{
+  uint32_t hash = (uint32_t)((offset / CACHE_LINE_SIZE) * 2654435761UL) >> 16; // Knuth's multiplicative hash
+
+  return fraction >= 1 || hash < fraction * 65536;
+}
+
+static void evictAll (struct cache_control *cc)
+{
+  struct eviction_slice slices[CACHE_MAX_THREADS];
+  pthread_t threads[CACHE_MAX_THREADS];
+  int created[CACHE_MAX_THREADS];
+  uint64_t chunk;
+  int t;
+
+  cc->round++;
+  chunk = (cc->eviction_size / cc->nthreads) & ~(CACHE_LINE_SIZE - 1UL);
+  for (t = 0; t < cc->nthreads; t++) {
+    slices[t].cc    = cc;
+    slices[t].start = t * chunk;
+    slices[t].end   = t == cc->nthreads - 1 ? cc->eviction_size : (t + 1) * chunk;
+  }
+  for (t = 1; t < cc->nthreads; t++) {
+    created[t] = pthread_create (&threads[t], NULL, evictSlice, &slices[t]) == 0;
+    if (!created[t]) {
+      evictSlice (&slices[t]);
+    }
+  }
+  evictSlice (&slices[0]);
+  for (t = 1; t < cc->nthreads; t++) {
+    if (created[t]) {
+      pthread_join (threads[t], NULL);
+    }
+  }
+}
+
+void cachePrepare (struct cache_control *cc, uint8_t *base, const struct cache_extent *e, int n, double fraction)
+{
+  uint64_t c, line, offset;
+  int i;
+
+  if (fraction < 1 && (cc->method & CACHE_EVICT)) {
+    evictAll (cc);
+  }
+  for (i = 0; i < n; i++) {
+    for (c = 0; c < e[i].count; c++) {
+      offset = e[i].offset + c * e[i].stride;
+      if (fraction >= 1) {
+        warmRange (base + offset, e[i].length);
+      } else if (fraction <= 0) {
+        if (cc->method & CACHE_FLUSH) {
+          flushRange (base + offset, e[i].length);
+        }
+      } else {
+        for (line = offset & ~(CACHE_LINE_SIZE - 1UL); line < offset + e[i].length; line += CACHE_LINE_SIZE) {
+          if (cacheIsWarmed (line, fraction)) {
+            warmRange (base + line, 1);
+          } else if (cc->method & CACHE_FLUSH) {
+            flushRange (base + line, 1);
+          }
+        }
+      }
+    }
+  }
+  flushFence ();
+}
+
+/* Cycles (or ns) of a load */
+static inline uint64_t timeAccess (volatile uint8_t *p)
+{
+#ifdef CACHE_X86
+  unsigned int aux;
+  uint64_t t0, t1;
+
+  t0 = __rdtscp (&aux);
+  _mm_lfence (); // rdtscp does not keep the following loads (this one, or the next sample) from starting before it
+  (void) *p;
+  t1 = __rdtscp (&aux);
+  _mm_lfence ();
+  return t1 - t0;
+#else
+  struct timespec t0, t1;
+
+  clock_gettime (CLOCK_MONOTONIC, &t0);
+  (void) *p;
+  clock_gettime (CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0.tv_sec) * 1000000000UL + t1.tv_nsec - t0.tv_nsec;
+#endif
+}
+
+/* Time of an access that misses every cache: the fastest of several reloads of a flushed line.
+   0 if the CPU cannot flush lines */
+static uint64_t missTime (void)
+{
+  static uint8_t probe[CACHE_LINE_SIZE] __attribute__ ((aligned (CACHE_LINE_SIZE)));
+  uint64_t t, best = 0;
+  int i;
+
+  if (!cacheCanFlush ()) {
+    return 0;
+  }
+  for (i = 0; i < CACHE_MISS_PROBES; i++) {
+    flushRange (probe, 1);
+    flushFence ();
+    t = timeAccess (probe);
+    best = i == 0 || t < best ? t : best;
+  }
+  return best;
+}
+
+double cacheVerify (struct cache_control *cc, uint8_t *base, const struct cache_extent *e, int n, double fraction)
+{
+  uint64_t lines_per_chunk, nlines, nsamples, spacing, k, j, line, cold, hot, right = 0, total = 0;
+  uint64_t order[CACHE_VERIFY_LINES], tmp, seed = 1, miss = missTime ();
+  int i, missed;
+
+  for (i = 0; i < n; i++) {
+    lines_per_chunk = (e[i].length + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE;
+    nlines = lines_per_chunk * e[i].count;
+    if (nlines == 0) {
+      continue;
+    }
+    /* Lines a page apart if there are enough of them, visited out of order so the prefetchers
+       do not bring the next sample */
+    nsamples = nlines / (CACHE_PAGE_SIZE / CACHE_LINE_SIZE);
+    nsamples = nsamples < 1 ? 1 : nsamples > CACHE_VERIFY_LINES / n ? CACHE_VERIFY_LINES / n : nsamples;
+    spacing  = nlines / nsamples;
+    /* Shuffled, because the stride prefetcher learns any constant step between the samples */
+    for (k = 0; k < nsamples; k++) {
+      order[k] = k;
+    }
+    for (k = nsamples - 1; k > 0; k--) {
+      seed     = seed * 6364136223846793005UL + 1442695040888963407UL;
+      j        = (seed >> 33) % (k + 1);
+      tmp      = order[k];
+      order[k] = order[j];
+      order[j] = tmp;
+    }
+    for (k = 0; k < nsamples; k++) {
+      j    = order[k] * spacing;
+      line = (e[i].offset + (j / lines_per_chunk) * e[i].stride + (j % lines_per_chunk) * CACHE_LINE_SIZE) & ~(CACHE_LINE_SIZE - 1UL);
+      cold = timeAccess (base + line);
+      hot  = timeAccess (base + line);
+      /* Closer to a miss than to a hit. The lines that are only in the last level cache are hits */
+      missed = miss > hot ? 2 * cold > miss + hot : cold > CACHE_MISS_RATIO * hot;
+      if (missed != cacheIsWarmed (line, fraction)) {
+        right++;
+      }
+      if (!cacheIsWarmed (line, fraction) && (cc->method & CACHE_FLUSH)) {
+        flushRange (base + line, 1);
+      }
+      total++;
+    }
+  }
+  flushFence ();
+  return total ? (double)right / total : 1;
+}
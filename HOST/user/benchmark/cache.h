@@ -0,0 +1,126 @@
+/**
+* @file cache.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Control of the state of the host caches before a measurement. The lines that the device
+* will access are warmed, flushed (clflush/clflushopt) or a fraction of them warmed and the rest
+* flushed, and the last level cache can be filled with an eviction set by several threads. The
+* resulting state can be checked by timing a sample of the lines.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#define CACHE_FLUSH          0x1   /**< Flush the lines that are not warmed */
+#define CACHE_EVICT          0x2   /**< Write an eviction set larger than the last level cache */
+#define CACHE_LINE_SIZE      64
+#define CACHE_DEFAULT_LLC    (16*1024*1024UL) /**< Size assumed if the last level cache cannot be detected */
+#define CACHE_EVICTION_RATIO 2     /**< Size of the eviction set in last level caches */
+#define CACHE_MAX_THREADS    16
+#define CACHE_VERIFY_LINES   64    /**< Maximum number of lines of the target range timed by cacheVerify */
+#define CACHE_MISS_RATIO     3     /**< cacheVerify: a miss takes this times the time of a hit if the CPU cannot flush lines */
+#define CACHE_MISS_PROBES    8     /**< cacheVerify: reloads of a flushed line that measure the time of a miss */
+
+/**
+* @brief Lines accessed by the device: count chunks of length bytes, stride bytes apart, from
+* offset.
+*/
+struct cache_extent {
+  uint64_t offset;
+  uint64_t length;
+  uint64_t stride;
+  uint64_t count;
+};
+
+/**
+* @brief Configuration of the controller. The eviction set is allocated once.
+*/
+struct cache_control {
+  int      method;         /**< CACHE_FLUSH and/or CACHE_EVICT */
+  int      nthreads;       /**< Threads that write the eviction set */
+  uint64_t llc_size;       /**< Size of the last level cache */
+  uint8_t *eviction_set;
+  uint64_t eviction_size;
+  uint64_t round;          /**< Value written in the last eviction, so the stores are never redundant */
+};
+
+/**
+* @brief Size of the last level cache of the CPU that runs the caller.
+*
+* @return The size in bytes, 0 if it cannot be detected.
+*/
+uint64_t cacheLLCSize (void);
+
+/**
+* @brief Check whether the CPU can flush lines (clflush).
+*/
+int cacheCanFlush (void);
+
+/**
+* @brief Prepare the controller. CACHE_FLUSH is dropped if the CPU cannot flush lines, and then
+* CACHE_EVICT is used instead.
+*
+* @param method CACHE_FLUSH and/or CACHE_EVICT.
+* @param nthreads Threads that write the eviction set (at most CACHE_MAX_THREADS).
+*
+* @return 0 if ok, a negative value if the eviction set could not be allocated.
+*/
+int cacheInit (struct cache_control *cc, int method, int nthreads);
+
+void cacheFree (struct cache_control *cc);
+
+/**
+* @brief Check whether a line is among the warmed ones. The choice only depends on the offset of
+* the line, so it is the same in every call.
+*
+* @param offset Offset of the line from the base of the extents.
+* @param fraction Fraction of the lines that are warmed.
+*/
+int cacheIsWarmed (uint64_t offset, double fraction);
+
+/**
+* @brief Set the state of the lines of the extents: the ones chosen by cacheIsWarmed are loaded
+* and the rest are flushed. If fraction is lower than 1 and CACHE_EVICT is set, the eviction set
+* is written first.
+*
+* @param base Address of the buffer. The extents are relative to it.
+* @param fraction 1 warms every line, 0 discards every line.
+*/
+void cachePrepare (struct cache_control *cc, uint8_t *base, const struct cache_extent *e, int n, double fraction);
+
+/**
+* @brief Time the first access to up to CACHE_VERIFY_LINES lines of the extents, at least 4KB apart
+* when possible (the prefetchers bring the rest of a page after a few misses). A line misses if its
+* time is closer to the one of a flushed line than to the one of an access that hits (or
+* CACHE_MISS_RATIO times the latter if the CPU cannot flush lines). The sampled lines that should not
+* be cached are flushed again afterwards (if the CPU can flush them), so the state is preserved.
+*
+* @return The fraction of the sampled lines that are in the state set by cachePrepare.
+*/
+double cacheVerify (struct cache_control *cc, uint8_t *base, const struct cache_extent *e, int n, double fraction);
+
+#endif
@@ -0,0 +1,127 @@
+/**
+* @file histogram.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Log-linear histogram of integer values.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+
+#include <string.h>
+#include <math.h>
+#include "histogram.h"
+
+#define SUB_BUCKETS (1UL << HISTOGRAM_SUB_BITS)
+
+void histogramReset (struct histogram *h)
+{
+  memset (h, 0, sizeof (struct histogram));
+  h->min = UINT64_MAX;
+}
+
+int histogramBucket (uint64_t value)
+{
+  int shift;
+
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+  // The HISTOGRAM_SUB_BITS bits after the most significant one select the bucket inside its power of 2
+  shift = 63 - __builtin_clzl (value) - HISTOGRAM_SUB_BITS;
+  return ((shift + 1) << HISTOGRAM_SUB_BITS) + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t histogramLowest (int bucket)
+{
+  int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+
+  if (shift < 0) {
+    return bucket;
+  }
+  return ((bucket & (SUB_BUCKETS - 1)) + SUB_BUCKETS) << shift;
+}
+
+uint64_t histogramHighest (int bucket)
+{
+  int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+
+  if (shift < 0) {
+    return bucket;
+  }
+  return histogramLowest (bucket) + ((1UL << shift) - 1);
+}
+
+void histogramAdd (struct histogram *h, uint64_t value)
+{
+  h->counts[histogramBucket (value)]++;
+  h->n++;
+  h->sum    += value;
+  h->sum_sq += (double)value * value;
+  if (value < h->min) {
+    h->min = value;
+  }
+  if (value > h->max) {
+    h->max = value;
+  }
+}
+
+double histogramMean (struct histogram *h)
+{
+  return h->n ? h->sum / h->n : 0;
+}
+
+double histogramStddev (struct histogram *h)
+{
+  double var;
+
+  if (h->n < 2) {
+    return 0;
+  }
+  var = (h->sum_sq - h->sum * h->sum / h->n) / (h->n - 1);
+  return var > 0 ? sqrt (var) : 0;
+}
+
+uint64_t histogramPercentile (struct histogram *h, double p)
+{
+  uint64_t rank, acc = 0;
+  int b;
+
+  if (h->n == 0) {
+    return 0;
+  }
+  rank = (uint64_t)ceil (p / 100.0 * h->n);
+  if (rank <= 1) {
+    return h->min;
+  }
+  if (rank >= h->n) {
+    return h->max;
+  }
+  for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    acc += h->counts[b];
+    if (acc >= rank) {
+      break;
+    }
+  }
+  return histogramHighest (b) < h->max ? histogramHighest (b) : h->max;
+}
@@ -0,0 +1,93 @@
+/**
+* @file histogram.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Log-linear histogram of integer values (as HdrHistogram does): the values lower than
+* 2^HISTOGRAM_SUB_BITS have a bucket each, and every power of 2 above them is split in
+* 2^HISTOGRAM_SUB_BITS buckets of the same width. The relative error of any value is lower than
+* 2^-HISTOGRAM_SUB_BITS and the memory is fixed, whatever the number of samples.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 7  /**< log2 of the buckets per power of 2: a relative error below 0.8% */
+#define HISTOGRAM_BUCKETS  ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) /**< Enough for any uint64_t */
+
+/**
+* @brief Samples of a point.
+*/
+struct histogram {
+  uint64_t counts[HISTOGRAM_BUCKETS];
+  uint64_t n;        /**< Number of samples */
+  uint64_t min;
+  uint64_t max;
+  double   sum;
+  double   sum_sq;   /**< Sum of the squares, for the standard deviation */
+};
+
+/**
+* @brief Discard the samples so the structure can be used for a new point.
+*/
+void histogramReset (struct histogram *h);
+
+/**
+* @brief Store a new sample.
+*/
+void histogramAdd (struct histogram *h, uint64_t value);
+
+/**
+* @brief Bucket of a value.
+*/
+int histogramBucket (uint64_t value);
+
+/**
+* @brief Lowest value of a bucket.
+*/
+uint64_t histogramLowest (int bucket);
+
+/**
+* @brief Highest value of a bucket.
+*/
+uint64_t histogramHighest (int bucket);
+
+double histogramMean (struct histogram *h);
+
+/**
+* @brief Sample standard deviation (n-1 in the denominator).
+*/
+double histogramStddev (struct histogram *h);
+
+/**
+* @brief Nearest-rank percentile: the highest value of the bucket of the sample of that rank
+* (the exact minimum and maximum for the first and the last one).
+*
+* @param p Percentile in the range [0, 100].
+*/
+uint64_t histogramPercentile (struct histogram *h, double p);
+
+#endif
@@ -0,0 +1,415 @@
+/**
+* @file results.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Writer of the results of the benchmark in CSV, JSON lines or binary columnar format.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "results.h"
+
+#define RING_WAKE_FRACTION 4  /**< The background writer is woken up when the ring is 1/4 full */
+
+/**
+* @brief Ring between the rows and the file. The producer (the stream of the writer) only moves
+* head and the background thread only moves tail, so the bytes are copied without the lock.
+*/
+struct result_ring {
+  char                    *data;
+  uint64_t                 size;
+  uint64_t                 head;     /**< Bytes copied to the ring since the file was opened */
+  uint64_t                 tail;     /**< Bytes written in the file */
+  int                      fd;
+  int                      flush;    /**< Write everything, even if the ring is not full enough to wake up the writer */
+  int                      stop;
+  int                      error;    /**< The file could not be written: the ring discards the bytes */
+  struct result_ring_stats stats;
+  pthread_mutex_t          lock;
+  pthread_cond_t           not_empty;
+  pthread_cond_t           not_full;
+  pthread_t                thread;
+};
+
+/* JSON strings of the schema and of the values are plain names: only the quotes and the
+   backslashes need to be escaped. */
+static void writeJsonString (FILE *f, const char *s)
+{
+  fputc ('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc ('\\', f);
+    }
+    fputc (*s, f);
+  }
+  fputc ('"', f);
+}
+
+static uint64_t nowNs (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* The background writer: it sleeps until the ring is full enough, a flush or the close */
+static void *ringWriter (void *arg)
+{
+  struct result_ring *r = arg;
+  uint64_t n;
+  ssize_t written;
+
+  pthread_mutex_lock (&r->lock);
+  for (;;) {
+    while (r->head - r->tail < r->size / RING_WAKE_FRACTION && !r->flush && !r->stop) {
+      pthread_cond_wait (&r->not_empty, &r->lock);
+    }
+    if (r->head == r->tail) {
+      r->flush = 0;
+      if (r->stop) {
+        break;
+      }
+      continue;
+    }
+
+    // The bytes between tail and head are not touched by the producer
+    n = r->head - r->tail;
+    if (r->tail % r->size + n > r->size) {
+      n = r->size - r->tail % r->size;
+    }
+    pthread_mutex_unlock (&r->lock);
+    written = r->error ? (ssize_t)n : write (r->fd, r->data + r->tail % r->size, n);
+    pthread_mutex_lock (&r->lock);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      r->error = 1;
+      written  = n;
+    }
+    r->tail += written;
+    pthread_cond_broadcast (&r->not_full);
+  }
+  pthread_mutex_unlock (&r->lock);
+  return NULL;
+}
+
+/* Write function of the stream of a writer with a ring (fopencookie) */
+static ssize_t ringWrite (void *cookie, const char *buf, size_t size)
+{
+  struct result_ring *r = cookie;
+  uint64_t n, t0 = 0;
+  size_t done = 0;
+
+  pthread_mutex_lock (&r->lock);
+  while (done < size && !r->error) {
+    if (r->head - r->tail == r->size) {
+      if (t0 == 0) {
+        t0 = nowNs ();
+        r->stats.blocked++;
+      }
+      r->flush = 1;
+      pthread_cond_signal (&r->not_empty);
+      pthread_cond_wait (&r->not_full, &r->lock);
+      continue;
+    }
+    n = r->size - (r->head - r->tail);
+    n = n < size - done ? n : size - done;
+    if (r->head % r->size + n > r->size) {
+      n = r->size - r->head % r->size;
+    }
+    pthread_mutex_unlock (&r->lock);
+    memcpy (r->data + r->head % r->size, buf + done, n);
+    pthread_mutex_lock (&r->lock);
+    r->head += n;
+    done    += n;
+    if (r->head - r->tail > r->stats.peak) {
+      r->stats.peak = r->head - r->tail;
+    }
+    if (r->head - r->tail >= r->size / RING_WAKE_FRACTION) {
+      pthread_cond_signal (&r->not_empty);
+    }
+  }
+  if (t0) {
+    r->stats.blocked_ns += nowNs () - t0;
+  }
+  r->stats.bytes += done;
+  pthread_mutex_unlock (&r->lock);
+  return r->error ? -1 : (ssize_t)size;
+}
+
+/* Close function of the stream: the writer empties the ring before the file is closed */
+static int ringClose (void *cookie)
+{
+  struct result_ring *r = cookie;
+  int error;
+
+  pthread_mutex_lock (&r->lock);
+  r->stop = 1;
+  pthread_cond_signal (&r->not_empty);
+  pthread_mutex_unlock (&r->lock);
+  pthread_join (r->thread, NULL);
+
+  error = r->error || close (r->fd);
+  pthread_mutex_destroy (&r->lock);
+  pthread_cond_destroy (&r->not_empty);
+  pthread_cond_destroy (&r->not_full);
+  free (r->data);
+  free (r);
+  return error ? -1 : 0;
+}
+
+/**
+* @brief Open the file with a ring and its background writer.
+*
+* @param empty Set to 1 if the file is empty (a CSV header is needed).
+*
+* @return A stream whose writes are copied to the ring, NULL on error.
+*/
+static FILE *ringOpen (struct result_writer *w, const char *path, size_t size, int *empty)
+{
+  cookie_io_functions_t io = {.read = NULL, .write = ringWrite, .seek = NULL, .close = ringClose};
+  struct result_ring *r;
+  FILE *f;
+
+  r = calloc (1, sizeof (struct result_ring));
+  if (r == NULL) {
+    return NULL;
+  }
+  r->size = size;
+  r->data = malloc (size);
+  r->fd   = open (path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (r->data == NULL || r->fd < 0) {
+    goto error;
+  }
+  memset (r->data, 0, size); // Fault the pages in now, not while the rows are copied
+  *empty = lseek (r->fd, 0, SEEK_END) == 0;
+  r->stats.size = size;
+  pthread_mutex_init (&r->lock, NULL);
+  pthread_cond_init (&r->not_empty, NULL);
+  pthread_cond_init (&r->not_full, NULL);
+  if (pthread_create (&r->thread, NULL, ringWriter, r)) {
+    pthread_mutex_destroy (&r->lock);
+    pthread_cond_destroy (&r->not_empty);
+    pthread_cond_destroy (&r->not_full);
+    goto error;
+  }
+
+  f = fopencookie (r, "w", io);
+  if (f == NULL) {
+    ringClose (r);
+    return NULL;
+  }
+  w->ring = r;
+  return f;
+
+error:
+  if (r->fd >= 0) {
+    close (r->fd);
+  }
+  free (r->data);
+  free (r);
+  return NULL;
+}
+
+static void writeValue (struct result_writer *w, uint8_t type, union result_value v)
+{
+  switch (type) {
+  case RESULT_U64:
+    fprintf (w->f, "%lu", v.u);
+    break;
+  case RESULT_I64:
+    fprintf (w->f, "%ld", v.i);
+    break;
+  case RESULT_F64:
+    fprintf (w->f, "%.9g", v.f);
+    break;
+  case RESULT_STR:
+    if (w->format == RESULT_JSONL) {
+      writeJsonString (w->f, v.s);
+    } else {
+      fputs (v.s, w->f);
+    }
+    break;
+  }
+}
+
+static int writeSchemaChunk (struct result_writer *w)
+{
+  uint32_t ncolumns = w->ncolumns;
+  uint8_t type, length;
+  int c;
+
+  if (fwrite (RESULT_BINARY_MAGIC, 8, 1, w->f) != 1 || fwrite (&ncolumns, sizeof (ncolumns), 1, w->f) != 1) {
+    return -1;
+  }
+  for (c = 0; c < w->ncolumns; c++) {
+    type   = w->columns[c].type;
+    length = strlen (w->columns[c].name);
+    if (fwrite (&type, 1, 1, w->f) != 1 || fwrite (&length, 1, 1, w->f) != 1 ||
+        fwrite (w->columns[c].name, length, 1, w->f) != 1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int resultOpen (struct result_writer *w, const char *path, uint8_t format, const struct result_column *columns, int ncolumns,
+                size_t ring_size)
+{
+  int c, empty = 0;
+
+  memset (w, 0, sizeof (struct result_writer));
+  if (ncolumns > RESULT_MAX_COLUMNS) {
+    return -1;
+  }
+  w->format   = format;
+  w->columns  = columns;
+  w->ncolumns = ncolumns;
+  if (ring_size) {
+    w->f = ringOpen (w, path, ring_size, &empty);
+  } else {
+    w->f = fopen (path, format == RESULT_BINARY ? "ab" : "a");
+    if (w->f) {
+      fseek (w->f, 0, SEEK_END);
+      empty = ftell (w->f) == 0;
+    }
+  }
+  if (w->f == NULL) {
+    return -1;
+  }
+
+  switch (format) {
+  case RESULT_CSV:
+    if (empty) {
+      for (c = 0; c < ncolumns; c++) {
+        fprintf (w->f, "%s%s", c ? "," : "", columns[c].name);
+      }
+      fprintf (w->f, "\n");
+    }
+    break;
+  case RESULT_BINARY:
+    w->block = malloc (RESULT_BLOCK_ROWS * ncolumns * sizeof (uint64_t));
+    if (w->block == NULL || writeSchemaChunk (w)) {
+      resultClose (w);
+      return -1;
+    }
+    break;
+  }
+  return 0;
+}
+
+int resultWrite (struct result_writer *w, const union result_value *row)
+{
+  uint64_t *cell;
+  int c;
+
+  if (w->format == RESULT_BINARY) {
+    for (c = 0; c < w->ncolumns; c++) {
+      cell = &w->block[c * RESULT_BLOCK_ROWS + w->nrows];
+      if (w->columns[c].type == RESULT_STR) {
+        *cell = 0;
+        strncpy ((char *)cell, row[c].s, sizeof (uint64_t));
+      } else {
+        memcpy (cell, &row[c], sizeof (uint64_t));
+      }
+    }
+    if (++w->nrows == RESULT_BLOCK_ROWS) {
+      return resultFlush (w);
+    }
+    return 0;
+  }
+
+  if (w->format == RESULT_JSONL) {
+    fputc ('{', w->f);
+  }
+  for (c = 0; c < w->ncolumns; c++) {
+    if (c) {
+      fputc (',', w->f);
+    }
+    if (w->format == RESULT_JSONL) {
+      writeJsonString (w->f, w->columns[c].name);
+      fputc (':', w->f);
+    }
+    writeValue (w, w->columns[c].type, row[c]);
+  }
+  fputs (w->format == RESULT_JSONL ? "}\n" : "\n", w->f);
+  return ferror (w->f) ? -1 : 0;
+}
+
+int resultFlush (struct result_writer *w)
+{
+  int c;
+
+  if (w->format == RESULT_BINARY && w->nrows) {
+    if (fwrite (&w->nrows, sizeof (w->nrows), 1, w->f) != 1) {
+      return -1;
+    }
+    for (c = 0; c < w->ncolumns; c++) {
+      if (fwrite (&w->block[c * RESULT_BLOCK_ROWS], sizeof (uint64_t), w->nrows, w->f) != w->nrows) {
+        return -1;
+      }
+    }
+    w->nrows = 0;
+  }
+  if (fflush (w->f)) {
+    return -1;
+  }
+  if (w->ring) {
+    pthread_mutex_lock (&w->ring->lock);
+    w->ring->flush = 1;
+    pthread_cond_signal (&w->ring->not_empty);
+    pthread_mutex_unlock (&w->ring->lock);
+  }
+  return 0;
+}
+
+int resultRingStats (struct result_writer *w, struct result_ring_stats *s)
+{
+  if (w->ring == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock (&w->ring->lock);
+  *s = w->ring->stats;
+  pthread_mutex_unlock (&w->ring->lock);
+  return 0;
+}
+
+void resultClose (struct result_writer *w)
+{
+  if (w->f) {
+    resultFlush (w);
+    fclose (w->f);
+  }
+  free (w->block);
+  memset (w, 0, sizeof (struct result_writer));
+}
@@ -0,0 +1,149 @@
+/**
+* @file results.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Writer of the results of the benchmark. A results file has a fixed schema (an
+* ordered list of typed columns) and it is written as CSV, JSON lines or a binary columnar
+* format, so the rows can be loaded without parsing ad-hoc text.
+*
+* Binary format (little endian). The file is a sequence of chunks:
+*   - Schema chunk: the magic RESULT_BINARY_MAGIC (8 bytes), uint32 number of columns and,
+*     per column, uint8 type (enum result_type), uint8 length of the name and the name.
+*     Every run that appends to the file starts with a schema chunk.
+*   - Data block: uint32 number of rows (1..RESULT_BLOCK_ROWS) followed by the values of
+*     each column: number of rows * 8 bytes per column. RESULT_STR values are NUL padded
+*     (and truncated) to 8 bytes. As the number of rows is lower than the first 4 bytes of the
+*     magic, a reader tells a schema chunk from a data block by its first uint32.
+*
+* A writer can keep the output in a preallocated ring instead of writing it from the thread that
+* measures: a background thread moves the ring to the file when it is a quarter full, when the
+* file is flushed and when it is closed. The measurements only wait if the ring is full.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define RESULT_MAX_COLUMNS  64          /**< Maximum number of columns of a schema */
+#define RESULT_BLOCK_ROWS   4096        /**< Rows of a block of the binary format */
+#define RESULT_BINARY_MAGIC "NFPRES1"   /**< Including the NUL, 8 bytes */
+
+enum result_format {
+  RESULT_CSV,
+  RESULT_JSONL,
+  RESULT_BINARY
+};
+
+enum result_type {
+  RESULT_U64,
+  RESULT_I64,
+  RESULT_F64,
+  RESULT_STR
+};
+
+struct result_column {
+  const char *name;
+  uint8_t     type;    /**< enum result_type */
+};
+
+union result_value {
+  uint64_t    u;
+  int64_t     i;
+  double      f;
+  const char *s;
+};
+
+/**
+* @brief Activity of the ring of a writer.
+*/
+struct result_ring_stats {
+  uint64_t size;        /**< Bytes of the ring */
+  uint64_t bytes;       /**< Bytes that went through the ring */
+  uint64_t peak;        /**< Maximum number of bytes waiting in the ring */
+  uint64_t blocked;     /**< Writes that had to wait for free space in the ring */
+  uint64_t blocked_ns;  /**< Time spent waiting for free space */
+};
+
+struct result_ring;
+
+/**
+* @brief An open results file. The binary format keeps the rows of the current block by column.
+*/
+struct result_writer {
+  FILE                       *f;      /**< The file, or a stream that copies to the ring */
+  struct result_ring         *ring;   /**< NULL if the rows are written by the caller */
+  uint8_t                     format;
+  const struct result_column *columns;
+  int                         ncolumns;
+  uint64_t                   *block;  /**< Binary format: RESULT_BLOCK_ROWS values per column */
+  uint32_t                    nrows;  /**< Binary format: rows in block */
+};
+
+/**
+* @brief Open (in append mode) a results file. The CSV header is written only if the file is
+* empty; the binary format writes a schema chunk.
+*
+* @param columns The schema. It must remain valid until resultClose.
+* @param ring_size Bytes of the ring of the background writer. 0 writes the rows in the file from
+* the calling thread.
+*
+* @return 0 if ok, a negative value if the file could not be opened, the schema is too large or
+* the ring could not be allocated.
+*/
+int resultOpen (struct result_writer *w, const char *path, uint8_t format, const struct result_column *columns, int ncolumns,
+                size_t ring_size);
+
+/**
+* @brief Write a row.
+*
+* @param row One value per column of the schema, in the same order.
+*
+* @return 0 if ok, a negative value if the row could not be written.
+*/
+int resultWrite (struct result_writer *w, const union result_value *row);
+
+/**
+* @brief Write the pending rows to the file. With a ring, they are copied to it and the background
+* writer is woken up, but the call does not wait for the file.
+*/
+int resultFlush (struct result_writer *w);
+
+/**
+* @brief Activity of the ring since the file was opened. Call resultFlush first to count the rows
+* that are still in the buffers of the writer.
+*
+* @return 0 if ok, a negative value if the writer has no ring.
+*/
+int resultRingStats (struct result_writer *w, struct result_ring_stats *s);
+
+/**
+* @brief Flush and close the file. With a ring, it waits until the background writer has emptied it.
+*/
+void resultClose (struct result_writer *w);
+
+#endif
@@ -0,0 +1,132 @@
+/**
+* @file statistics.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Aggregation of the samples measured for a point of the benchmark.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "statistics.h"
+
+/* Two sided 95% critical values of Student's t for 1..30 degrees of freedom. */
+static const double t95[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+int statsInit (struct statistics *st, uint64_t capacity)
+{
+  memset (st, 0, sizeof (struct statistics));
+  st->samples = malloc (capacity * sizeof (double));
+  if (st->samples == NULL) {
+    return -1;
+  }
+  st->capacity = capacity;
+  return 0;
+}
+
+void statsFree (struct statistics *st)
+{
+  free (st->samples);
+  memset (st, 0, sizeof (struct statistics));
+}
+
+void statsReset (struct statistics *st)
+{
+  st->n      = 0;
+  st->sum    = 0;
+  st->sorted = 1;
+}
+
+int statsAdd (struct statistics *st, double value)
+{
+  if (st->n == st->capacity) {
+    return -1;
+  }
+  st->samples[st->n++] = value;
+  st->sum   += value;
+  st->sorted = 0;
+  return 0;
+}
+
+double statsMean (struct statistics *st)
+{
+  return st->n ? st->sum / st->n : 0;
+}
+
+double statsStddev (struct statistics *st)
+{
+  double mean = statsMean (st), acc = 0;
+  uint64_t i;
+
+  if (st->n < 2) {
+    return 0;
+  }
+  for (i = 0; i < st->n; i++) {
+    acc += (st->samples[i] - mean) * (st->samples[i] - mean);
+  }
+  return sqrt (acc / (st->n - 1));
+}
+
+static int compareDouble (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+double statsPercentile (struct statistics *st, double p)
+{
+  uint64_t rank;
+
+  if (st->n == 0) {
+    return 0;
+  }
+  if (!st->sorted) {
+    qsort (st->samples, st->n, sizeof (double), compareDouble);
+    st->sorted = 1;
+  }
+  rank = (uint64_t)ceil (p / 100.0 * st->n);
+  return st->samples[rank ? rank - 1 : 0];
+}
+
+double statsCI95 (struct statistics *st)
+{
+  uint64_t df = st->n - 1;
+  double t;
+
+  if (st->n < STATS_MIN_SAMPLES_CI) {
+    return 0;
+  }
+  if (df <= sizeof (t95) / sizeof (*t95)) {
+    t = t95[df - 1];
+  } else {
+    t = df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+  }
+  return t * statsStddev (st) / sqrt (st->n);
+}
@@ -0,0 +1,94 @@
+/**
+* @file statistics.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Aggregation of the samples measured for a point of the benchmark: order
+* statistics, standard deviation and confidence interval of the mean.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <stdint.h>
+
+#define STATS_MIN_SAMPLES_CI 2  /**< Minimum number of samples to compute a confidence interval */
+
+/**
+* @brief Samples of a point. The buffer is allocated once and reused between points.
+*/
+struct statistics {
+  double   *samples;   /**< Values in order of arrival (sorted on demand) */
+  uint64_t n;          /**< Number of samples stored */
+  uint64_t capacity;   /**< Size of samples */
+  double   sum;
+  uint8_t  sorted;
+};
+
+/**
+* @brief Reserve room for capacity samples.
+*
+* @return 0 if ok, a negative value if the memory could not be allocated.
+*/
+int statsInit (struct statistics *st, uint64_t capacity);
+
+/**
+* @brief Release the memory of the samples.
+*/
+void statsFree (struct statistics *st);
+
+/**
+* @brief Discard the samples so the structure can be used for a new point.
+*/
+void statsReset (struct statistics *st);
+
+/**
+* @brief Store a new sample.
+*
+* @return 0 if ok, a negative value if there is no room for it.
+*/
+int statsAdd (struct statistics *st, double value);
+
+double statsMean (struct statistics *st);
+
+/**
+* @brief Sample standard deviation (n-1 in the denominator).
+*/
+double statsStddev (struct statistics *st);
+
+/**
+* @brief Nearest-rank percentile. statsPercentile(st, 50) is the median.
+*
+* @param p Percentile in the range [0, 100].
+*/
+double statsPercentile (struct statistics *st, double p);
+
+/**
+* @brief Half width of the 95% confidence interval of the mean (Student's t).
+*
+* @return The half width. 0 if there are less than STATS_MIN_SAMPLES_CI samples.
+*/
+double statsCI95 (struct statistics *st);
+
+#endif
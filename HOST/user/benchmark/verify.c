@@ -0,0 +1,163 @@
+/**
+* @file verify.c
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Check of the data moved by the DMA core. The pattern and the checks work on whole
+* lines in vector registers (GCC vector extensions), and only the lines that differ from what
+* is expected are inspected unit by unit.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+
+#include <string.h>
+#include "verify.h"
+
+#define VERIFY_LINE_SIZE  64
+#define UNITS_PER_LINE    (VERIFY_LINE_SIZE / VERIFY_UNIT_SIZE)
+#define MUL_OFFSET        0x9E3779B97F4A7C15UL
+#define MUL_SEED          0xC2B2AE3D27D4EB4FUL
+#define MUL_MIX           0xD6E8FEB86659FD93UL
+#define STAMP_MASK        0xFFFFFFFF00000000UL // Bits of the first word of a unit that the counter does not use
+
+typedef uint64_t verify_line_t __attribute__ ((vector_size (VERIFY_LINE_SIZE))); /**< A line in vector registers */
+typedef uint64_t verify_unit_t __attribute__ ((vector_size (VERIFY_UNIT_SIZE)));
+
+/* Pattern of the 8 words of the line at offset. Every word is a hash of its offset and the seed,
+   so a unit that the core moves to another position does not match it */
+static inline void linePattern (verify_line_t *x, uint64_t offset, uint64_t seed)
+{
+  const verify_line_t lanes = {0, 8, 16, 24, 32, 40, 48, 56};
+
+  *x  = (offset + lanes) * MUL_OFFSET + seed * MUL_SEED;
+  *x ^= *x >> 31;
+  *x *= MUL_MIX;
+  *x ^= *x >> 29;
+}
+
+static inline verify_unit_t unitPattern (uint64_t offset, uint64_t seed)
+{
+  const verify_unit_t lanes = {0, 8};
+  verify_unit_t x = (offset + lanes) * MUL_OFFSET + seed * MUL_SEED;
+
+  x ^= x >> 31;
+  x *= MUL_MIX;
+  x ^= x >> 29;
+  return x;
+}
+
+static inline int lineIsZero (const verify_line_t *x)
+{
+  uint64_t acc = 0;
+  int i;
+
+  for (i = 0; i < VERIFY_LINE_SIZE / 8; i++) {
+    acc |= (*x)[i];
+  }
+  return acc == 0;
+}
+
+/* Run unit_body for the units at the edges of [start, end) and line_body for its aligned lines.
+   The range is rounded to whole units */
+#define FOR_EACH_UNIT_AND_LINE(start, end, o, unit_body, line_body) \
+  do { \
+    o = (start) & ~(VERIFY_UNIT_SIZE - 1UL); \
+    for (; o < (end) && o % VERIFY_LINE_SIZE; o += VERIFY_UNIT_SIZE) { unit_body; } \
+    for (; o + VERIFY_LINE_SIZE <= (end); o += VERIFY_LINE_SIZE) { line_body; } \
+    for (; o < (end); o += VERIFY_UNIT_SIZE) { unit_body; } \
+  } while (0)
+
+void verifyFill (uint8_t *base, const struct cache_extent *e, int n, uint64_t seed)
+{
+  verify_line_t line;
+  verify_unit_t unit;
+  uint64_t c, start, o;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    for (c = 0; c < e[i].count; c++) {
+      start = e[i].offset + c * e[i].stride;
+      FOR_EACH_UNIT_AND_LINE(start, start + e[i].length, o,
+                             unit = unitPattern (o, seed); memcpy (base + o, &unit, sizeof (unit)),
+                             linePattern (&line, o, seed); memcpy (base + o, &line, sizeof (line)));
+    }
+  }
+}
+
+static void checkUnit (const uint8_t *p, uint64_t offset, uint64_t seed, int expect, struct verify_result *r)
+{
+  verify_unit_t v, pattern = unitPattern (offset, seed);
+
+  memcpy (&v, p, sizeof (v));
+  r->units++;
+  if ((v[0] & STAMP_MASK) == 0 && v[1] == 0) {
+    r->stamps++;
+    if (expect != VERIFY_PATTERN) {
+      return;
+    }
+  } else if (v[0] == pattern[0] && v[1] == pattern[1] && expect != VERIFY_STAMP) {
+    return;
+  }
+  if (r->errors++ == 0) {
+    r->first_error = offset;
+  }
+}
+
+static void checkLine (const uint8_t *p, uint64_t offset, uint64_t seed, int expect, struct verify_result *r)
+{
+  const verify_line_t stamp_mask = {STAMP_MASK, ~0UL, STAMP_MASK, ~0UL, STAMP_MASK, ~0UL, STAMP_MASK, ~0UL};
+  verify_line_t v, pattern, diff, stamp;
+  int u;
+
+  memcpy (&v, p, sizeof (v));
+  linePattern (&pattern, offset, seed);
+  diff  = v ^ pattern;
+  stamp = v & stamp_mask;
+  if (expect != VERIFY_STAMP && lineIsZero (&diff)) {
+    r->units += UNITS_PER_LINE;
+  } else if (expect != VERIFY_PATTERN && lineIsZero (&stamp)) {
+    r->units  += UNITS_PER_LINE;
+    r->stamps += UNITS_PER_LINE;
+  } else {
+    for (u = 0; u < UNITS_PER_LINE; u++) {
+      checkUnit (p + u * VERIFY_UNIT_SIZE, offset + u * VERIFY_UNIT_SIZE, seed, expect, r);
+    }
+  }
+}
+
+void verifyCheck (const uint8_t *base, const struct cache_extent *e, int n, uint64_t seed, int expect,
+                  struct verify_result *r)
+{
+  uint64_t c, start, o;
+  int i;
+
+  memset (r, 0, sizeof (struct verify_result));
+  for (i = 0; i < n; i++) {
+    for (c = 0; c < e[i].count; c++) {
+      start = e[i].offset + c * e[i].stride;
+      FOR_EACH_UNIT_AND_LINE(start, start + e[i].length, o,
+                             checkUnit (base + o, o, seed, expect, r),
+                             checkLine (base + o, o, seed, expect, r));
+    }
+  }
+}
@@ -0,0 +1,84 @@
+/**
+* @file verify.h
+*
+* Copyright (c) 2016
+* All rights reserved.
+*
+*
+* @NETFPGA_LICENSE_HEADER_START@
+*
+* Licensed to NetFPGA C.I.C. (NetFPGA) under one or more contributor
+* license agreements.  See the NOTICE file distributed with this work for
+* additional information regarding copyright ownership.  NetFPGA licenses this
+* file to you under the NetFPGA Hardware-Software License, Version 1.0 (the
+* "License"); you may not use this file except in compliance with the
+* License.  You may obtain a copy of the License at:
+*
+*   http://www.netfpga-cic.org
+*
+* Unless required by applicable law or agreed to in writing, Work distributed
+* under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+* CONDITIONS OF ANY KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations under the License.
+*
+* @NETFPGA_LICENSE_HEADER_END@
+*
+* @brief Check of the data moved by the DMA core. Before a set of descriptors the lines that the
+* core will access are filled with a pattern that depends on a seed and on the offset of each
+* word. Afterwards, out of the timed region, every 16 byte unit is compared with what it should
+* hold: the pattern if the core only reads the buffer, or the stamp of the application of the
+* FPGA (FPGA/source/hdl/app/app.v) if it writes it. The application sends 256-bit words with a
+* 32-bit counter in the less significant bits and zeros in the rest, and dma_rq_logic splits
+* them in two units, so a unit written by the core is {counter, 0, 0, 0} or all zeros.
+* @author José Fernando Zazo Rollón, josefernando.zazo@estudiante.uam.es
+* @date 2026-10-17
+*/
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include "cache.h"
+
+#define VERIFY_UNIT_SIZE 16  /**< Bytes of a unit of the stream of the application (half a 256-bit word) */
+
+/**
+* @brief What the units of the extents must hold after the descriptors.
+*/
+enum verify_expect {
+  VERIFY_PATTERN,          /**< The core only reads the buffer: the pattern is intact */
+  VERIFY_STAMP,            /**< The core writes every unit of the extents */
+  VERIFY_PATTERN_OR_STAMP  /**< The core writes some of the units (random addresses) */
+};
+
+/**
+* @brief Outcome of verifyCheck.
+*/
+struct verify_result {
+  uint64_t units;        /**< Units checked */
+  uint64_t stamps;       /**< Units that hold a stamp of the application */
+  uint64_t errors;       /**< Units that hold neither of the allowed values */
+  uint64_t first_error;  /**< Offset of the first wrong unit from the base. Valid if errors > 0 */
+};
+
+/**
+* @brief Fill the units of the extents with the pattern of a seed. The units that overlap the
+* edges of an extent are filled as a whole.
+*
+* @param base Address of the buffer. The extents are relative to it (see cache_extent).
+* @param seed Selects the pattern. Any value but a different one for each set of descriptors, so
+* data of a previous set is not taken as valid.
+*/
+void verifyFill (uint8_t *base, const struct cache_extent *e, int n, uint64_t seed);
+
+/**
+* @brief Check the units of the extents filled by verifyFill with the same seed. The units that
+* overlap the edges of an extent are checked as a whole too, so a core that writes the extents
+* can only be checked if they start and end at multiples of VERIFY_UNIT_SIZE bytes from the base.
+*
+* @param expect enum verify_expect.
+* @param r Where the counts are stored.
+*/
+void verifyCheck (const uint8_t *base, const struct cache_extent *e, int n, uint64_t seed, int expect,
+                  struct verify_result *r);
+
+#endif